@@ -0,0 +1,209 @@
+#ifndef HALIDE_ASSOCIATIVE_OPS_INDEX_H
+#define HALIDE_ASSOCIATIVE_OPS_INDEX_H
+
+/** \file
+ *
+ * Index over the patterns of the associative ops tables, so that looking up
+ * a reduction does not try every entry of its root table (292 of them for
+ * max). The patterns of the first tuple element go into a discrimination
+ * tree: a trie over their nodes in preorder, where the variables (x0, y0,
+ * k0, ...) are wildcards that match any subexpression. A lookup walks the
+ * trie along the reduction, skipping a whole subexpression for a wildcard,
+ * and only the entries it reaches are checked with expr_match, in table
+ * order. That returns the same entry as trying them all, at a cost that
+ * depends on the shape of the reduction rather than the size of the table.
+ */
+
+#include "AssociativeOpsTable.h"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+namespace Halide {
+namespace Internal {
+
+class AssociativeOpsIndex {
+    enum Node {
+        OtherNode = 0, IntImmNode, UIntImmNode, VariableNode, AddNode, SubNode, MulNode, DivNode,
+        ModNode, MinNode, MaxNode, EQNode, NENode, LTNode, LENode, GTNode, GENode, AndNode, OrNode
+    };
+
+    // A node of an expression: its kind, and its value for constants
+    typedef std::pair<int, int64_t> Key;
+
+    // Preorder keys of an expression, with the number of nodes under each
+    struct Flat {
+        std::vector<Key> keys;
+        std::vector<int> sizes;
+    };
+
+    struct TrieNode {
+        std::map<Key, int> children;
+        int wildcard;
+        std::vector<int> entries;  // Entries of the table ending here
+
+        TrieNode() : wildcard(-1) {}
+    };
+
+    const std::vector<std::vector<AssociativePair>> *table;
+    std::vector<TrieNode> trie;
+
+    template<typename Op>
+    static bool operands(const Expr &e, Expr &a, Expr &b) {
+        if (const Op *op = e.as<Op>()) {
+            a = op->a;
+            b = op->b;
+            return true;
+        }
+        return false;
+    }
+
+    static Node binary_node(const Expr &e, Expr &a, Expr &b) {
+        return operands<Add>(e, a, b) ? AddNode : operands<Sub>(e, a, b) ? SubNode :
+               operands<Mul>(e, a, b) ? MulNode : operands<Div>(e, a, b) ? DivNode :
+               operands<Mod>(e, a, b) ? ModNode : operands<Min>(e, a, b) ? MinNode :
+               operands<Max>(e, a, b) ? MaxNode : operands<EQ>(e, a, b) ? EQNode :
+               operands<NE>(e, a, b) ? NENode : operands<LT>(e, a, b) ? LTNode :
+               operands<LE>(e, a, b) ? LENode : operands<GT>(e, a, b) ? GTNode :
+               operands<GE>(e, a, b) ? GENode : operands<And>(e, a, b) ? AndNode :
+               operands<Or>(e, a, b) ? OrNode : OtherNode;
+    }
+
+    // Nodes the tables are not made of are leaves, which only a wildcard
+    // matches
+    static void flatten(const Expr &e, Flat &flat) {
+        size_t at = flat.keys.size();
+        flat.keys.push_back(Key(OtherNode, 0));
+        flat.sizes.push_back(1);
+        Expr a, b;
+        if (e.as<Variable>()) {
+            flat.keys[at].first = VariableNode;
+        } else if (const IntImm *imm = e.as<IntImm>()) {
+            flat.keys[at] = Key(IntImmNode, imm->value);
+        } else if (const UIntImm *imm = e.as<UIntImm>()) {
+            flat.keys[at] = Key(UIntImmNode, (int64_t)imm->value);
+        } else {
+            Node node = binary_node(e, a, b);
+            flat.keys[at].first = node;
+            if (node != OtherNode) {
+                flatten(a, flat);
+                flatten(b, flat);
+            }
+        }
+        flat.sizes[at] = flat.keys.size() - at;
+    }
+
+    void insert(const Expr &pattern, int entry) {
+        Flat flat;
+        flatten(pattern, flat);
+        int t = 0;
+        for (const Key &key : flat.keys) {
+            bool wildcard = (key.first == VariableNode);
+            int &next = wildcard ? trie[t].wildcard : trie[t].children.insert(std::make_pair(key, -1)).first->second;
+            if (next < 0) {
+                // Set it before the push invalidates the reference
+                next = trie.size();
+                t = next;
+                trie.push_back(TrieNode());
+            } else {
+                t = next;
+            }
+        }
+        trie[t].entries.push_back(entry);
+    }
+
+    // Collect the entries whose pattern matches flat[pos, end) from trie node t
+    void lookup(const Flat &flat, size_t pos, int t, std::vector<int> &entries) const {
+        const TrieNode &node = trie[t];
+        if (pos == flat.keys.size()) {
+            entries.insert(entries.end(), node.entries.begin(), node.entries.end());
+            return;
+        }
+        if (node.wildcard >= 0) {
+            lookup(flat, pos + flat.sizes[pos], node.wildcard, entries);
+        }
+        auto iter = node.children.find(flat.keys[pos]);
+        if (iter != node.children.end()) {
+            lookup(flat, pos + 1, iter->second, entries);
+        }
+    }
+
+public:
+    explicit AssociativeOpsIndex(const std::vector<std::vector<AssociativePair>> &table)
+        : table(&table), trie(1) {
+        for (size_t i = 0; i < table.size(); ++i) {
+            if (!table[i].empty()) {
+                insert(table[i][0].op, i);
+            }
+        }
+    }
+
+    /** The first entry of the table whose ops all match 'exprs', or null.
+     * 'bindings' gets what the variables of its ops stand for. */
+    const std::vector<AssociativePair> *match(const std::vector<Expr> &exprs,
+                                              std::map<std::string, Expr> &bindings) const {
+        bindings.clear();
+        if (exprs.empty()) {
+            return nullptr;
+        }
+        Flat flat;
+        flatten(exprs[0], flat);
+        std::vector<int> entries;
+        lookup(flat, 0, 0, entries);
+        std::sort(entries.begin(), entries.end());
+        for (int i : entries) {
+            const std::vector<AssociativePair> &entry = (*table)[i];
+            if (entry.size() != exprs.size()) {
+                continue;
+            }
+            // expr_match keeps the bindings of the earlier elements, so the
+            // variables they share must agree
+            bool matched = true;
+            for (size_t j = 0; matched && (j < exprs.size()); ++j) {
+                matched = expr_match(entry[j].op, exprs[j], bindings);
+            }
+            if (matched) {
+                debug(5) << "Matched entry " << i << " of " << entries.size() << " candidates\n";
+                return &entry;
+            }
+            bindings.clear();
+        }
+        return nullptr;
+    }
+};
+
+/** Look up 'exprs' in the table get_i32_ops_table returns for them; see
+ * AssociativeOpsIndex::match. The index of a table is built on its first
+ * lookup; lookups may run on several threads at once. */
+inline const std::vector<AssociativePair> *match_i32_ops_table(const std::vector<Expr> &exprs,
+                                                               std::map<std::string, Expr> &bindings) {
+    static std::mutex mutex;
+    static std::map<const void *, AssociativeOpsIndex> indices;
+    if (exprs.empty()) {
+        bindings.clear();
+        return nullptr;
+    }
+    const std::vector<std::vector<AssociativePair>> &table = get_i32_ops_table(exprs);
+    // The map's nodes stay put, so an index can be used once the lock is
+    // released
+    const AssociativeOpsIndex *index;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iter = indices.find(&table);
+        if (iter == indices.end()) {
+            iter = indices.insert(std::make_pair((const void *)&table, AssociativeOpsIndex(table))).first;
+        }
+        index = &iter->second;
+    }
+    return index->match(exprs, bindings);
+}
+
+}
+}
+
+#endif
@@ -1,4 +1,9 @@
 #include "AssociativeOpsTable.h"
+#include "AssociativeOpsIndex.h"
+
+#include <chrono>
+#include <map>
+#include <string>
 
 using std::vector;
 
@@ -17,6 +22,7 @@ const Expr i32_x0 = Variable::make(i32, "x0");
 const Expr i32_y0 = Variable::make(i32, "y0");
 const Expr i32_x1 = Variable::make(i32, "x1");
 const Expr i32_y1 = Variable::make(i32, "y1");
+const Expr k0 = Variable::make(i32, "k0");
 
 const Expr i32_mul_x0y0 = Mul::make(i32_x0, i32_y0);
 const Expr i32_mul_x0x0 = Mul::make(i32_x0, i32_x0);
@@ -845,12 +851,47 @@ const std::vector<std::vector<AssociativePair>> &get_i32_ops_table(const vector<
 using namespace Halide;
 using namespace Halide::Internal;
 
+// Look up every entry of the tables, instantiated on other variables, with
+// the index and with a scan of the whole table, which must agree
 int main() {
     Expr x = Variable::make(Int(32), "x");
     Expr y = Variable::make(Int(32), "y");
     Expr expr = Min::make(x, y);
-    const auto &table = get_i32_ops_table({expr});
-    std::cout << "Op: " << table[0][0].op << " with id: " << table[0][0].identity << "\n";
+    std::map<std::string, Expr> bindings;
+    const auto *entry = match_i32_ops_table({expr}, bindings);
+    std::cout << "Op: " << (*entry)[0].op << " with id: " << (*entry)[0].identity << "\n";
+
+    std::map<std::string, Expr> renames = {{"x0", x}, {"y0", y}, {"k0", make_const(Int(32), 3)}};
+    double t_index = 0, t_scan = 0;
+    int lookups = 0;
+    for (Expr root : {Add::make(x, y), Sub::make(x, y), Mul::make(x, y), Min::make(x, y), Max::make(x, y)}) {
+        const auto &table = get_i32_ops_table({root});
+        // Build the index before timing it
+        match_i32_ops_table({root}, bindings);
+        for (size_t i = 0; i < table.size(); ++i) {
+            vector<Expr> exprs = {substitute(renames, table[i][0].op)};
+            auto start = std::chrono::steady_clock::now();
+            entry = match_i32_ops_table(exprs, bindings);
+            auto middle = std::chrono::steady_clock::now();
+            const vector<AssociativePair> *scanned = nullptr;
+            for (size_t j = 0; !scanned && (j < table.size()); ++j) {
+                std::map<std::string, Expr> matches;
+                if (expr_match(table[j][0].op, exprs[0], matches)) {
+                    scanned = &table[j];
+                }
+            }
+            auto end = std::chrono::steady_clock::now();
+            t_index += std::chrono::duration<double>(middle - start).count();
+            t_scan += std::chrono::duration<double>(end - middle).count();
+            lookups++;
+            if (entry != scanned) {
+                std::cerr << "The index and the scan disagree on " << exprs[0] << "\n";
+                return -1;
+            }
+        }
+    }
+    std::cout << "Lookups: " << lookups << "\tindex: " << 1e6 * t_index / lookups << " us"
+              << "\tscan: " << 1e6 * t_scan / lookups << " us\n";
     return 0;
 }
 
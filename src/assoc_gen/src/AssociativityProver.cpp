@@ -1,9 +1,22 @@
 #include "AssociativityProver.h"
 #include "Z3OpsHelper.h"
 #include "HalideToZ3.h"
+#include "CounterexampleBank.h"
+#include "ProofCache.h"
+#include "ProverWorkers.h"
+#include "SlowQueryLog.h"
+#include "WorkStealingPool.h"
 #include "Error.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
 using namespace Halide;
 using namespace Halide::Internal;
@@ -15,6 +28,32 @@ using std::vector;
 
 const unsigned TIMEOUT = 1000*10u;
 
+// Narrower bit widths the associativity of a candidate is first refuted at
+// (see z3_refute_narrow), with the timeout (in ms) of each
+struct RefutationTier {
+    int bits;
+    unsigned timeout;
+};
+const RefutationTier kRefutationTiers[] = {{8, 200}, {16, 500}};
+
+// Timeouts of the full-width proof, each only tried if the previous one
+// ended in UNKNOWN
+const unsigned kProofTimeouts[] = {1000, TIMEOUT};
+
+// The tactics of each named pipeline (see tactic_pipelines), applied in
+// order; none for Z3's default solver
+struct TacticPipeline {
+    const char *name;
+    vector<const char *> tactics;
+};
+const TacticPipeline kTacticPipelines[] = {
+    {"default", {}},
+    {"smt", {"simplify", "solve-eqs", "smt"}},
+    {"bit-blast", {"simplify", "solve-eqs", "bit-blast", "sat"}},
+    {"ufbv", {"ufbv"}},
+    {"qe", {"simplify", "qe", "smt"}},
+};
+
 namespace {
 
 void print_tuple(const Tuple &tuple) {
@@ -108,6 +147,235 @@ public:
     }
 };
 
+class FindOperations : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Mul *op) {
+        has_mul = true;
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Min *op) {
+        has_min_max = true;
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Max *op) {
+        has_min_max = true;
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Select *op) {
+        has_min_max = true;
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool has_mul, has_min_max;
+    FindOperations() : has_mul(false), has_min_max(false) {}
+};
+
+string check_result_name(z3::check_result result) {
+    return (result == z3::sat) ? "sat" : (result == z3::unsat) ? "unsat" : "unknown";
+}
+
+// Add the query to the slow_query_log() if it took at least its threshold
+void log_if_slow(ProverSession &session, const char *kind, const string &pipeline, unsigned timeout,
+                 z3::check_result result, double seconds, const std::function<string()> &smt2) {
+    SlowQueryLog &log = slow_query_log();
+    if (!log.is_open() || (seconds < log.threshold_seconds())) {
+        return;
+    }
+    std::ostringstream subject;
+    subject << "{";
+    for (size_t i = 0; i < session.subject().size(); ++i) {
+        subject << (i ? ", " : "") << session.subject()[i];
+    }
+    subject << "}";
+    log.add(kind, pipeline, timeout, check_result_name(result), seconds, subject.str(), smt2());
+}
+
+// s.check(), for a query of the given kind run through 'pipeline' with the
+// given timeout, logged if it is slow
+z3::check_result timed_check(ProverSession &session, z3::solver &s, const char *kind,
+                             const string &pipeline, unsigned timeout) {
+    if (session.is_cancelled()) {
+        return z3::unknown;
+    }
+    if (!slow_query_log().is_open()) {
+        return s.check();
+    }
+    auto start = std::chrono::steady_clock::now();
+    z3::check_result result = s.check();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    log_if_slow(session, kind, pipeline, timeout, result, seconds, [&]() { return s.to_smt2(); });
+    return result;
+}
+
+ProverStrategy &current_strategy() {
+    static ProverStrategy strategy;
+    return strategy;
+}
+
+// Wins of each pipeline in the races of each operator family
+struct RaceStats {
+    std::mutex mutex;
+    int races[kNumOperatorFamilies];
+    map<string, int> wins[kNumOperatorFamilies];
+    map<string, double> winning_time[kNumOperatorFamilies];
+
+    RaceStats() {
+        for (int f = 0; f < kNumOperatorFamilies; ++f) {
+            races[f] = 0;
+        }
+    }
+};
+
+RaceStats &race_stats() {
+    static RaceStats stats;
+    return stats;
+}
+
+// Canonical hash of the structure of an expr: the kind, type and value (for
+// constants and variables) of each node, in pre-order. Two independent
+// lanes make up the 128-bit ProofKey.
+class StructuralHash : public IRVisitor {
+    using IRVisitor::visit;
+
+    void mix(uint64_t v) {
+        lo = (lo ^ v) * 0x100000001b3ULL;
+        hi = (hi ^ (v + 0x9e3779b97f4a7c15ULL)) * 0xff51afd7ed558ccdULL;
+        hi ^= hi >> 29;
+    }
+
+    void mix(const Type &t) {
+        mix(((uint64_t)t.code() << 16) | (uint64_t)t.bits());
+    }
+
+    void mix(const string &name) {
+        for (char c : name) {
+            mix((uint64_t)(unsigned char)c);
+        }
+        mix((uint64_t)name.size());
+    }
+
+    enum Node {
+        IntImmNode = 1, UIntImmNode, FloatImmNode, CastNode, VariableNode, AddNode, SubNode,
+        MulNode, DivNode, ModNode, MinNode, MaxNode, EQNode, NENode, LTNode, LENode, GTNode,
+        GENode, AndNode, OrNode, NotNode, SelectNode
+    };
+
+    template<typename T>
+    void node(const T *op, Node kind) {
+        mix((uint64_t)kind);
+        mix(op->type);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const IntImm *op) { node(op, IntImmNode); mix((uint64_t)op->value); }
+    void visit(const UIntImm *op) { node(op, UIntImmNode); mix(op->value); }
+    void visit(const FloatImm *op) {
+        node(op, FloatImmNode);
+        uint64_t bits = 0;
+        double value = op->value;
+        memcpy(&bits, &value, sizeof(value));
+        mix(bits);
+    }
+    void visit(const Cast *op) { node(op, CastNode); }
+    void visit(const Variable *op) { node(op, VariableNode); mix(op->name); }
+    void visit(const Add *op) { node(op, AddNode); }
+    void visit(const Sub *op) { node(op, SubNode); }
+    void visit(const Mul *op) { node(op, MulNode); }
+    void visit(const Div *op) { node(op, DivNode); }
+    void visit(const Mod *op) { node(op, ModNode); }
+    void visit(const Min *op) { node(op, MinNode); }
+    void visit(const Max *op) { node(op, MaxNode); }
+    void visit(const EQ *op) { node(op, EQNode); }
+    void visit(const NE *op) { node(op, NENode); }
+    void visit(const LT *op) { node(op, LTNode); }
+    void visit(const LE *op) { node(op, LENode); }
+    void visit(const GT *op) { node(op, GTNode); }
+    void visit(const GE *op) { node(op, GENode); }
+    void visit(const And *op) { node(op, AndNode); }
+    void visit(const Or *op) { node(op, OrNode); }
+    void visit(const Not *op) { node(op, NotNode); }
+    void visit(const Select *op) { node(op, SelectNode); }
+
+public:
+    uint64_t lo, hi;
+    StructuralHash() : lo(0xcbf29ce484222325ULL), hi(0x84222325cbf29ce4ULL) {}
+
+    void add_element(const Expr &e) {
+        // Separates the elements of a tuple
+        mix((uint64_t)0);
+        mix(e.type());
+        e.accept(this);
+    }
+
+    void add_tag(uint64_t tag) { mix(tag); }
+};
+
+ProofKey proof_key(const Tuple &tuple, FloatSemantics floats) {
+    StructuralHash hash;
+    bool has_float = false;
+    for (const Expr &e : tuple.as_vector()) {
+        hash.add_element(e);
+        has_float = has_float || e.type().is_float();
+    }
+    // A verdict on floats only holds under the semantics it was reached in
+    if (has_float) {
+        hash.add_tag((uint64_t)floats + 1);
+    }
+    return {hash.lo, hash.hi};
+}
+
+bool key_less(const ProofKey &a, const ProofKey &b) {
+    return (a.hi != b.hi) ? (a.hi < b.hi) : (a.lo < b.lo);
+}
+
+// The key of the operator, the same for all its relabelings: permuting the
+// slots of the tuple and renaming x_j, y_j to match gives the same operator,
+// so each relabeling is hashed and the smallest key kept. Element i of
+// 'tuple' is element slots[i] of the relabeling that key is of.
+ProofKey relabeled_proof_key(const Tuple &tuple, const vector<Expr> &xvars, const vector<Expr> &yvars,
+                             FloatSemantics floats, vector<size_t> &slots) {
+    size_t size = tuple.size();
+    vector<size_t> perm(size);
+    for (size_t i = 0; i < size; ++i) {
+        perm[i] = i;
+    }
+    slots = perm;
+    ProofKey best = proof_key(tuple, floats);
+    if ((xvars.size() != size) || (yvars.size() != size)) {
+        return best;
+    }
+    while (std::next_permutation(perm.begin(), perm.end())) {
+        bool same_types = true;
+        for (size_t i = 0; i < size; ++i) {
+            same_types = same_types && (tuple[i].type() == tuple[perm[i]].type()) &&
+                         (xvars[i].type() == xvars[perm[i]].type());
+        }
+        if (!same_types) {
+            continue;
+        }
+        map<string, Expr> renames;
+        for (size_t j = 0; j < size; ++j) {
+            renames[xvars[j].as<Variable>()->name] = xvars[perm[j]];
+            renames[yvars[j].as<Variable>()->name] = yvars[perm[j]];
+        }
+        vector<Expr> relabeled(size);
+        for (size_t i = 0; i < size; ++i) {
+            relabeled[perm[i]] = substitute(renames, tuple[i]);
+        }
+        ProofKey key = proof_key(Tuple(relabeled), floats);
+        if (key_less(key, best)) {
+            best = key;
+            slots = perm;
+        }
+    }
+    return best;
+}
+
 bool check_vars_validity(Expr e, const vector<Expr> &xvars, const vector<Expr> &yvars,
                          const vector<Expr> &constants) {
     CheckVars check(xvars, yvars, constants);
@@ -115,20 +383,47 @@ bool check_vars_validity(Expr e, const vector<Expr> &xvars, const vector<Expr> &
     return check.valid;
 }
 
-bool z3_find_identity(const z3::expr &equation, const vector<Type> types,
+// The identity 'val' (a Z3 numeral, or unconstrained) as a Halide constant
+// of type 't'
+Expr identity_from_z3(const z3::expr &val, const Type &t) {
+    bool is_signed = t.is_int();
+
+    if (t.is_float()) {
+        if (val.is_const() && (val.decl().decl_kind() == Z3_OP_UNINTERPRETED)) {
+            return FloatImm::make(t, 0.0);
+        }
+        return FloatImm::make(t, z3::fp_to_double(val));
+    }
+    if (!val.is_numeral()) {
+        // Since the identity is not constrained by the model, we can pick any
+        // value. We'll pick 0 here.
+        if (is_signed) {
+            return IntImm::make(t, 0);
+        } else {
+            return UIntImm::make(t, 0);
+        }
+    }
+    if (is_signed) {
+        Expr min_int_expr = t.min();
+        const IntImm *min_int = min_int_expr.as<IntImm>();
+        ASSERT(min_int != nullptr, "Should have been an int\n");
+        return IntImm::make(t, z3::to_int(val, t.bits(), min_int->value));
+    } else {
+        return UIntImm::make(t, z3::to_uint(val));
+    }
+}
+
+bool z3_find_identity(ProverSession &session, const string &pipeline,
+                      const z3::expr &equation, const vector<Type> types,
                       const z3::expr_vector &qvars, const z3::expr_vector &evars,
                       vector<Expr> &result) {
     DEBUG_PRINT << "Finding identity of " << equation << "\n";
-    z3::context &ctx = equation.ctx();
-    z3::solver s(ctx);
-    z3::params p(ctx);
-    p.set(":timeout", TIMEOUT);
-    s.set(p);
+    z3::solver &s = session.reset_solver(TIMEOUT, pipeline);
     z3::expr qf = forall(qvars, equation);
     s.add(qf);
     DEBUG_PRINT << s.to_smt2() << "\n";
 
-    if (s.check() != z3::sat) {
+    if (timed_check(session, s, "identity", pipeline, TIMEOUT) != z3::sat) {
         DEBUG_PRINT << "Failed to find identity of " << equation << "\n";
         return false;
     }
@@ -139,61 +434,639 @@ bool z3_find_identity(const z3::expr &equation, const vector<Type> types,
     result.resize(evars.size());
     for (size_t i = 0; i < evars.size(); ++i) {
         // Convert z3 id to halide expr
-        z3::expr z3_id = m.eval(evars[i]);
-        const Type &t = types[i];
-        bool is_signed = t.is_int();
-
-        //TODO(psuriana): add handler for float
-        if (!z3_id.is_numeral()) {
-            // Since evars[i] is not constrained by the model, we can pick any
-            // value. We'll pick 0 here.
-            if (is_signed) {
-                result[i] = IntImm::make(t, 0);
-            } else {
-                result[i] = UIntImm::make(t, 0);
+        result[i] = identity_from_z3(m.eval(evars[i]), types[i]);
+    }
+    return true;
+}
+
+// The usual identities of an element of type 't', tried before searching
+// for one: nearly every identity in AssociativeOpsTable is one of them
+vector<Expr> identity_candidates(const Type &t) {
+    vector<Expr> all = {make_const(t, 0), make_const(t, 1)};
+    if (t.is_float()) {
+        all.insert(all.begin() + 1, make_const(t, -0.0));
+        all.push_back(make_const(t, -1));
+        all.push_back(make_const(t, -2));
+        all.push_back(make_const(t, (double)-INFINITY));
+        all.push_back(make_const(t, (double)INFINITY));
+    } else if (t.is_int()) {
+        all.push_back(make_const(t, -1));
+        all.push_back(make_const(t, -2));
+    }
+    all.push_back(t.min());
+    all.push_back(t.max());
+
+    // -0.0 and 0.0 compare equal, but are different identities
+    auto same = [](const Expr &a, const Expr &b) {
+        const FloatImm *fa = a.as<FloatImm>();
+        const FloatImm *fb = b.as<FloatImm>();
+        if ((fa != nullptr) && (fb != nullptr)) {
+            return (fa->value == fb->value) && (std::signbit(fa->value) == std::signbit(fb->value));
+        }
+        return equal(a, b);
+    };
+    vector<Expr> candidates;
+    for (const Expr &c : all) {
+        bool duplicate = false;
+        for (const Expr &other : candidates) {
+            duplicate = duplicate || same(c, other);
+        }
+        if (!duplicate) {
+            candidates.push_back(c);
+        }
+    }
+    return candidates;
+}
+
+// Values of the quantified variables the identity candidates are first
+// checked on, one sample per row
+const int kIdentitySamples[][3] = {
+    {0, 1, -1},
+    {1, -1, 0},
+    {-7, 12345, 2},
+    {0x7fffffff, (int)0x80000000, 5},
+};
+
+// Timeout (in ms) of the proof of each candidate identity; most of them are
+// refuted by the samples instead
+const unsigned kCandidateTimeout = 1000;
+
+const int kMaxSynthesisIterations = 16;
+
+z3::expr sample_value(const z3::expr &var, int value) {
+    z3::context &ctx = var.ctx();
+    if (var.is_bv()) {
+        return ctx.bv_val(value, var.get_sort().bv_size());
+    } else if (var.get_sort().sort_kind() == Z3_FLOATING_POINT_SORT) {
+        return z3::expr(ctx, Z3_mk_fpa_numeral_int(ctx, value, var.get_sort()));
+    }
+    return ctx.int_val(value);
+}
+
+z3::expr_vector sample_in_model(const z3::model &m, const z3::expr_vector &qvars) {
+    z3::expr_vector sample(qvars.ctx());
+    for (unsigned i = 0; i < qvars.size(); ++i) {
+        sample.push_back(m.eval(qvars[i], true));
+    }
+    return sample;
+}
+
+// Return false if 'formula' (over 'qvars') does not hold on one of the
+// samples of their values
+bool holds_on_samples(const z3::expr &formula, const z3::expr_vector &qvars,
+                      const vector<z3::expr_vector> &samples) {
+    for (const z3::expr_vector &sample : samples) {
+        z3::expr instance = formula;
+        instance = instance.substitute(qvars, sample).simplify();
+        if (z3::eq(instance, formula.ctx().bool_val(false))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Find values of 'evars' for which 'equation' holds for all values of
+ * 'qvars' with quantifier-free queries only, since quantified bitvector
+ * queries are the slowest we run. First, every combination of the usual
+ * identities (see identity_candidates) is checked on a few samples of the
+ * qvars, and the ones that pass are proven. Then, the search alternates
+ * between solving for evars on the samples and proving the solution, adding
+ * the counterexample of a failed proof to the samples (CEGIS); the
+ * counterexamples of failed candidate proofs seed it. Only if that runs out
+ * of iterations or time is the quantified query solved instead.
+ */
+bool z3_synthesize_identity(ProverSession &session, const string &pipeline,
+                            const string &quantified_pipeline, bool use_bv,
+                            const z3::expr &equation, const vector<Type> types,
+                            const z3::expr_vector &qvars, const z3::expr_vector &evars,
+                            vector<Expr> &result) {
+    z3::context &ctx = session.context();
+
+    vector<z3::expr_vector> samples;
+    for (const auto &row : kIdentitySamples) {
+        z3::expr_vector sample(ctx);
+        for (unsigned i = 0; i < qvars.size(); ++i) {
+            // Rotate the rows for the variables past the third
+            sample.push_back(sample_value(qvars[i], row[(i + i / 3) % 3]));
+        }
+        samples.push_back(sample);
+    }
+
+    vector<vector<Expr>> candidates(evars.size());
+    vector<vector<z3::expr>> z3_candidates(evars.size());
+    for (size_t i = 0; i < evars.size(); ++i) {
+        candidates[i] = identity_candidates(types[i]);
+        for (const Expr &c : candidates[i]) {
+            z3_candidates[i].push_back(convert_halide_to_z3(c, &ctx, use_bv));
+        }
+    }
+
+    vector<size_t> choice(evars.size(), 0);
+    while (!session.is_cancelled()) {
+        z3::expr_vector values(ctx);
+        for (size_t i = 0; i < evars.size(); ++i) {
+            values.push_back(z3_candidates[i][choice[i]]);
+        }
+        z3::expr instance = equation;
+        instance = instance.substitute(evars, values);
+        if (holds_on_samples(instance, qvars, samples)) {
+            z3::solver &s = session.reset_solver(kCandidateTimeout, pipeline);
+            s.add(!instance);
+            z3::check_result check = timed_check(session, s, "identity candidate", pipeline, kCandidateTimeout);
+            if (check == z3::unsat) {
+                result.resize(evars.size());
+                for (size_t i = 0; i < evars.size(); ++i) {
+                    result[i] = candidates[i][choice[i]];
+                }
+                DEBUG_PRINT << "Found identity among the usual candidates\n";
+                return true;
+            } else if (check == z3::sat) {
+                samples.push_back(sample_in_model(s.get_model(), qvars));
             }
-        } else {
-            if (is_signed) {
-                Expr min_int_expr = t.min();
-                const IntImm *min_int = min_int_expr.as<IntImm>();
-                ASSERT(min_int != nullptr, "Should have been an int\n");
-                result[i] = IntImm::make(t, z3::to_int(z3_id, t.bits(), min_int->value));
-            } else {
-                result[i] = UIntImm::make(t, z3::to_uint(z3_id));
+        }
+
+        // Next combination
+        size_t i = 0;
+        while ((i < choice.size()) && (++choice[i] == candidates[i].size())) {
+            choice[i] = 0;
+            ++i;
+        }
+        if (i == choice.size()) {
+            break;
+        }
+    }
+
+    for (int iter = 0; iter < kMaxSynthesisIterations; ++iter) {
+        z3::solver &s = session.reset_solver(TIMEOUT, pipeline);
+        for (const z3::expr_vector &sample : samples) {
+            z3::expr instance = equation;
+            s.add(instance.substitute(qvars, sample));
+        }
+        z3::check_result check = timed_check(session, s, "identity synthesis", pipeline, TIMEOUT);
+        if (check == z3::unsat) {
+            // No identity even works on the samples
+            DEBUG_PRINT << "Failed to find identity of " << equation << "\n";
+            return false;
+        } else if (check == z3::unknown) {
+            break;
+        }
+        z3::model m = s.get_model();
+        z3::expr_vector values(ctx);
+        for (unsigned i = 0; i < evars.size(); ++i) {
+            values.push_back(m.eval(evars[i], true));
+        }
+
+        z3::expr instance = equation;
+        instance = instance.substitute(evars, values);
+        z3::solver &v = session.reset_solver(TIMEOUT, pipeline);
+        v.add(!instance);
+        check = timed_check(session, v, "identity verification", pipeline, TIMEOUT);
+        if (check == z3::unsat) {
+            result.resize(evars.size());
+            for (size_t i = 0; i < evars.size(); ++i) {
+                result[i] = identity_from_z3(values[i], types[i]);
             }
+            DEBUG_PRINT << "Synthesized identity after " << iter + 1 << " iterations\n";
+            return true;
+        } else if (check == z3::unknown) {
+            break;
         }
+        samples.push_back(sample_in_model(v.get_model(), qvars));
     }
-    return true;
+
+    return z3_find_identity(session, quantified_pipeline, equation, types, qvars, evars, result);
 }
 
-IsAssociative z3_prove_associativity(const z3::expr &conjecture) {
-    DEBUG_PRINT << "Proving associativity of:\n" << conjecture << "\n";
+bool is_fp(const z3::expr &e) {
+    return e.get_sort().sort_kind() == Z3_FLOATING_POINT_SORT;
+}
+
+// a == b, where IEEE floats are equal if they are the same number (either
+// zero being equal to the other) or both NaN
+z3::expr equals(const z3::expr &a, const z3::expr &b) {
+    if (is_fp(a)) {
+        return z3::fp_equal(a, b) || (z3::fp_is_nan(a) && z3::fp_is_nan(b));
+    }
+    return a == b;
+}
+
+// The conjunction of 'es', true if there are none
+z3::expr conjunction(z3::context &ctx, const vector<z3::expr> &es) {
+    if (es.empty()) {
+        return ctx.bool_val(true);
+    }
+    z3::expr result = es[0];
+    for (size_t i = 1; i < es.size(); ++i) {
+        result = result && es[i];
+    }
+    return result;
+}
+
+// None of the IEEE floats among 'vars' is NaN
+z3::expr none_nan(z3::context &ctx, const vector<z3::expr> &vars) {
+    vector<z3::expr> conditions;
+    for (const z3::expr &v : vars) {
+        if (is_fp(v)) {
+            conditions.push_back(!z3::fp_is_nan(v));
+        }
+    }
+    return conjunction(ctx, conditions);
+}
 
+// The variables of the associativity conjecture, to read a counterexample
+// off the model of its negation
+struct ConjectureVars {
+    vector<z3::expr> x, y, z, k;
+};
+
+// A counterexample: the (sign-extended) values of the ConjectureVars
+struct ConjectureValues {
+    vector<int64_t> x, y, z, k;
+};
+
+int64_t sign_extend(uint64_t u, int bits) {
+    if ((bits < 64) && (u >> (bits - 1))) {
+        return (int64_t)(u - (1ULL << bits));
+    }
+    return (int64_t)u;
+}
+
+int64_t signed_value(const z3::model &m, const z3::expr &var, int bits) {
+    z3::expr val = m.eval(var, true);
+    if (!val.is_numeral()) {
+        return 0;
+    }
+    return sign_extend(z3::to_uint(val), bits);
+}
+
+ConjectureValues values_in_model(const z3::model &m, const ConjectureVars &vars, int bits) {
+    ConjectureValues values;
+    for (const z3::expr &v : vars.x) {
+        values.x.push_back(signed_value(m, v, bits));
+    }
+    for (const z3::expr &v : vars.y) {
+        values.y.push_back(signed_value(m, v, bits));
+    }
+    for (const z3::expr &v : vars.z) {
+        values.z.push_back(signed_value(m, v, bits));
+    }
+    for (const z3::expr &v : vars.k) {
+        values.k.push_back(signed_value(m, v, bits));
+    }
+    return values;
+}
+
+// Return false if 'conjecture' does not hold for the given values of its
+// variables (of the given bit width)
+bool holds_at(const z3::expr &conjecture, const ConjectureVars &vars,
+              const ConjectureValues &values, int bits) {
     z3::context &ctx = conjecture.ctx();
-    z3::solver s(ctx);
-    // Set solver timeout
-    z3::params p(ctx);
-    p.set(":timeout", TIMEOUT);
-    s.set(p);
-    s.add(!conjecture);
-
-    if (s.check() == z3::unsat) {
+    z3::expr_vector from(ctx), to(ctx);
+    auto bind = [&](const vector<z3::expr> &vs, const vector<int64_t> &vals) {
+        for (size_t i = 0; i < vs.size(); ++i) {
+            from.push_back(vs[i]);
+            to.push_back(ctx.bv_val((int)vals[i], bits));
+        }
+    };
+    bind(vars.x, values.x);
+    bind(vars.y, values.y);
+    bind(vars.z, values.z);
+    bind(vars.k, values.k);
+    z3::expr instance = conjecture;
+    instance = instance.substitute(from, to).simplify();
+    return !z3::eq(instance, ctx.bool_val(false));
+}
+
+// Record the counterexample in the bank the fast check tries first. The fast
+// check only models (wrapping) 32-bit arithmetic, so other types are left out.
+void record_counterexample(const ConjectureValues &values, int bits) {
+    size_t size = values.x.size();
+    if ((bits != 32) || (size < 1) || (size > MAX_TUPLE_SIZE)) {
+        return;
+    }
+    Counterexample c;
+    for (size_t i = 0; i < size; ++i) {
+        c.x[i] = (Value)values.x[i];
+        c.y[i] = (Value)values.y[i];
+        c.z[i] = (Value)values.z[i];
+    }
+    c.k = values.k.empty() ? 0 : (Value)values.k[0];
+    counterexample_bank().add(size, c);
+}
+
+/**
+ * Check whether 'conjecture' (over variables of 'bits' bits) can fail, in
+ * the session or, if it is running, in a worker process of z3_worker_pool().
+ * If it can, 'counterexample' is where it fails.
+ */
+z3::check_result z3_check_conjecture(ProverSession &session, const string &pipeline, const char *kind,
+                                     const z3::expr &conjecture, const ConjectureVars &vars,
+                                     int bits, unsigned timeout, ConjectureValues &counterexample) {
+    if (!z3_worker_pool().is_running()) {
+        z3::solver &s = session.reset_solver(timeout, pipeline);
+        s.add(!conjecture);
+        z3::check_result result = timed_check(session, s, kind, pipeline, timeout);
+        if (result == z3::sat) {
+            DEBUG_PRINT << "Counter example:\n" << s.get_model() << "\n";
+            counterexample = values_in_model(s.get_model(), vars, bits);
+        }
+        return result;
+    }
+
+    vector<string> tactics;
+    for (const TacticPipeline &p : kTacticPipelines) {
+        if (pipeline == p.name) {
+            tactics.assign(p.tactics.begin(), p.tactics.end());
+        }
+    }
+    vector<string> reads;
+    for (const vector<z3::expr> *vs : {&vars.x, &vars.y, &vars.z, &vars.k}) {
+        for (const z3::expr &v : *vs) {
+            reads.push_back(v.decl().name().str());
+        }
+    }
+    z3::context &ctx = session.context();
+    z3::expr negation = !conjecture;
+    string smt2 = Z3_benchmark_to_smtlib_string(ctx, "", "", "unknown", "", 0, nullptr, negation);
+    vector<uint64_t> values;
+    auto start = std::chrono::steady_clock::now();
+    z3::check_result result = z3_worker_pool().check(smt2, tactics, timeout, reads, values);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    log_if_slow(session, kind, pipeline, timeout, result, seconds, [&]() { return smt2; });
+    if (result == z3::sat) {
+        // In the order of 'reads'
+        size_t i = 0;
+        auto take = [&](size_t size) {
+            vector<int64_t> vals;
+            for (size_t j = 0; j < size; ++j) {
+                vals.push_back(sign_extend(values[i++], bits));
+            }
+            return vals;
+        };
+        counterexample.x = take(vars.x.size());
+        counterexample.y = take(vars.y.size());
+        counterexample.z = take(vars.z.size());
+        counterexample.k = take(vars.k.size());
+    }
+    return result;
+}
+
+IsAssociative z3_prove_associativity(ProverSession &session, const string &pipeline,
+                                     const z3::expr &conjecture, const ConjectureVars &vars,
+                                     int bits, unsigned timeout) {
+    DEBUG_PRINT << "Proving associativity of:\n" << conjecture << "\n";
+
+    ConjectureValues counterexample;
+    z3::check_result result = z3_check_conjecture(session, pipeline, "associativity", conjecture, vars, bits,
+                                                  timeout, counterexample);
+    if (result == z3::unsat) {
         DEBUG_PRINT << "Succeeded at proving associativity\n";
         return IsAssociative::YES;
-    } else if (s.check() == z3::unknown) {
+    } else if (result == z3::unknown) {
         return IsAssociative::UNKNOWN;
     } else {
         DEBUG_PRINT << "Failed to prove associativity\n";
-        DEBUG_PRINT << "Counter example:\n" << s.get_model() << "\n";
+        record_counterexample(counterexample, bits);
         return IsAssociative::NO;
     }
 }
 
+/**
+ * Try to refute 'conjecture' (over variables of 'bits' bits) with the
+ * narrowed 'narrow' (over variables of 'narrow_bits' bits), which is much
+ * cheaper to bit-blast. The narrow conjecture failing does not imply the
+ * full one does (e.g. when min/max meet wrap-around), so its counterexample
+ * is sign-extended and only counts if the full conjecture fails on it too.
+ * Returns NO if that refuted it, YES if the narrow conjecture holds (which
+ * says nothing about the full one), UNKNOWN otherwise.
+ */
+IsAssociative z3_refute_narrow(ProverSession &session, const string &pipeline,
+                               const z3::expr &narrow, const ConjectureVars &narrow_vars,
+                               int narrow_bits, unsigned timeout,
+                               const z3::expr &conjecture, const ConjectureVars &vars, int bits) {
+    ConjectureValues values;
+    z3::check_result result = z3_check_conjecture(session, pipeline, "narrow refutation", narrow, narrow_vars, narrow_bits,
+                                                  timeout, values);
+    if (result == z3::unsat) {
+        return IsAssociative::YES;
+    } else if (result == z3::unknown) {
+        return IsAssociative::UNKNOWN;
+    }
+    if (holds_at(conjecture, vars, values, bits)) {
+        DEBUG_PRINT << "Counter example at " << narrow_bits << " bits does not extend to " << bits << " bits\n";
+        return IsAssociative::UNKNOWN;
+    }
+    DEBUG_PRINT << "Refuted associativity at " << narrow_bits << " bits\n";
+    record_counterexample(values, bits);
+    return IsAssociative::NO;
+}
+
+z3::expr translate(const z3::expr &e, z3::context &to) {
+    return z3::expr(to, Z3_translate(e.ctx(), e, to));
+}
+
+vector<z3::expr> translate(const vector<z3::expr> &es, z3::context &to) {
+    vector<z3::expr> result;
+    for (const z3::expr &e : es) {
+        result.push_back(translate(e, to));
+    }
+    return result;
+}
+
+/**
+ * Prove 'conjecture' with each of the strategy's race pipelines at once,
+ * each on its own thread, and keep the first answer other than UNKNOWN; the
+ * others are interrupted. The win is tallied for print_tactic_report.
+ */
+IsAssociative z3_race_associativity(const z3::expr &conjecture, const ConjectureVars &vars,
+                                    int bits, OperatorFamily family) {
+    const vector<string> &pipelines = current_strategy().race;
+
+    // A Z3 context must only be used by one thread at a time, so each racer
+    // gets its own, with the query translated into it up front
+    vector<std::unique_ptr<z3::context>> contexts;
+    vector<z3::expr> conjectures;
+    vector<ConjectureVars> racer_vars;
+    for (size_t i = 0; i < pipelines.size(); ++i) {
+        contexts.emplace_back(new z3::context);
+        z3::context &ctx = *contexts.back();
+        conjectures.push_back(translate(conjecture, ctx));
+        ConjectureVars v;
+        v.x = translate(vars.x, ctx);
+        v.y = translate(vars.y, ctx);
+        v.z = translate(vars.z, ctx);
+        v.k = translate(vars.k, ctx);
+        racer_vars.push_back(v);
+    }
+
+    std::mutex mutex;
+    int winner = -1;
+    IsAssociative result = IsAssociative::UNKNOWN;
+    ConjectureValues values;
+    double winning_time = 0;
+
+    vector<std::thread> racers;
+    for (size_t i = 0; i < pipelines.size(); ++i) {
+        racers.emplace_back([&, i]() {
+            auto start = std::chrono::steady_clock::now();
+            z3::context &ctx = *contexts[i];
+            z3::solver s = make_solver(ctx, pipelines[i]);
+            z3::params params(ctx);
+            params.set(":timeout", TIMEOUT);
+            s.set(params);
+            s.add(!conjectures[i]);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (winner != -1) {
+                    return;
+                }
+            }
+            z3::check_result r = s.check();
+            if (r == z3::unknown) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (winner != -1) {
+                return;
+            }
+            winner = (int)i;
+            winning_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (r == z3::unsat) {
+                result = IsAssociative::YES;
+            } else {
+                result = IsAssociative::NO;
+                values = values_in_model(s.get_model(), racer_vars[i], bits);
+            }
+            for (size_t j = 0; j < contexts.size(); ++j) {
+                if (j != i) {
+                    contexts[j]->interrupt();
+                }
+            }
+        });
+    }
+    for (std::thread &racer : racers) {
+        racer.join();
+    }
+
+    RaceStats &stats = race_stats();
+    {
+        std::lock_guard<std::mutex> lock(stats.mutex);
+        int f = (int)family;
+        stats.races[f]++;
+        if (winner != -1) {
+            stats.wins[f][pipelines[winner]]++;
+            stats.winning_time[f][pipelines[winner]] += winning_time;
+        }
+    }
+    if (result == IsAssociative::NO) {
+        DEBUG_PRINT << "Refuted associativity with " << pipelines[winner] << "\n";
+        record_counterexample(values, bits);
+    }
+    return result;
+}
+
+/**
+ * Prove each of the 'size' component equations lhs[i] == rhs[i] of a tuple's
+ * conjecture (as built in a session by 'component') on its own thread, in
+ * 'session' for the first and in its partners for the others. The conjunction is equivalent, but
+ * the components are independent queries, so the latency is that of the
+ * slowest one instead of their sum. As the tuple is only associative if
+ * all of them hold, the first counterexample stops all the others.
+ */
+IsAssociative z3_prove_components(ProverSession &session, const string &pipeline,
+                                  size_t size, int bits,
+                                  const std::function<z3::expr(ProverSession &, size_t)> &component_in,
+                                  const std::function<ConjectureVars(ProverSession &)> &declare_vars) {
+    vector<ProverSession *> sessions = {&session};
+    for (size_t i = 1; i < size; ++i) {
+        sessions.push_back(&session.partner(i - 1));
+    }
+
+    std::mutex mutex;
+    bool refuted = false;
+    ConjectureValues counterexample;
+    vector<IsAssociative> results(size, IsAssociative::UNKNOWN);
+    // Whether each component's query is running in its session's context.
+    // Only those are interrupted: the sessions outlive the proof, and one
+    // that is idle or whose query went to a worker process is left alone.
+    // z3 does not keep an interrupt that lands after the query returned, so
+    // the next query of the session does not start cancelled.
+    vector<bool> running(size, false);
+
+    auto prove = [&](size_t i) {
+        ProverSession &s = *sessions[i];
+        z3::expr component = component_in(s, i);
+        ConjectureVars vars = declare_vars(s);
+        bool in_process = !z3_worker_pool().is_running();
+        // Only spend the long timeout on the candidates the short one can't
+        // decide
+        for (unsigned timeout : kProofTimeouts) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (refuted) {
+                    return;
+                }
+                running[i] = in_process;
+            }
+            // A component running in a worker process is not interrupted,
+            // but its result is ignored
+            ConjectureValues values;
+            z3::check_result check = z3_check_conjecture(s, pipeline, "component", component, vars, bits,
+                                                         timeout, values);
+            std::lock_guard<std::mutex> lock(mutex);
+            running[i] = false;
+            if (check == z3::unsat) {
+                results[i] = IsAssociative::YES;
+                return;
+            } else if (check == z3::sat) {
+                results[i] = IsAssociative::NO;
+                if (!refuted) {
+                    refuted = true;
+                    counterexample = values;
+                    for (size_t j = 0; j < size; ++j) {
+                        if (running[j]) {
+                            sessions[j]->context().interrupt();
+                        }
+                    }
+                }
+                return;
+            }
+        }
+    };
+
+    vector<std::thread> threads;
+    for (size_t i = 1; i < size; ++i) {
+        threads.emplace_back(prove, i);
+    }
+    prove(0);
+    for (std::thread &t : threads) {
+        t.join();
+    }
+
+    if (refuted) {
+        DEBUG_PRINT << "Failed to prove associativity of a component\n";
+        record_counterexample(counterexample, bits);
+        return IsAssociative::NO;
+    }
+    for (IsAssociative r : results) {
+        if (r != IsAssociative::YES) {
+            return IsAssociative::UNKNOWN;
+        }
+    }
+    DEBUG_PRINT << "Succeeded at proving associativity\n";
+    return IsAssociative::YES;
+}
+
 IsAssociative prove_associativity_helper(const Halide::Tuple &tuple,
                                          const vector<Expr> &xvars,
                                          const vector<Expr> &yvars,
                                          const vector<Expr> &constants,
-                                         z3::context &ctx) {
+                                         OperatorFamily family,
+                                         ProverSession &session) {
+    z3::context &ctx = session.context();
+    const ProverStrategy &strategy = current_strategy();
+    const string &pipeline = strategy.associativity[(int)family];
     const vector<Expr> &ops = tuple.as_vector();
 
     vector<string> xnames(ops.size()), ynames(ops.size()), znames(ops.size());
@@ -258,12 +1131,111 @@ IsAssociative prove_associativity_helper(const Halide::Tuple &tuple,
     }
     DEBUG_PRINT << "}\n";
 
-    Expr conjecture = (lhs[0] == rhs[0]);
-    for (size_t i = 1; i < ops.size(); ++i) {
-        conjecture = conjecture && (lhs[i] == rhs[i]);
+    // Counterexamples are only read off (and conjectures only narrowed) for
+    // integer operators
+    bool all_int = true;
+    for (const vector<Expr> *vs : {&xvars, &constants}) {
+        for (const Expr &v : *vs) {
+            all_int = all_int && !v.type().is_float();
+        }
     }
 
-    IsAssociative result = z3_prove_associativity(convert_halide_to_z3(conjecture, &ctx, true));
+    // lhs[i] == rhs[i] in the given session, for all the non-NaN values of
+    // the IEEE float variables
+    auto component_in = [&](ProverSession &s, size_t i, int narrow_bits) {
+        z3::context &c = s.context();
+        z3::expr l = convert_halide_to_z3(lhs[i], &c, true, narrow_bits, strategy.floats);
+        z3::expr r = convert_halide_to_z3(rhs[i], &c, true, narrow_bits, strategy.floats);
+        if (all_int) {
+            return l == r;
+        }
+        vector<z3::expr> vars;
+        for (size_t j = 0; j < ops.size(); ++j) {
+            for (const Expr &v : {xvars[j], yvars[j], zvars[j]}) {
+                vars.push_back(convert_halide_to_z3(v, &c, true, 0, strategy.floats));
+            }
+        }
+        for (const Expr &v : constants) {
+            vars.push_back(convert_halide_to_z3(v, &c, true, 0, strategy.floats));
+        }
+        return z3::implies(none_nan(c, vars), equals(l, r));
+    };
+    auto conjecture_in = [&](int narrow_bits) {
+        vector<z3::expr> components;
+        for (size_t i = 0; i < ops.size(); ++i) {
+            components.push_back(component_in(session, i, narrow_bits));
+        }
+        return conjunction(ctx, components);
+    };
+
+    auto declare_vars_in = [&](ProverSession &s, int narrow_bits) {
+        ConjectureVars vars;
+        if (!all_int) {
+            return vars;
+        }
+        for (size_t i = 0; i < ops.size(); ++i) {
+            vars.x.push_back(s.declare(xvars[i], true, narrow_bits));
+            vars.y.push_back(s.declare(yvars[i], true, narrow_bits));
+            vars.z.push_back(s.declare(zvars[i], true, narrow_bits));
+        }
+        for (size_t i = 0; i < constants.size(); ++i) {
+            vars.k.push_back(s.declare(constants[i], true, narrow_bits));
+        }
+        return vars;
+    };
+    auto declare_vars = [&](int narrow_bits) {
+        return declare_vars_in(session, narrow_bits);
+    };
+
+    int bits = xvars[0].type().bits();
+    bool same_bits = true;
+    for (const vector<Expr> *vs : {&xvars, &yvars, &constants}) {
+        for (const Expr &v : *vs) {
+            same_bits = same_bits && (v.type().bits() == bits);
+        }
+    }
+
+    ConjectureVars vars = declare_vars(0);
+    z3::expr full = conjecture_in(0);
+
+    // Most candidates that get this far are still not associative, and
+    // refuting them is much cheaper at a narrower bit width. Once a narrow
+    // conjecture holds, a wider one most likely does too, so the remaining
+    // tiers are skipped.
+    for (const RefutationTier &tier : kRefutationTiers) {
+        if (!same_bits || !all_int || (tier.bits >= bits)) {
+            break;
+        }
+        z3::expr narrow = conjecture_in(tier.bits);
+        IsAssociative narrow_result = z3_refute_narrow(session, pipeline, narrow, declare_vars(tier.bits),
+                                                       tier.bits, tier.timeout, full, vars, bits);
+        if (narrow_result == IsAssociative::NO) {
+            return IsAssociative::NO;
+        } else if (narrow_result == IsAssociative::YES) {
+            break;
+        }
+    }
+
+    // Only spend the long timeout on the candidates the short one can't decide
+    IsAssociative result = IsAssociative::UNKNOWN;
+    if (!strategy.race.empty()) {
+        result = z3_race_associativity(full, vars, bits, family);
+    } else if ((ops.size() > 1) && (std::thread::hardware_concurrency() >= ops.size()) &&
+               !WorkStealingPool::is_worker_thread()) {
+        // Run one after the other, the components take longer than the
+        // conjunction, so they are only split if they can all run at once:
+        // not from the workers of a sweep, which already use every core
+        result = z3_prove_components(session, pipeline, ops.size(), bits,
+                                     [&](ProverSession &s, size_t i) { return component_in(s, i, 0); },
+                                     [&](ProverSession &s) { return declare_vars_in(s, 0); });
+    } else {
+        for (unsigned timeout : kProofTimeouts) {
+            result = z3_prove_associativity(session, pipeline, full, vars, bits, timeout);
+            if (result != IsAssociative::UNKNOWN) {
+                break;
+            }
+        }
+    }
     if (result != IsAssociative::YES) {
         DEBUG_PRINT << "Cannot prove associativity of Tuple\n";
         /*result = z3_prove_associativity(convert_halide_to_z3(conjecture, &ctx, false));
@@ -274,19 +1246,27 @@ IsAssociative prove_associativity_helper(const Halide::Tuple &tuple,
     return result;
 }
 
-AssociativeIds find_identity(const Halide::Tuple &tuple,
+/**
+ * Find the left identity e of the operator, for which f(e, y) == y, or its
+ * right identity, for which f(x, e) == x, in the given session.
+ */
+bool find_one_sided_identity(const Halide::Tuple &tuple,
                              const vector<Expr> &xvars,
                              const vector<Expr> &yvars,
                              const vector<Expr> &constants,
-                             z3::context &ctx,
-                             bool use_bv) {
+                             AssociativeIds::Associativity side,
+                             OperatorFamily family,
+                             ProverSession &session,
+                             bool use_bv,
+                             vector<Expr> &identities) {
+    z3::context &ctx = session.context();
     const vector<Expr> &ops = tuple.as_vector();
+    bool left = (side == AssociativeIds::LEFT);
 
     vector<Type> types(ops.size());
-    vector<string> xnames(ops.size()), ynames(ops.size()), enames(ops.size());
     vector<Expr> evars(ops.size());
-    z3::expr_vector z3_xqvars(ctx), z3_yqvars(ctx), z3_constants(ctx), z3_evars(ctx);
-
+    z3::expr_vector z3_qvars(ctx), z3_evars(ctx);
+    map<string, Expr> replacement;
     for (size_t i = 0; i < ops.size(); ++i) {
         const Variable *x = xvars[i].as<Variable>();
         const Variable *y = yvars[i].as<Variable>();
@@ -294,92 +1274,263 @@ AssociativeIds find_identity(const Halide::Tuple &tuple,
         ASSERT(x->type == y->type, "Expect xvar and yvar to be of the same type\n");
 
         types[i] = x->type;
-        xnames[i] = x->name;
-        ynames[i] = y->name;
-        enames[i] = "e" + std::to_string(i);
-        evars[i] = Variable::make(xvars[i].type(), enames[i]);
-        z3_xqvars.push_back(convert_halide_to_z3(xvars[i], &ctx, use_bv));
-        z3_yqvars.push_back(convert_halide_to_z3(yvars[i], &ctx, use_bv));
-        z3_evars.push_back(convert_halide_to_z3(evars[i], &ctx, use_bv));
+        evars[i] = Variable::make(xvars[i].type(), "e" + std::to_string(i));
+        // Left identity f(e, y) : x -> e; right identity f(x, e) : y -> e
+        replacement.emplace(left ? x->name : y->name, evars[i]);
+        z3_qvars.push_back(session.declare(left ? yvars[i] : xvars[i], use_bv));
+        z3_evars.push_back(session.declare(evars[i], use_bv));
     }
     for (size_t i = 0; i < constants.size(); ++i) {
-        z3_xqvars.push_back(convert_halide_to_z3(constants[i], &ctx, use_bv));
-        z3_yqvars.push_back(convert_halide_to_z3(constants[i], &ctx, use_bv));
+        z3_qvars.push_back(session.declare(constants[i], use_bv));
     }
 
-    AssociativeIds result;
+    vector<Expr> sides(ops);
+    for (size_t i = 0; i < ops.size(); ++i) {
+        sides[i] = substitute(replacement, sides[i]);
+    }
 
-    // First, try to find a left-identity
-    {
-        vector<Expr> lhs(ops);
+    DEBUG_PRINT << (left ? "Left" : "Right") << "-identity:\n{\n";
+    for (size_t i = 0; i < ops.size(); ++i) {
+        DEBUG_PRINT << "   " << sides[i] << "\n";
+    }
+    DEBUG_PRINT << "}\n";
 
-        map<string, Expr> replacement;
-        for (size_t j = 0; j < ops.size(); ++j) {
-            replacement.emplace(xnames[j], evars[j]);
+    // The identity of an IEEE float element must give back every non-NaN
+    // value, and not be NaN itself. It must give back the value exactly (e.g.
+    // -0.0 for addition) unless floats are modelled as reals, under which the
+    // sign of zero is lost anyway.
+    const ProverStrategy &strategy = current_strategy();
+    vector<z3::expr> equations, qvars, not_nan;
+    for (size_t i = 0; i < ops.size(); ++i) {
+        z3::expr side = convert_halide_to_z3(sides[i], &ctx, use_bv);
+        const z3::expr &other = z3_qvars[i];
+        if (is_fp(side) && (strategy.floats == FloatSemantics::REAL)) {
+            equations.push_back(z3::fp_equal(side, other));
+        } else {
+            equations.push_back(side == other);
         }
-        for (size_t i = 0; i < ops.size(); ++i) {
-            // f(e, y) : x -> e
-            lhs[i] = substitute(replacement, lhs[i]);
+        if (is_fp(z3_evars[i])) {
+            not_nan.push_back(!z3::fp_is_nan(z3_evars[i]));
         }
+    }
+    for (unsigned i = 0; i < z3_qvars.size(); ++i) {
+        qvars.push_back(z3_qvars[i]);
+    }
+    z3::expr equation = conjunction(ctx, equations);
+    if (!not_nan.empty()) {
+        equation = z3::implies(none_nan(ctx, qvars), equation) && conjunction(ctx, not_nan);
+    }
 
-        DEBUG_PRINT << "Left-identity:\n{\n";
-        for (size_t i = 0; i < ops.size(); ++i) {
-            DEBUG_PRINT << "   " << lhs[i] << "\n";
-        }
-        DEBUG_PRINT << "}\n";
+    DEBUG_PRINT << "\n****Finding identity of " << equation << "\n";
+    return z3_synthesize_identity(session, strategy.associativity[(int)family],
+                                  strategy.identity[(int)family], use_bv, equation,
+                                  types, z3_qvars, z3_evars, identities);
+}
 
-        Expr equation = (lhs[0] == yvars[0]);
-        for (size_t i = 1; i < ops.size(); ++i) {
-            equation = equation && (lhs[i] == yvars[i]);
+// Search for a left and a right identity at once, the latter in the
+// session's partner, which is cancelled as soon as a left identity is found
+// since a left identity is preferred if both exist. On the workers of a
+// sweep, which already use every core, the right identity is only searched
+// for if there is no left one.
+AssociativeIds find_identity(const Halide::Tuple &tuple,
+                             const vector<Expr> &xvars,
+                             const vector<Expr> &yvars,
+                             const vector<Expr> &constants,
+                             OperatorFamily family,
+                             ProverSession &session,
+                             bool use_bv) {
+    vector<Expr> left_ids, right_ids;
+    bool left = false, right = false;
+    if (WorkStealingPool::is_worker_thread()) {
+        left = find_one_sided_identity(tuple, xvars, yvars, constants, AssociativeIds::LEFT,
+                                       family, session, use_bv, left_ids);
+        if (!left) {
+            right = find_one_sided_identity(tuple, xvars, yvars, constants, AssociativeIds::RIGHT,
+                                            family, session, use_bv, right_ids);
         }
+    } else {
+        ProverSession &partner = session.partner();
+        std::thread right_search([&]() {
+            right = find_one_sided_identity(tuple, xvars, yvars, constants, AssociativeIds::RIGHT,
+                                            family, partner, use_bv, right_ids);
+        });
+        left = find_one_sided_identity(tuple, xvars, yvars, constants, AssociativeIds::LEFT,
+                                       family, session, use_bv, left_ids);
+        if (left) {
+            partner.cancel();
+        }
+        right_search.join();
+        partner.resume();
+    }
 
-        DEBUG_PRINT << "\n****Finding identity of " << equation << "\n";
-        if (z3_find_identity(convert_halide_to_z3(equation, &ctx, use_bv),
-                             types, z3_yqvars, z3_evars,
-                             result.identities)) {
-            result.associativity = AssociativeIds::LEFT;
-            DEBUG_PRINT << "Found left-identity\n";
-            return result;
+    AssociativeIds result;
+    if (left) {
+        DEBUG_PRINT << "Found left-identity\n";
+        result.associativity = AssociativeIds::LEFT;
+        result.identities = left_ids;
+    } else if (right) {
+        DEBUG_PRINT << "Found right-identity\n";
+        result.associativity = AssociativeIds::RIGHT;
+        result.identities = right_ids;
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+OperatorFamily operator_family(const Halide::Tuple &tuple) {
+    FindOperations find;
+    for (const Expr &e : tuple.as_vector()) {
+        if (e.type().is_float()) {
+            return OperatorFamily::FLOAT;
         }
+        e.accept(&find);
     }
+    if (find.has_mul) {
+        return find.has_min_max ? OperatorFamily::MUL_MIN_MAX : OperatorFamily::MUL;
+    }
+    return find.has_min_max ? OperatorFamily::MIN_MAX : OperatorFamily::LINEAR;
+}
 
-    // Failed to find left-identity, try to find a right-identity
-    {
-        vector<Expr> rhs(ops);
+const char *operator_family_name(OperatorFamily family) {
+    switch (family) {
+    case OperatorFamily::LINEAR:
+        return "linear";
+    case OperatorFamily::MIN_MAX:
+        return "min/max";
+    case OperatorFamily::MUL:
+        return "mul";
+    case OperatorFamily::MUL_MIN_MAX:
+        return "mul+min/max";
+    case OperatorFamily::FLOAT:
+        return "float";
+    }
+    return "unknown";
+}
 
-        // Right identity f(x, e) : y -> e
-        map<string, Expr> replacement;
-        for (size_t j = 0; j < ops.size(); ++j) {
-            replacement.emplace(ynames[j], evars[j]);  // y -> e
+z3::solver make_solver(z3::context &ctx, const string &pipeline) {
+    for (const TacticPipeline &p : kTacticPipelines) {
+        if (pipeline != p.name) {
+            continue;
         }
-        for (size_t i = 0; i < ops.size(); ++i) {
-            rhs[i] = substitute(replacement, rhs[i]);
+        if (p.tactics.empty()) {
+            return z3::solver(ctx);
         }
-
-        DEBUG_PRINT << "Right-identity:\n{\n";
-        for (size_t i = 0; i < ops.size(); ++i) {
-            DEBUG_PRINT << "   " << rhs[i] << "\n";
+        z3::tactic t(ctx, p.tactics[0]);
+        for (size_t i = 1; i < p.tactics.size(); ++i) {
+            t = t & z3::tactic(ctx, p.tactics[i]);
         }
-        DEBUG_PRINT << "}\n";
+        return t.mk_solver();
+    }
+    ASSERT(false, "Unknown tactic pipeline " << pipeline << "\n");
+    return z3::solver(ctx);
+}
 
-        Expr equation = (rhs[0] == xvars[0]);
-        for (size_t i = 1; i < ops.size(); ++i) {
-            equation = equation && (rhs[i] == xvars[i]);
+const vector<string> &tactic_pipelines() {
+    static const vector<string> names = []() {
+        vector<string> names;
+        for (const TacticPipeline &p : kTacticPipelines) {
+            names.push_back(p.name);
         }
+        return names;
+    }();
+    return names;
+}
 
-        if (z3_find_identity(convert_halide_to_z3(equation, &ctx, use_bv),
-                             types, z3_xqvars, z3_evars,
-                             result.identities)) {
-            result.associativity = AssociativeIds::RIGHT;
-            DEBUG_PRINT << "Found right-identity\n";
-            return result;
+ProverStrategy::ProverStrategy() : floats(FloatSemantics::IEEE) {
+    // Bit-blasting straight to SAT is about 2x faster than the default solver
+    // on the min/max operators that take seconds, but times out on some
+    // multiplications that smt proves instantly. ufbv finds most identities
+    // 5-10x faster than the default solver, but takes 0.5s on min(x, y).
+    associativity[(int)OperatorFamily::LINEAR] = "smt";
+    associativity[(int)OperatorFamily::MIN_MAX] = "bit-blast";
+    associativity[(int)OperatorFamily::MUL] = "smt";
+    associativity[(int)OperatorFamily::MUL_MIN_MAX] = "smt";
+    identity[(int)OperatorFamily::LINEAR] = "ufbv";
+    identity[(int)OperatorFamily::MIN_MAX] = "default";
+    identity[(int)OperatorFamily::MUL] = "ufbv";
+    identity[(int)OperatorFamily::MUL_MIN_MAX] = "default";
+    // None of the pipelines but the default solver handles floating-point
+    // and real arithmetic (and the quantified identity query over floats)
+    // well, since they are tuned for bitvectors.
+    associativity[(int)OperatorFamily::FLOAT] = "default";
+    identity[(int)OperatorFamily::FLOAT] = "default";
+}
+
+void set_prover_strategy(const ProverStrategy &strategy) {
+    const vector<string> &names = tactic_pipelines();
+    auto check = [&](const string &pipeline) {
+        ASSERT(std::find(names.begin(), names.end(), pipeline) != names.end(),
+               "Unknown tactic pipeline " << pipeline << "\n");
+    };
+    for (int f = 0; f < kNumOperatorFamilies; ++f) {
+        check(strategy.associativity[f]);
+        check(strategy.identity[f]);
+    }
+    for (const string &pipeline : strategy.race) {
+        check(pipeline);
+    }
+    current_strategy() = strategy;
+}
+
+const ProverStrategy &prover_strategy() {
+    return current_strategy();
+}
+
+void print_tactic_report(std::ostream &out) {
+    RaceStats &stats = race_stats();
+    std::lock_guard<std::mutex> lock(stats.mutex);
+    out << "Tactic race wins:\n";
+    for (int f = 0; f < kNumOperatorFamilies; ++f) {
+        if (stats.races[f] == 0) {
+            continue;
+        }
+        int decided = 0;
+        out << "  " << operator_family_name((OperatorFamily)f) << ":";
+        for (const auto &iter : stats.wins[f]) {
+            out << "  " << iter.first << " " << iter.second
+                << " (" << 1000 * stats.winning_time[f][iter.first] / iter.second << " ms)";
+            decided += iter.second;
         }
+        out << "  undecided " << stats.races[f] - decided << " of " << stats.races[f] << "\n";
     }
+}
 
-    return result;
+ProverSession::ProverSession() : params(ctx), cancelled(false) {}
+
+ProverSession &ProverSession::partner(size_t i) {
+    while (partners.size() <= i) {
+        partners.emplace_back(new ProverSession);
+    }
+    partners[i]->operator_subject = operator_subject;
+    return *partners[i];
 }
 
-} // anonymous namespace
+z3::solver &ProverSession::reset_solver(unsigned timeout, const string &pipeline) {
+    auto iter = solvers.find(pipeline);
+    if (iter == solvers.end()) {
+        iter = solvers.emplace(pipeline, make_solver(ctx, pipeline)).first;
+    }
+    z3::solver &solver = iter->second;
+    // Resetting keeps the solver in its non-incremental mode, which bit-blasts
+    // the conjecture up front; push/pop runs the same queries about 2x slower.
+    solver.reset();
+    params.set(":timeout", timeout);
+    solver.set(params);
+    return solver;
+}
+
+const z3::expr &ProverSession::declare(const Expr &var, bool use_bv, int bits) {
+    const Variable *v = var.as<Variable>();
+    ASSERT(v != nullptr, "Expect a variable\n");
+    int width = (bits != 0) ? bits : v->type.bits();
+    string key = v->name + "/" + std::to_string(width) + (use_bv ? "/bv" : "/int");
+    auto iter = declarations.find(key);
+    if (iter == declarations.end()) {
+        iter = declarations.emplace(key, convert_halide_to_z3(var, &ctx, use_bv, bits)).first;
+    }
+    return iter->second;
+}
 
 pair<IsAssociative, AssociativeIds> prove_associativity(const Halide::Expr &expr,
                                                         const vector<Expr> &xvars,
@@ -393,7 +1544,76 @@ pair<IsAssociative, AssociativeIds> prove_associativity(const Halide::Tuple &tup
                                                         const vector<Expr> &xvars,
                                                         const vector<Expr> &yvars,
                                                         const vector<Expr> &constants) {
+    // Each worker thread keeps its own session for the whole sweep
+    thread_local ProverSession session;
+    ProofCache &cache = proof_cache();
+
+    if (!cache.is_open()) {
+        return prove_associativity(tuple, xvars, yvars, constants, session);
+    }
 
+    // The records are shared by all the relabelings of an operator, with
+    // the identities in the order of the one the key is of
+    vector<size_t> slots;
+    ProofKey key = relabeled_proof_key(tuple, xvars, yvars, current_strategy().floats, slots);
+    // UNKNOWN is not settled: a longer budget or another strategy may well
+    // decide it, so it is proven again. Caches written before it was left
+    // out may still hold such records.
+    ProofRecord record;
+    if (cache.find(key, record) && ((IsAssociative)record.result != IsAssociative::UNKNOWN) &&
+        ((record.size == 0) || (record.size == tuple.size()))) {
+        AssociativeIds identities;
+        identities.associativity = (AssociativeIds::Associativity)record.associativity;
+        for (size_t i = 0; i < record.size; ++i) {
+            const Type &t = xvars[i].type();
+            int64_t bits = record.identities[slots[i]];
+            if (t.is_float()) {
+                double value;
+                memcpy(&value, &bits, sizeof(value));
+                identities.identities.push_back(FloatImm::make(t, value));
+            } else {
+                identities.identities.push_back(make_const(t, bits));
+            }
+        }
+        return std::make_pair((IsAssociative)record.result, identities);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    pair<IsAssociative, AssociativeIds> result = prove_associativity(tuple, xvars, yvars, constants, session);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const vector<Expr> &ids = result.second.identities;
+    if ((result.first == IsAssociative::UNKNOWN) || (ids.size() > (size_t)ProofRecord::kMaxIdentities) ||
+        (!ids.empty() && (ids.size() != tuple.size()))) {
+        return result;
+    }
+    record = ProofRecord();
+    record.result = (uint8_t)result.first;
+    record.associativity = (uint8_t)result.second.associativity;
+    record.size = (uint8_t)ids.size();
+    record.seconds = (float)seconds;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        int64_t &bits = record.identities[slots[i]];
+        if (const IntImm *imm = ids[i].as<IntImm>()) {
+            bits = imm->value;
+        } else if (const UIntImm *imm = ids[i].as<UIntImm>()) {
+            bits = (int64_t)imm->value;
+        } else if (const FloatImm *imm = ids[i].as<FloatImm>()) {
+            // By bit pattern, to keep the sign of zero
+            memcpy(&bits, &imm->value, sizeof(imm->value));
+        } else {
+            return result;
+        }
+    }
+    cache.insert(key, record);
+    return result;
+}
+
+pair<IsAssociative, AssociativeIds> prove_associativity(const Halide::Tuple &tuple,
+                                                        const vector<Expr> &xvars,
+                                                        const vector<Expr> &yvars,
+                                                        const vector<Expr> &constants,
+                                                        ProverSession &session) {
     ASSERT((xvars.size() == yvars.size()) && (xvars.size() == tuple.size()),
         "Expect xvars, yvars, and tuple of exprs to all be of the same size\n");
 
@@ -401,16 +1621,17 @@ pair<IsAssociative, AssociativeIds> prove_associativity(const Halide::Tuple &tup
         ASSERT(check_vars_validity(e, xvars, yvars, constants), "Contains invalid vars\n");
     }
 
-    z3::context ctx;
     AssociativeIds identities;
+    OperatorFamily family = operator_family(tuple);
+    session.set_subject(tuple.as_vector());
 
-    IsAssociative is_associative = prove_associativity_helper(tuple, xvars, yvars, constants, ctx);
+    IsAssociative is_associative = prove_associativity_helper(tuple, xvars, yvars, constants, family, session);
 
     if (is_associative != IsAssociative::NO) {
-        identities = find_identity(tuple, xvars, yvars, constants, ctx, true);
+        identities = find_identity(tuple, xvars, yvars, constants, family, session, true);
         /*if (identities.associativity == AssociativeIds::UNKNOWN) {
             DEBUG_PRINT << "SWITCH to infinite integer when finding identity\n";
-            identities = find_identity(tuple, xvars, yvars, constants, ctx, false);
+            identities = find_identity(tuple, xvars, yvars, constants, family, session, false);
         }*/
         return std::make_pair(is_associative, identities);
     }
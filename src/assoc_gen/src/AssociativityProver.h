@@ -8,8 +8,15 @@
  */
 
 #include "Halide.h"
+#include "HalideToZ3.h"
 #include "z3++.h"
 
+#include <atomic>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
 #include <vector>
 
 struct AssociativeIds {
@@ -31,6 +38,134 @@ enum class IsAssociative {
 	UNKNOWN = 2
 };
 
+/**
+ * Operator families, by the kinds of operations an operator uses. Z3 has
+ * no single best strategy across them, so each picks its own tactic
+ * pipelines (see ProverStrategy).
+ */
+enum class OperatorFamily {
+	LINEAR = 0,      // Only additions and subtractions
+	MIN_MAX = 1,     // Min, max or select, but no multiplication
+	MUL = 2,         // Multiplication, but no min, max or select
+	MUL_MIN_MAX = 3, // Both
+	FLOAT = 4        // Any operator with a float element
+};
+
+const int kNumOperatorFamilies = 5;
+
+OperatorFamily operator_family(const Halide::Tuple &tuple);
+const char *operator_family_name(OperatorFamily family);
+
+/**
+ * The named Z3 tactic pipelines the prover's queries are run through:
+ *   "default"   : Z3's default solver
+ *   "smt"       : simplify, solve-eqs, smt
+ *   "bit-blast" : simplify, solve-eqs, bit-blast, sat
+ *   "ufbv"      : Z3's strategy for quantified bitvector formulas
+ *   "qe"        : simplify, qe, smt
+ * All the queries are quantifier-free but the last resort of the identity
+ * search, forall x. f(e, x) == x.
+ */
+const std::vector<std::string> &tactic_pipelines();
+
+// A solver running the named pipeline
+z3::solver make_solver(z3::context &ctx, const std::string &pipeline);
+
+/**
+ * Which pipeline the prover runs each query through, by the operator
+ * family of the candidate: 'associativity' for the quantifier-free ones,
+ * 'identity' for the quantified identity query. The defaults are the fastest pipeline per
+ * family on the single-element operators of up to 3 leaves. If 'race' is
+ * not empty, the full-width associativity proof instead runs through all
+ * of its pipelines at once, each on its own thread, and keeps the first
+ * answer; the wins are tallied for print_tactic_report. Racing is meant
+ * for tuning the defaults: it multiplies the threads of a sweep.
+ *
+ * 'floats' is how float operators are proven associative. With IEEE floats
+ * (the default), the operator must give the same result either way, up to
+ * the sign of zero, for all the non-NaN inputs; that holds for min and max
+ * but not for addition or multiplication, which round differently. With
+ * REAL, floats are modelled as reals, so sums and products are associative
+ * up to the rounding error of reassociating them, which is what reordering
+ * a float reduction into a parallel one accepts. Identities are always
+ * those of the IEEE operator (e.g. -inf for max, -0.0 for addition).
+ */
+struct ProverStrategy {
+    std::string associativity[kNumOperatorFamilies];
+    std::string identity[kNumOperatorFamilies];
+    std::vector<std::string> race;
+    FloatSemantics floats;
+
+    ProverStrategy();
+};
+
+// Set the strategy of all the following proofs. Must not be called while
+// any proof is running.
+void set_prover_strategy(const ProverStrategy &strategy);
+const ProverStrategy &prover_strategy();
+
+// Print, per operator family, how many races each pipeline won and how
+// long its winning proofs took on average
+void print_tactic_report(std::ostream &out);
+
+/**
+ * Z3 state kept alive across proofs: one context, one solver per tactic
+ * pipeline that is reset (rather than rebuilt, with its parameters set
+ * again) for every query, and the declarations of the x/y/z/k/e variables.
+ * Creating a context and a solver per proof takes about a third of the time
+ * spent proving the simple operators the generators mostly produce. A
+ * session must only be used by one thread.
+ */
+class ProverSession {
+    z3::context ctx;
+    z3::params params;
+    // By pipeline name
+    std::map<std::string, z3::solver> solvers;
+    // By variable name, bit width and whether it is a bitvector
+    std::map<std::string, z3::expr> declarations;
+    // Run the queries that run alongside this session's own
+    std::vector<std::unique_ptr<ProverSession>> partners;
+    // The operator being proven, for the slow-query log
+    std::vector<Halide::Expr> operator_subject;
+    // Set by cancel(): the session's queries give up at once
+    std::atomic<bool> cancelled;
+
+public:
+    ProverSession();
+    ProverSession(const ProverSession &) = delete;
+    ProverSession &operator=(const ProverSession &) = delete;
+
+    z3::context &context() { return ctx; }
+
+    // The session's solver for the given tactic pipeline, emptied for a new
+    // query with the given timeout (in ms)
+    z3::solver &reset_solver(unsigned timeout, const std::string &pipeline = "default");
+
+    // The Z3 constant for the Halide variable 'var', narrowed to 'bits' bits
+    // if that is non-zero
+    const z3::expr &declare(const Halide::Expr &var, bool use_bv, int bits = 0);
+
+    // The operator the session (and its partners) are proving
+    void set_subject(const std::vector<Halide::Expr> &ops) { operator_subject = ops; }
+    const std::vector<Halide::Expr> &subject() const { return operator_subject; }
+
+    // Interrupt the session's running query and make its following ones
+    // return unknown without running, until resume(). May be called from
+    // another thread than the one using the session.
+    void cancel() {
+        cancelled = true;
+        ctx.interrupt();
+    }
+    void resume() { cancelled = false; }
+    bool is_cancelled() const { return cancelled; }
+
+    // Another session, for a query run on another thread at the same time as
+    // one of this session's (see find_identity and z3_prove_components).
+    // Partners are created on first use, so only call this from the thread
+    // using this session.
+    ProverSession &partner(size_t i = 0);
+};
+
 /**
  * Given Tuple of Halide Exprs and list of variables involves in the exprs,
  * determine if they are associative and compute the identity of each Expr in
@@ -50,6 +185,15 @@ enum class IsAssociative {
  * The list of variables are the following: xvars -> {x0, x1} and
  * yvars -> {y0, y1}. Note that xvars and yvars have to be of the same size,
  * which size equals to the Tuple size.
+ *
+ * Unless a session is given, each thread proves with its own ProverSession,
+ * and the verdict is looked up in (or else added to) the persistent
+ * proof_cache() first, if PROOF_CACHE names one, under a key shared by all
+ * the relabelings of the operator (its slots permuted, with x_j and y_j
+ * renamed to match). UNKNOWN verdicts are not cached. The
+ * associativity queries run in the worker processes of z3_worker_pool() if
+ * it was started (see start_prover_workers); the identity queries always
+ * run in-process.
  */
 // @{
 std::pair<IsAssociative, AssociativeIds> prove_associativity(
@@ -62,6 +206,12 @@ std::pair<IsAssociative, AssociativeIds> prove_associativity(
 	const std::vector<Halide::Expr> &xvars,
 	const std::vector<Halide::Expr> &yvars,
 	const std::vector<Halide::Expr> &constants);
+std::pair<IsAssociative, AssociativeIds> prove_associativity(
+	const Halide::Tuple &tuple,
+	const std::vector<Halide::Expr> &xvars,
+	const std::vector<Halide::Expr> &yvars,
+	const std::vector<Halide::Expr> &constants,
+	ProverSession &session);
 // @}
 
 void associativity_prover_test();
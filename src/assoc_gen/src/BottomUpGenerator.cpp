@@ -0,0 +1,479 @@
+#include "Halide.h"
+#include "Error.h"
+#include "Utilities.h"
+#include "ProverWorkers.h"
+#include "HashSet.h"
+#include "Fingerprint.h"
+#include "SimdEval.h"
+
+#include <chrono>
+#include <iostream>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <stdint.h>
+
+/**
+ * Single-element generator (same search space as Generator.cpp) that grows
+ * the expressions bottom-up by number of leaves. Every new expression is
+ * op(a, b) for two expressions already in the table, and its values on a
+ * fixed set of sample inputs are computed from the values of a and b. An
+ * expression whose values match those of an expression already in the table
+ * computes the same function (observational equivalence), so it is neither
+ * stored nor checked; only the smallest representative of each function is
+ * sent through should_skip_expression, the fast check and Z3.
+ * It is built like Generator.cpp, e.g.
+ *   g++ -std=c++11 -O3 BottomUpGenerator.cpp Utilities.cpp AssociativityProver.cpp ... -lHalide -lz3
+ */
+
+using std::string;
+using std::vector;
+using Halide::Internal::Variable;
+
+Halide::Type kType = Halide::UInt(32);
+vector<string> kXNames = {"x0"};
+vector<string> kYNames = {"y0"};
+vector<string> kConstantNames = {"k0"};
+vector<Halide::Expr> kXVars = {Variable::make(kType, "x0")};
+vector<Halide::Expr> kYVars = {Variable::make(kType, "y0")};
+vector<Halide::Expr> kConstants = {Variable::make(kType, "k0")};
+
+enum Node : uint8_t {
+    X0 = 0,
+    Y0,
+    K0,
+    Add,
+    Sub,
+    Mul,
+    Min,
+    Max,
+    LastNode,
+};
+
+// Number of sample inputs every expression is evaluated on. Trees mixing
+// min/max can differ on only a small part of the input space; with 64
+// samples about 0.04% of the distinct 6-leaf functions get merged, while 256
+// tell apart all of those that 1024 do.
+const int NUM_SAMPLES = 256;
+
+// Samples the last level is split into passes by (see Table::grow)
+const int NUM_PREFIX_SAMPLES = 8;
+
+// Largest number of trees composed per pass over the last level, which
+// bounds the set the pass dedups them in
+const uint64_t MAX_PASS_TREES = 1ULL << 24;
+
+// out[s] = op(a[s], b[s]) for the samples in [begin, end)
+void compose_values(Node op, const Value *a, const Value *b, Value *out, int begin, int end) {
+    switch (op) {
+    case Add:
+        for (int s = begin; s < end; ++s) {
+            out[s] = wrap_add(a[s], b[s]);
+        }
+        break;
+    case Sub:
+        for (int s = begin; s < end; ++s) {
+            out[s] = wrap_sub(a[s], b[s]);
+        }
+        break;
+    case Mul:
+        for (int s = begin; s < end; ++s) {
+            out[s] = wrap_mul(a[s], b[s]);
+        }
+        break;
+    case Min:
+        for (int s = begin; s < end; ++s) {
+            out[s] = std::min(a[s], b[s]);
+        }
+        break;
+    case Max:
+        for (int s = begin; s < end; ++s) {
+            out[s] = std::max(a[s], b[s]);
+        }
+        break;
+    default:
+        assert(false);
+        break;
+    }
+}
+
+// FNV-1a over the samples in [begin, end), continuing from 'h'
+uint64_t hash_values(const Value *v, int begin, int end,
+                     uint64_t h = 14695981039346656037ULL) {
+    for (int s = begin; s < end; ++s) {
+        h ^= (uint32_t)v[s];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * The distinct functions found so far, by number of leaves. Only the terms
+ * with at most max_leaves / 2 leaves keep their values: those are the only
+ * ones that can be the smaller operand of a new tree, so they are looked at
+ * over and over. The values of a larger operand are recomputed from its
+ * subtrees once for all the trees it is the larger operand of. Functions
+ * are told apart by the 64-bit hash of their values; for the ~10^9 trees
+ * with 8 leaves the odds of two different functions colliding are ~10^-3.
+ */
+class Table {
+public:
+    // The expression is 'op' if it is a leaf, op(left, right) otherwise
+    struct Term {
+        Node op;
+        uint8_t leaves;
+        bool uses_x, uses_y;
+        uint32_t left, right;
+    };
+
+private:
+    const uint64_t max_leaves_to_store;
+
+    vector<Term> terms;
+    // Values of the terms [0, values.size() / NUM_SAMPLES)
+    vector<Value> values;
+    HashSet<Fingerprint> index;
+    // Terms with n leaves are [level_start[n], level_start[n + 1])
+    vector<uint32_t> level_start;
+
+    Value sample_x[NUM_SAMPLES], sample_y[NUM_SAMPLES], sample_k[NUM_SAMPLES];
+
+    void add_leaf(Node op) {
+        const Value *sample = (op == X0) ? sample_x : ((op == Y0) ? sample_y : sample_k);
+        index.insert(Fingerprint(hash_values(sample, 0, NUM_SAMPLES)));
+        terms.push_back({op, 1, op == X0, op == Y0, 0, 0});
+        values.insert(values.end(), sample, sample + NUM_SAMPLES);
+    }
+
+    Term make_term(Node op, uint32_t a, uint32_t b) const {
+        const Term &ta = terms[a], &tb = terms[b];
+        return {op, (uint8_t)(ta.leaves + tb.leaves), ta.uses_x || tb.uses_x, ta.uses_y || tb.uses_y, a, b};
+    }
+
+    bool has_values(uint32_t id) const {
+        return (size_t)id * NUM_SAMPLES < values.size();
+    }
+
+    // The first 'n' values of the term, either stored or computed into
+    // 'scratch' (which must hold NUM_SAMPLES Values)
+    const Value *values_of(uint32_t id, int n, Value *scratch) const {
+        if (has_values(id)) {
+            return &values[(size_t)id * NUM_SAMPLES];
+        }
+        const Term &t = terms[id];
+        Value left_scratch[NUM_SAMPLES], right_scratch[NUM_SAMPLES];
+        const Value *a = values_of(t.left, n, left_scratch);
+        const Value *b = values_of(t.right, n, right_scratch);
+        compose_values(t.op, a, b, scratch, 0, n);
+        return scratch;
+    }
+
+public:
+    Table(const Table &) = delete;
+    Table &operator=(const Table &) = delete;
+
+    explicit Table(uint64_t max_leaves) : max_leaves_to_store(std::max<uint64_t>(max_leaves / 2, 1)) {
+        // Full-range samples, drawn from their own engine so that they do not
+        // depend on (or shift) the random trials of the fast check
+        std::mt19937 engine(0x5eed);
+        for (int s = 0; s < NUM_SAMPLES; ++s) {
+            sample_x[s] = (Value)engine();
+            sample_y[s] = (Value)engine();
+            sample_k[s] = (Value)engine();
+        }
+
+        level_start = {0, 0};
+        add_leaf(X0);
+        add_leaf(Y0);
+        add_leaf(K0);
+        level_start.push_back(terms.size());
+    }
+
+    const Term &operator[](uint32_t id) const {
+        return terms[id];
+    }
+
+    size_t size() const {
+        return terms.size();
+    }
+
+    // Number of leaves of the largest terms in the table
+    uint64_t max_leaves() const {
+        return level_start.size() - 2;
+    }
+
+    uint32_t level_begin(uint64_t leaves) const {
+        return level_start[leaves];
+    }
+
+    uint32_t level_end(uint64_t leaves) const {
+        return level_start[leaves + 1];
+    }
+
+    // Number of trees the next call to grow() composes
+    uint64_t count_next() const {
+        uint64_t leaves = max_leaves() + 1;
+        uint64_t count = 0;
+        for (uint64_t left = leaves - 1; left >= 1; --left) {
+            uint64_t right = leaves - left;
+            uint64_t n_left = level_end(left) - level_begin(left);
+            uint64_t n_right = level_end(right) - level_begin(right);
+            // Sub takes every split in both orders, the commutative ops
+            // only the ones with left >= right
+            count += n_left * n_right;
+            if (left > right) {
+                count += 4 * n_left * n_right;
+            } else if (left == right) {
+                count += 4 * n_left * (n_left + 1) / 2;
+            }
+        }
+        return count;
+    }
+
+    /**
+     * Compose all the trees with one more leaf than the largest terms so far
+     * and call 'visit(id)' on each one computing a new function. If 'store'
+     * is set they are kept as the next level of the table. Otherwise they are
+     * only visited (and dropped again right after), and the set of the
+     * functions seen at that level is all that bounds the memory: the trees
+     * are then composed in several passes, each of which only looks at the
+     * trees whose first NUM_PREFIX_SAMPLES values hash to its share. Equal
+     * functions agree on those samples, so each is still visited once.
+     * Returns the number of trees that were composed.
+     */
+    template<typename Visit>
+    uint64_t grow(bool store, Visit visit) {
+        uint64_t leaves = max_leaves() + 1;
+        uint64_t composed = count_next();
+        bool keep_values = store && (leaves <= max_leaves_to_store);
+        uint64_t passes = store ? 1 : (composed + MAX_PASS_TREES - 1) / MAX_PASS_TREES;
+        // Nothing may move while the loops below point into the table
+        if (store) {
+            terms.reserve(terms.size() + composed);
+        } else {
+            terms.reserve(terms.size() + 1);
+        }
+        if (keep_values) {
+            values.reserve(values.size() + composed * NUM_SAMPLES);
+        }
+
+        Value scratch[NUM_SAMPLES], v[NUM_SAMPLES];
+        const Node ops[] = {Add, Sub, Mul, Min, Max};
+        for (uint64_t pass = 0; pass < passes; ++pass) {
+            HashSet<Fingerprint> seen;
+            for (Node op : ops) {
+                bool commutative = (op != Sub);
+                for (uint64_t left = leaves - 1; left >= 1; --left) {
+                    uint64_t right = leaves - left;
+                    if (commutative && (left < right)) {
+                        break;
+                    }
+                    // The larger operand goes in the outer loop, so that its
+                    // values are recomputed (if they are not stored) at most
+                    // once for all the trees it is part of. The smaller one
+                    // always has its values stored.
+                    bool outer_is_left = (left >= right);
+                    uint64_t outer = outer_is_left ? left : right;
+                    uint64_t inner = outer_is_left ? right : left;
+                    for (uint32_t o = level_begin(outer); o < level_end(outer); ++o) {
+                        const Value *vo = values_of(o, NUM_PREFIX_SAMPLES, scratch);
+                        bool complete = has_values(o);
+                        // op(a, b) == op(b, a), so only one order is needed
+                        // when both come from the same level
+                        uint32_t i_end = (commutative && (left == right)) ? o + 1 : level_end(inner);
+                        for (uint32_t i = level_begin(inner); i < i_end; ++i) {
+                            const Value *vi = &values[(size_t)i * NUM_SAMPLES];
+                            compose_values(op, outer_is_left ? vo : vi, outer_is_left ? vi : vo, v, 0, NUM_PREFIX_SAMPLES);
+                            uint64_t h = hash_values(v, 0, NUM_PREFIX_SAMPLES);
+                            if ((passes > 1) && ((h >> 32) % passes != pass)) {
+                                continue;
+                            }
+                            if (!complete) {
+                                vo = values_of(o, NUM_SAMPLES, scratch);
+                                complete = true;
+                            }
+                            compose_values(op, outer_is_left ? vo : vi, outer_is_left ? vi : vo, v, NUM_PREFIX_SAMPLES, NUM_SAMPLES);
+                            Fingerprint f(hash_values(v, NUM_PREFIX_SAMPLES, NUM_SAMPLES, h));
+
+                            uint32_t a = outer_is_left ? o : i;
+                            uint32_t b = outer_is_left ? i : o;
+                            uint32_t id = terms.size();
+                            if (store) {
+                                if (index.insert(f)) {
+                                    terms.push_back(make_term(op, a, b));
+                                    if (keep_values) {
+                                        values.insert(values.end(), v, v + NUM_SAMPLES);
+                                    }
+                                    visit(id);
+                                }
+                            } else if (!index.contains(f) && seen.insert(f)) {
+                                terms.push_back(make_term(op, a, b));
+                                visit(id);
+                                terms.pop_back();
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        level_start.push_back(terms.size());
+        return composed;
+    }
+
+    Halide::Expr get_expr(uint32_t id) const {
+        const Term &t = terms[id];
+        switch (t.op) {
+        case X0:
+            return kXVars[0];
+        case Y0:
+            return kYVars[0];
+        case K0:
+            return kConstants[0];
+        case Add:
+            return get_expr(t.left) + get_expr(t.right);
+        case Sub:
+            return get_expr(t.left) - get_expr(t.right);
+        case Mul:
+            return get_expr(t.left) * get_expr(t.right);
+        case Min:
+            return Halide::min(get_expr(t.left), get_expr(t.right));
+        case Max:
+            return Halide::max(get_expr(t.left), get_expr(t.right));
+        default:
+            assert(false);
+            return Halide::Expr();
+        }
+    }
+
+    void compile_term(uint32_t id, Program &p) const {
+        const Term &t = terms[id];
+        switch (t.op) {
+        case X0:
+            p.push(OpCode::LoadX, 0);
+            break;
+        case Y0:
+            p.push(OpCode::LoadY, 0);
+            break;
+        case K0:
+            p.push(OpCode::LoadK);
+            break;
+        case Add:
+            compile_term(t.left, p);
+            compile_term(t.right, p);
+            p.push(OpCode::Add);
+            break;
+        case Sub:
+            compile_term(t.left, p);
+            compile_term(t.right, p);
+            p.push(OpCode::Sub);
+            break;
+        case Mul:
+            compile_term(t.left, p);
+            compile_term(t.right, p);
+            p.push(OpCode::Mul);
+            break;
+        case Min:
+            compile_term(t.left, p);
+            compile_term(t.right, p);
+            p.push(OpCode::Min);
+            break;
+        case Max:
+            compile_term(t.left, p);
+            compile_term(t.right, p);
+            p.push(OpCode::Max);
+            break;
+        default:
+            assert(false);
+            break;
+        }
+    }
+
+    Program compile(uint32_t id) const {
+        Program p;
+        compile_term(id, p);
+        return p;
+    }
+};
+
+int main(int argc, char **argv) {
+    start_prover_workers();
+    uint64_t MIN_LEAVES = 8;
+    uint64_t MAX_LEAVES = 8;
+    if (argc > 1) {
+        MIN_LEAVES = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        MAX_LEAVES = atoi(argv[2]);
+    }
+    std::cout << "Running bottom-up single element generator of type: " << kType << "\n";
+    std::cout << "Min leaves: " << MIN_LEAVES << ", max leaves: " << MAX_LEAVES << "\n\n";
+
+    Table table(MAX_LEAVES);
+    uint64_t valid = 0;
+    uint64_t fails = 0, distinct = 0;
+
+    // Run a new function through the same checks as Generator.cpp
+    auto check = [&](uint32_t id) {
+        const Table::Term &t = table[id];
+        uint64_t leaves = t.leaves;
+        distinct++;
+
+        Halide::Expr expr = table.get_expr(id);
+        bool skip = should_skip_expression(0, expr, false, {t.uses_x}, {t.uses_y}, kXNames, kYNames, kConstantNames);
+        if (skip) {
+            return;
+        }
+
+        bool uses_x = false, uses_y = false;
+        Program program = table.compile(id);
+        bool associative = simd_check_associativity(&program, 1, 250, uses_x, uses_y);
+
+        if (associative && uses_x && uses_y) {
+            vector<Halide::Expr> halide_exprs = {expr};
+            if (z3_check_associativity(halide_exprs, kXVars, kYVars, kConstants, {leaves}, {id})) {
+                valid++;
+            }
+        } else {
+            fails++;
+            DEBUG_PRINT2 << "...Skip " << id << ": " << expr << "\t; uses_x: " << uses_x
+                         << "; uses_y: " << uses_y << "; associative: " << associative << "\n";
+        }
+    };
+    auto ignore = [](uint32_t) {};
+
+    for (uint64_t leaves = 1; leaves <= MAX_LEAVES; ++leaves) {
+        auto start = std::chrono::steady_clock::now();
+        bool report = (leaves >= MIN_LEAVES);
+        if (report) {
+            std::cout << "\n******************************************************************\n";
+            std::cout << "Leaves: " << leaves << "\n";
+            std::cout.flush();
+        }
+
+        fails = 0;
+        distinct = 0;
+        uint64_t composed;
+        if (leaves == 1) {
+            composed = table.size();
+            for (uint32_t id = table.level_begin(1); report && (id < table.level_end(1)); ++id) {
+                check(id);
+            }
+        } else if (report) {
+            // Nothing is built on top of the last level, so it is not kept
+            composed = table.grow(leaves < MAX_LEAVES, check);
+        } else {
+            composed = table.grow(true, ignore);
+        }
+
+        if (report) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "Total: " << composed << ", distinct: " << distinct << ", fails: " << fails << "\n";
+            std::cout << "Valid: " << valid << "\n";
+            std::cout << "Time: " << seconds << " s\n";
+            std::cout << "**************************************************************************\n";
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,120 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+/** \file
+ *
+ * Flat postfix encoding of the generator expressions. Each generator compiles
+ * its candidate once into a Program, which is then evaluated without
+ * recursion on a fixed-size stack for every random trial.
+ */
+
+#include "CommonClass.h"
+
+#include <algorithm>
+#include <cassert>
+#include <stdint.h>
+
+enum class OpCode : uint8_t {
+    LoadX = 0,  // push x[index]
+    LoadY,      // push y[index]
+    LoadK,      // push k
+    Add,
+    Sub,
+    Mul,
+    Min,
+    Max,
+    LT,
+    GT,
+    EQ,
+    NE,
+};
+
+// Largest tuple the fast associativity checks evaluate on fixed-size arrays
+const size_t MAX_TUPLE_SIZE = 4;
+
+struct Instr {
+    OpCode op;
+    uint8_t index;
+};
+
+// Arithmetic on Values wraps around like the int32 values the prover reasons
+// about; doing it on unsigned keeps it well-defined in C++.
+inline Value wrap_add(Value a, Value b) { return (Value)((uint32_t)a + (uint32_t)b); }
+inline Value wrap_sub(Value a, Value b) { return (Value)((uint32_t)a - (uint32_t)b); }
+inline Value wrap_mul(Value a, Value b) { return (Value)((uint32_t)a * (uint32_t)b); }
+
+class Program {
+public:
+    static const int kMaxSize = 64;
+
+    Instr code[kMaxSize];
+    int size;
+
+    Program() : size(0) {}
+
+    void push(OpCode op, int index = 0) {
+        assert(size < kMaxSize);
+        code[size].op = op;
+        code[size].index = (uint8_t)index;
+        size++;
+    }
+
+    Value run(const Value *x, const Value *y, Value k) const {
+        // A postfix program of n instructions never holds more than n values
+        Value stack[kMaxSize];
+        int sp = 0;
+        for (int pc = 0; pc < size; ++pc) {
+            const Instr &in = code[pc];
+            switch (in.op) {
+            case OpCode::LoadX:
+                stack[sp++] = x[in.index];
+                break;
+            case OpCode::LoadY:
+                stack[sp++] = y[in.index];
+                break;
+            case OpCode::LoadK:
+                stack[sp++] = k;
+                break;
+            case OpCode::Add:
+                sp--;
+                stack[sp - 1] = wrap_add(stack[sp - 1], stack[sp]);
+                break;
+            case OpCode::Sub:
+                sp--;
+                stack[sp - 1] = wrap_sub(stack[sp - 1], stack[sp]);
+                break;
+            case OpCode::Mul:
+                sp--;
+                stack[sp - 1] = wrap_mul(stack[sp - 1], stack[sp]);
+                break;
+            case OpCode::Min:
+                sp--;
+                stack[sp - 1] = std::min(stack[sp - 1], stack[sp]);
+                break;
+            case OpCode::Max:
+                sp--;
+                stack[sp - 1] = std::max(stack[sp - 1], stack[sp]);
+                break;
+            case OpCode::LT:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] < stack[sp];
+                break;
+            case OpCode::GT:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] > stack[sp];
+                break;
+            case OpCode::EQ:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] == stack[sp];
+                break;
+            case OpCode::NE:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] != stack[sp];
+                break;
+            }
+        }
+        return (sp == 1) ? stack[0] : 0;
+    }
+};
+
+#endif
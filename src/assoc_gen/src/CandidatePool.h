@@ -0,0 +1,347 @@
+#ifndef CANDIDATE_POOL_H
+#define CANDIDATE_POOL_H
+
+/** \file
+ *
+ * Per-leaf-count pools of the single-element candidates of the tuple
+ * generators, filtered and prepared once per Morton tile.
+ */
+
+#include "Halide.h"
+#include "Bytecode.h"
+#include "Canonicalizer.h"
+#include "Enumerator.h"
+#include "Fingerprint.h"
+#include "HashSet.h"
+#include "Utilities.h"
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+// A tuple element that passed should_skip_expression and was the first such
+// tree of its fingerprint class, along with everything the tuple search
+// needs from it
+template<class T>
+struct Candidate {
+    uint64_t leaves;
+    uint64_t i;
+    T e;
+    Halide::Expr expr;
+    Program program;
+    Fingerprint fingerprint;
+    std::vector<bool> uses_x, uses_y;
+    // Row of the tuple's dependency graph: bit j is set if it uses x_j or y_j
+    uint32_t row;
+    // Rank in the tile, by leaf count and then index
+    uint32_t id;
+};
+
+/**
+ * The surviving candidates of a tile, one pool per leaf count, each in index
+ * order. Every element of a tuple is drawn from the same tile, so the tuple
+ * search is a cartesian product over the pools instead of regenerating and
+ * re-simplifying the inner elements for every outer one. Of the trees that
+ * compute the same function (same fingerprint) and pass the filters only
+ * the first one, by leaf count and then index, is kept: a function is only
+ * lost if all of its trees are filtered out. The pools are only read once
+ * built, so the workers sweeping the tile can share them.
+ */
+template<class T>
+class CandidatePool {
+    // Number of indices handled as one task of the thread pool
+    static const uint64_t kChunk = 1000;
+
+    uint64_t leaves_start;
+    std::vector<std::vector<Candidate<T>>> pools;
+    // Positions in each pool of the candidates with each dependency row
+    std::vector<std::vector<std::vector<size_t>>> rows;
+
+    // Every permutation of the tuple slots, the identity first
+    std::vector<std::vector<uint8_t>> permutations;
+    // Entry id * permutations.size() + p is the id of the candidate that
+    // computes candidate id with its slots renamed by permutation p (x_j and
+    // y_j becoming x_p[j] and y_p[j]), or kNone if no candidate of the tile
+    // does
+    std::vector<uint32_t> relabeled;
+
+    static const uint32_t kNone = ~0u;
+
+    void index_rows() {
+        rows.assign(pools.size(), {});
+        for (size_t p = 0; p < pools.size(); ++p) {
+            for (size_t k = 0; k < pools[p].size(); ++k) {
+                uint32_t row = pools[p][k].row;
+                if (row >= rows[p].size()) {
+                    rows[p].resize(row + 1);
+                }
+                rows[p][row].push_back(k);
+            }
+        }
+    }
+
+    // Number the candidates and set up the relabeling table, to be filled
+    // in by relabel()
+    void index_relabelings(std::unordered_map<uint64_t, uint32_t> &ids) {
+        std::vector<uint8_t> slots;
+        uint32_t id = 0;
+        for (auto &pool : pools) {
+            for (Candidate<T> &c : pool) {
+                c.id = id++;
+                ids[c.fingerprint.value] = c.id;
+                slots.resize(c.uses_x.size());
+            }
+        }
+        for (size_t j = 0; j < slots.size(); ++j) {
+            slots[j] = (uint8_t)j;
+        }
+        permutations.clear();
+        do {
+            permutations.push_back(slots);
+        } while (std::next_permutation(slots.begin(), slots.end()));
+        relabeled.assign((size_t)id * permutations.size(), kNone);
+    }
+
+    void relabel(const std::vector<Candidate<T>> &pool, size_t begin, size_t end,
+                 const std::unordered_map<uint64_t, uint32_t> &ids) {
+        const FingerprintBank &bank = fingerprint_bank();
+        for (size_t k = begin; k < end; ++k) {
+            const Candidate<T> &c = pool[k];
+            for (size_t p = 0; p < permutations.size(); ++p) {
+                Program program = c.program;
+                for (int pc = 0; pc < program.size; ++pc) {
+                    Instr &in = program.code[pc];
+                    if ((in.op == OpCode::LoadX) || (in.op == OpCode::LoadY)) {
+                        in.index = permutations[p][in.index];
+                    }
+                }
+                auto iter = ids.find(bank.fingerprint(program).value);
+                if (iter != ids.end()) {
+                    relabeled[(size_t)c.id * permutations.size() + p] = iter->second;
+                }
+            }
+        }
+    }
+
+public:
+    // An empty range of leaf counts (leaves_start > leaves_end) gives no pools
+    CandidatePool(uint64_t leaves_start, uint64_t leaves_end)
+        : leaves_start(leaves_start), pools((leaves_end >= leaves_start) ? leaves_end + 1 - leaves_start : 0) {}
+
+    // All the trees with the given number of leaves and an index in
+    // [i_start, i_end], compiled and fingerprinted
+    static std::vector<Candidate<T>> generate(const Enumerator &enumerator, uint64_t leaves,
+                                              uint64_t i_start, uint64_t i_end) {
+        const FingerprintBank &bank = fingerprint_bank();
+        std::vector<Candidate<T>> result;
+        IntervalSet range = enumerator.index_range(leaves, i_start, i_end);
+        for (auto it = range.begin(); it != range.end(); it++) {
+            for (uint64_t i = it->lower(); i <= it->upper(); ++i) {
+                Candidate<T> c;
+                c.leaves = leaves;
+                c.i = i;
+                c.e.create(enumerator, leaves, i);
+                c.program = c.e.compile();
+                c.fingerprint = bank.fingerprint(c.program);
+                result.push_back(c);
+            }
+        }
+        return result;
+    }
+
+    // Drop the candidates computing a function already in 'fingerprints'. It
+    // runs after drop_skipped, so that a class is represented by its first
+    // tree that passes the filters rather than lost with a boring first tree.
+    static void drop_equivalent(std::vector<Candidate<T>> &candidates, HashSet<Fingerprint> &fingerprints) {
+        size_t kept = 0;
+        for (size_t j = 0; j < candidates.size(); ++j) {
+            if (fingerprints.insert(candidates[j].fingerprint)) {
+                if (kept != j) {
+                    candidates[kept] = candidates[j];
+                }
+                kept++;
+            } else {
+                DEBUG_PRINT2 << "...Skip equivalent leaves: " << candidates[j].leaves << ", i: " << candidates[j].i << "\n";
+            }
+        }
+        candidates.resize(kept);
+    }
+
+    // Keep the candidates that should_skip_expression lets through, trying
+    // the native Canonicalizer first if it is enabled
+    static void drop_skipped(std::vector<Candidate<T>> &candidates,
+                             const std::vector<std::string> &x_names,
+                             const std::vector<std::string> &y_names,
+                             const std::vector<std::string> &constant_names) {
+        Canonicalizer canonicalizer;
+        bool native = native_canonicalizer_enabled();
+        size_t kept = 0;
+        for (size_t j = 0; j < candidates.size(); ++j) {
+            Candidate<T> &c = candidates[j];
+            // Most of the boring ones are caught without building the Expr
+            if (native && canonicalizer.is_boring(c.program)) {
+                DEBUG_PRINT2 << "...Skip boring leaves: " << c.leaves << ", i: " << c.i << "\n";
+                continue;
+            }
+            c.expr = c.e.get_expr();
+            c.uses_x = c.e.uses_x;
+            c.uses_y = c.e.uses_y;
+            c.row = c.e.uses_x.mask() | c.e.uses_y.mask();
+            if (should_skip_expression(0, c.expr, c.e.fail, c.uses_x, c.uses_y,
+                                       x_names, y_names, constant_names)) {
+                continue;
+            }
+            if (kept != j) {
+                candidates[kept] = c;
+            }
+            kept++;
+        }
+        candidates.resize(kept);
+    }
+
+    // Fill the pools with the candidates in [i_start, i_end]
+    void build(const Enumerator &enumerator, uint64_t i_start, uint64_t i_end,
+               const std::vector<std::string> &x_names,
+               const std::vector<std::string> &y_names,
+               const std::vector<std::string> &constant_names) {
+        HashSet<Fingerprint> fingerprints;
+        for (size_t p = 0; p < pools.size(); ++p) {
+            pools[p] = generate(enumerator, leaves_start + p, i_start, i_end);
+            drop_skipped(pools[p], x_names, y_names, constant_names);
+            drop_equivalent(pools[p], fingerprints);
+        }
+        index_rows();
+        std::unordered_map<uint64_t, uint32_t> ids;
+        index_relabelings(ids);
+        for (const auto &pool : pools) {
+            relabel(pool, 0, pool.size(), ids);
+        }
+    }
+
+    // Same, spreading the work over the workers of 'workers'. Picking the
+    // representative of each class is done in index order as the chunks are
+    // emitted, so the pools come out the same as with the serial build.
+    void build(WorkStealingPool &workers, const Enumerator &enumerator,
+               uint64_t i_start, uint64_t i_end,
+               const std::vector<std::string> &x_names,
+               const std::vector<std::string> &y_names,
+               const std::vector<std::string> &constant_names) {
+        struct Chunk {
+            uint64_t leaves, i_start, i_end;
+            std::vector<Candidate<T>> candidates;
+        };
+        std::vector<Chunk> chunks;
+        for (size_t p = 0; p < pools.size(); ++p) {
+            pools[p].clear();
+            for (uint64_t i = i_start; i <= i_end; i += kChunk) {
+                chunks.push_back({leaves_start + p, i, std::min(i + kChunk - 1, i_end), {}});
+            }
+        }
+
+        HashSet<Fingerprint> fingerprints;
+        workers.run(chunks.size(),
+            [&](int, size_t t) {
+                Chunk &c = chunks[t];
+                c.candidates = generate(enumerator, c.leaves, c.i_start, c.i_end);
+                drop_skipped(c.candidates, x_names, y_names, constant_names);
+            },
+            [&](size_t t) {
+                // Chunks are emitted in order, so the pools stay sorted by index
+                Chunk &c = chunks[t];
+                drop_equivalent(c.candidates, fingerprints);
+                std::vector<Candidate<T>> &pool = pools[c.leaves - leaves_start];
+                pool.insert(pool.end(), c.candidates.begin(), c.candidates.end());
+                std::vector<Candidate<T>>().swap(c.candidates);
+            });
+        index_rows();
+
+        std::unordered_map<uint64_t, uint32_t> ids;
+        index_relabelings(ids);
+        std::vector<std::pair<size_t, size_t>> ranges;
+        for (size_t p = 0; p < pools.size(); ++p) {
+            for (size_t k = 0; k < pools[p].size(); k += kChunk) {
+                ranges.push_back(std::make_pair(p, k));
+            }
+        }
+        workers.run(ranges.size(),
+            [&](int, size_t t) {
+                const std::vector<Candidate<T>> &pool = pools[ranges[t].first];
+                size_t begin = ranges[t].second;
+                relabel(pool, begin, std::min(begin + kChunk, pool.size()), ids);
+            },
+            [&](size_t) {});
+    }
+
+    const std::vector<Candidate<T>> &operator[](uint64_t leaves) const {
+        ASSERT((leaves >= leaves_start) && (leaves - leaves_start < pools.size()),
+               "Leaves out of range of the candidate pool\n");
+        return pools[leaves - leaves_start];
+    }
+
+    // Whether the tuple is the smallest, by the ids of its elements, of its
+    // relabelings (permuting its slots and renaming x_j, y_j to match) that
+    // are in the tile. The others compute the same operator, so only this one
+    // needs to be proven; it is swept too, since the tuple filters do not
+    // depend on the slot order.
+    bool is_canonical(const std::vector<const Candidate<T> *> &eqs) const {
+        size_t size = eqs.size();
+        uint32_t ids[MAX_TUPLE_SIZE];
+        ASSERT(size <= MAX_TUPLE_SIZE, "Tuple is too large to relabel\n");
+        for (size_t p = 1; p < permutations.size(); ++p) {
+            const std::vector<uint8_t> &slots = permutations[p];
+            bool complete = true;
+            for (size_t i = 0; i < size; ++i) {
+                ids[slots[i]] = relabeled[(size_t)eqs[i]->id * permutations.size() + p];
+                complete = complete && (ids[slots[i]] != kNone);
+            }
+            if (!complete) {
+                continue;
+            }
+            for (size_t i = 0; i < size; ++i) {
+                if (ids[i] != eqs[i]->id) {
+                    if (ids[i] < eqs[i]->id) {
+                        return false;
+                    }
+                    break;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Positions, in index order, of the candidates in the pool of the given
+    // leaf count whose dependency row is 'row'
+    const std::vector<size_t> &with_row(uint64_t leaves, uint32_t row) const {
+        static const std::vector<size_t> none;
+        const std::vector<std::vector<size_t>> &by_row = rows[leaves - leaves_start];
+        return (row < by_row.size()) ? by_row[row] : none;
+    }
+
+    // Positions [first, second) of the candidates in the pool of the given
+    // leaf count with an index in [i_start, i_end]
+    std::pair<size_t, size_t> range(uint64_t leaves, uint64_t i_start, uint64_t i_end) const {
+        const std::vector<Candidate<T>> &pool = (*this)[leaves];
+        auto before = [](const Candidate<T> &c, uint64_t i) { return c.i < i; };
+        size_t first = std::lower_bound(pool.begin(), pool.end(), i_start, before) - pool.begin();
+        size_t last = std::lower_bound(pool.begin(), pool.end(), i_end + 1, before) - pool.begin();
+        return std::make_pair(first, std::max(first, last));
+    }
+
+    // Total number of candidates over all leaf counts
+    size_t size() const {
+        size_t n = 0;
+        for (const auto &pool : pools) {
+            n += pool.size();
+        }
+        return n;
+    }
+};
+
+template<class T>
+const uint32_t CandidatePool<T>::kNone;
+
+#endif
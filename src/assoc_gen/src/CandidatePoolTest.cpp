@@ -0,0 +1,213 @@
+#include "Halide.h"
+#include "Bytecode.h"
+#include "CandidatePool.h"
+#include "CommonClass.h"
+#include "Enumerator.h"
+#include "Fingerprint.h"
+#include "WorkStealingPool.h"
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+using std::map;
+using std::string;
+using std::vector;
+using Halide::Internal::Variable;
+
+/**
+ * Check that the candidate pools keep every function that has a tree passing
+ * the filters, and represent it by the first such tree. In particular a
+ * fingerprint class whose first tree should_skip_expression rejects (say
+ * k0 + x0*y0, which simplify reorders) must still be represented by a later
+ * tree of the class. Both the serial and the parallel build are checked
+ * against filtering every tree on its own, over all the single-element trees
+ * of 2 to 4 leaves. Returns non-zero on failure. Build it like the
+ * generators, e.g.
+ *   g++ -std=c++11 -O3 CandidatePoolTest.cpp Utilities.cpp AssociativityProver.cpp HalideToZ3.cpp -I<halide>/include -lHalide -lz3 -lpthread
+ */
+
+const uint64_t MIN_LEAVES = 2;
+const uint64_t MAX_LEAVES = 4;
+
+Halide::Type kType = Halide::UInt(32);
+vector<string> kXNames = {"x0"};
+vector<string> kYNames = {"y0"};
+vector<string> kConstantNames = {"k0"};
+
+enum Node : uint8_t {
+    X0 = 0,
+    Y0,
+    K0,
+    Add,
+    Sub,
+    Mul,
+    Min,
+    Max,
+    LastNode,
+};
+
+// Every ordering of the leaves, so that a class has several trees
+int leaf_choices(int, int, uint8_t *choices) {
+    choices[0] = X0;
+    choices[1] = Y0;
+    choices[2] = K0;
+    return 3;
+}
+
+class SingleExpr : public Expr {
+public:
+    SingleExpr() : Expr(1) {}
+
+    void compile_term(Program &p, int &cursor) const {
+        Node node = (Node)nodes[cursor++];
+        switch(node) {
+        case X0:
+            p.push(OpCode::LoadX, 0);
+            break;
+        case Y0:
+            p.push(OpCode::LoadY, 0);
+            break;
+        case K0:
+            p.push(OpCode::LoadK);
+            break;
+        default:
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push((OpCode)(node - Add + (int)OpCode::Add));
+            break;
+        }
+    }
+
+    Program compile() const {
+        Program p;
+        int cursor = 0;
+        compile_term(p, cursor);
+        return p;
+    }
+
+    void create(const Enumerator &enumerator, uint64_t leaves, uint64_t index) {
+        uint8_t codes[MAX_NODES];
+        size = enumerator.unrank(leaves, index, codes);
+        for (int j = 0; j < size; ++j) {
+            nodes[j] = (Node)codes[j];
+            if (nodes[j] == X0) {
+                uses_x[0] = true;
+            } else if (nodes[j] == Y0) {
+                uses_y[0] = true;
+            }
+        }
+    }
+
+    Halide::Expr get_expr_term(int &cursor) const {
+        Node node = (Node)nodes[cursor++];
+        switch(node) {
+        case X0:
+            return Variable::make(kType, kXNames[0]);
+        case Y0:
+            return Variable::make(kType, kYNames[0]);
+        case K0:
+            return Variable::make(kType, kConstantNames[0]);
+        default:
+            break;
+        }
+        Halide::Expr lhs = get_expr_term(cursor);
+        Halide::Expr rhs = get_expr_term(cursor);
+        switch(node) {
+        case Add:
+            return lhs + rhs;
+        case Sub:
+            return lhs - rhs;
+        case Mul:
+            return lhs * rhs;
+        case Min:
+            return Halide::min(lhs, rhs);
+        default:
+            return Halide::max(lhs, rhs);
+        }
+    }
+
+    Halide::Expr get_expr() const {
+        int cursor = 0;
+        return get_expr_term(cursor);
+    }
+};
+
+typedef CandidatePool<SingleExpr> Pool;
+
+// Whether the pools hold exactly the first tree, by leaf count and index, of
+// each function that has a tree passing the filters
+bool check_pool(const Pool &pool, const map<uint64_t, Candidate<SingleExpr>> &expected, const char *build) {
+    size_t size = 0;
+    for (uint64_t leaves = MIN_LEAVES; leaves <= MAX_LEAVES; ++leaves) {
+        for (const Candidate<SingleExpr> &c : pool[leaves]) {
+            auto iter = expected.find(c.fingerprint.value);
+            if ((iter == expected.end()) || (iter->second.leaves != c.leaves) || (iter->second.i != c.i)) {
+                std::cerr << build << " build keeps leaves: " << c.leaves << ", i: " << c.i
+                          << ", which is not the first tree of its class to pass the filters\n";
+                return false;
+            }
+            size++;
+        }
+    }
+    if (size != expected.size()) {
+        std::cerr << build << " build keeps " << size << " functions out of " << expected.size() << "\n";
+        return false;
+    }
+    return true;
+}
+
+int main() {
+    const Enumerator enumerator({{Add, true}, {Sub, false}, {Mul, true}, {Min, true}, {Max, true}},
+                                leaf_choices, MAX_LEAVES);
+    uint64_t i_end = 0;
+    for (uint64_t leaves = MIN_LEAVES; leaves <= MAX_LEAVES; ++leaves) {
+        i_end = std::max(i_end, enumerator.count(leaves) - 1);
+    }
+
+    // Filter every tree, then take the first survivor of each class
+    map<uint64_t, Candidate<SingleExpr>> expected;
+    map<uint64_t, bool> first_dropped;
+    for (uint64_t leaves = MIN_LEAVES; leaves <= MAX_LEAVES; ++leaves) {
+        vector<Candidate<SingleExpr>> all = Pool::generate(enumerator, leaves, 0, i_end);
+        for (const Candidate<SingleExpr> &c : all) {
+            first_dropped.insert(std::make_pair(c.fingerprint.value, true));
+        }
+        Pool::drop_skipped(all, kXNames, kYNames, kConstantNames);
+        for (const Candidate<SingleExpr> &c : all) {
+            expected.insert(std::make_pair(c.fingerprint.value, c));
+        }
+    }
+    // Classes whose first tree is filtered out but a later one is not
+    int rescued = 0;
+    for (uint64_t leaves = MIN_LEAVES; leaves <= MAX_LEAVES; ++leaves) {
+        for (const Candidate<SingleExpr> &c : Pool::generate(enumerator, leaves, 0, i_end)) {
+            auto iter = first_dropped.find(c.fingerprint.value);
+            if (iter->second) {
+                auto kept = expected.find(c.fingerprint.value);
+                rescued += (kept != expected.end()) && ((kept->second.leaves != c.leaves) || (kept->second.i != c.i));
+                iter->second = false;
+            }
+        }
+    }
+    std::cout << "Functions: " << first_dropped.size() << ", passing the filters: " << expected.size()
+              << ", of which with a filtered first tree: " << rescued << "\n";
+    if (rescued == 0) {
+        std::cerr << "No class has a filtered first tree; the test checks nothing\n";
+        return -1;
+    }
+
+    Pool serial(MIN_LEAVES, MAX_LEAVES);
+    serial.build(enumerator, 0, i_end, kXNames, kYNames, kConstantNames);
+    WorkStealingPool workers(std::max(2u, std::thread::hardware_concurrency()));
+    Pool parallel(MIN_LEAVES, MAX_LEAVES);
+    parallel.build(workers, enumerator, 0, i_end, kXNames, kYNames, kConstantNames);
+    if (!check_pool(serial, expected, "Serial") || !check_pool(parallel, expected, "Parallel")) {
+        return -1;
+    }
+    std::cout << "OK\n";
+    return 0;
+}
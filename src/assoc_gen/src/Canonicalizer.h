@@ -0,0 +1,164 @@
+#ifndef CANONICALIZER_H
+#define CANONICALIZER_H
+
+/** \file
+ *
+ * Native pre-filter for is_expr_boring, on the compiled generator programs.
+ * is_expr_boring rejects a candidate if simplify and solve_expression (for
+ * every variable, k0 first and x0 last) change it, which makes converting
+ * candidates to Halide and running them the bulk of the filtering cost.
+ * Most rejections come from a handful of rewrites whose outcome is known
+ * without running them:
+ *  - ordering: solving for a variable moves it into the left operand of a
+ *    commutative op (+, *, min, max) if only the right one uses it, so after
+ *    the last solve the left operand holds the first variable, in x-left,
+ *    y-next, constants-right order (x0, x1, ..., y0, y1, ..., k0), that only
+ *    one of them uses;
+ *  - idempotence and absorption: min(a, a), min(a, max(a, b)),
+ *    min(min(a, b), a) and the like for max, in either operand order;
+ *  - cancellation: a - a, a + a, (a + b) - a, (a + b) - b, a - (a + b),
+ *    a - (b + a), (a - b) - a, a + (b - a), (a - b) + b.
+ * The programs these flag should be rejected by the Halide path too; the
+ * ones that pass still go through it, so it keeps the final say. Until
+ * CanonicalizerTest has shown no program it flags that is_expr_boring keeps,
+ * the generators only use it if the NATIVE_CANONICALIZER environment
+ * variable is set to 1.
+ */
+
+#include "Bytecode.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+class Canonicalizer {
+    // A node of the program's tree. Its instructions are code[begin, end),
+    // the last one being its own.
+    struct Node {
+        OpCode op;
+        int a, b;       // Operands, -1 for leaves
+        int begin, end;
+        uint32_t vars;  // Variables used, one bit each in x-y-k order
+    };
+
+    const Program *program;
+    Node nodes[Program::kMaxSize];
+
+    static uint32_t var_bit(const Instr &in) {
+        switch (in.op) {
+        case OpCode::LoadX:
+            return 1u << in.index;
+        case OpCode::LoadY:
+            return 1u << (MAX_TUPLE_SIZE + in.index);
+        default:
+            return 1u << (2 * MAX_TUPLE_SIZE);
+        }
+    }
+
+    bool is(int n, OpCode op) const {
+        return (n >= 0) && (nodes[n].a >= 0) && (nodes[n].op == op);
+    }
+
+    // Whether the nodes are the same subtree
+    bool same(int m, int n) const {
+        const Node &a = nodes[m], &b = nodes[n];
+        if ((a.vars != b.vars) || (a.end - a.begin != b.end - b.begin)) {
+            return false;
+        }
+        for (int i = 0; i < a.end - a.begin; ++i) {
+            const Instr &x = program->code[a.begin + i], &y = program->code[b.begin + i];
+            if ((x.op != y.op) || (x.index != y.index)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Whether 'n' is one of the operands of the binary node 'of'
+    bool operand(int n, int of) const {
+        return same(n, nodes[of].a) || same(n, nodes[of].b);
+    }
+
+    // Whether the Halide path rewrites the node
+    bool rewritten(int n) const {
+        const Node &node = nodes[n];
+        int a = node.a, b = node.b;
+        switch (node.op) {
+        case OpCode::Add:
+        case OpCode::Mul:
+        case OpCode::Min:
+        case OpCode::Max: {
+            uint32_t diff = nodes[a].vars ^ nodes[b].vars;
+            if ((diff & (~diff + 1)) & nodes[b].vars) {
+                return true;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+
+        switch (node.op) {
+        case OpCode::Add:
+            return same(a, b) || (is(b, OpCode::Sub) && same(nodes[b].b, a)) ||
+                   (is(a, OpCode::Sub) && same(nodes[a].b, b));
+        case OpCode::Sub:
+            return same(a, b) || (is(a, OpCode::Add) && operand(b, a)) ||
+                   (is(b, OpCode::Add) && operand(a, b)) ||
+                   (is(a, OpCode::Sub) && same(nodes[a].a, b));
+        case OpCode::Min:
+        case OpCode::Max: {
+            OpCode other = (node.op == OpCode::Min) ? OpCode::Max : OpCode::Min;
+            return same(a, b) ||
+                   ((is(a, node.op) || is(a, other)) && operand(b, a)) ||
+                   ((is(b, node.op) || is(b, other)) && operand(a, b));
+        }
+        default:
+            return false;
+        }
+    }
+
+public:
+    Canonicalizer() : program(nullptr) {}
+
+    // Whether is_expr_boring would reject the program
+    bool is_boring(const Program &p) {
+        program = &p;
+        int stack[Program::kMaxSize];
+        int sp = 0;
+        for (int pc = 0; pc < p.size; ++pc) {
+            Node &node = nodes[pc];
+            node.op = p.code[pc].op;
+            node.end = pc + 1;
+            switch (node.op) {
+            case OpCode::LoadX:
+            case OpCode::LoadY:
+            case OpCode::LoadK:
+                node.a = node.b = -1;
+                node.begin = pc;
+                node.vars = var_bit(p.code[pc]);
+                break;
+            default:
+                node.b = stack[--sp];
+                node.a = stack[--sp];
+                node.begin = nodes[node.a].begin;
+                node.vars = nodes[node.a].vars | nodes[node.b].vars;
+                if (rewritten(pc)) {
+                    return true;
+                }
+                break;
+            }
+            stack[sp++] = pc;
+        }
+        return false;
+    }
+};
+
+// Whether the generators filter with the Canonicalizer (see above)
+inline bool native_canonicalizer_enabled() {
+    static const bool enabled = (getenv("NATIVE_CANONICALIZER") != nullptr) &&
+                                (strcmp(getenv("NATIVE_CANONICALIZER"), "1") == 0);
+    return enabled;
+}
+
+#endif
@@ -0,0 +1,188 @@
+#include "Halide.h"
+#include "Bytecode.h"
+#include "Canonicalizer.h"
+#include "CommonClass.h"
+#include "Utilities.h"
+#include "benchmark.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+using namespace Halide::Internal;
+using std::string;
+using std::vector;
+
+/**
+ * Check the Canonicalizer against is_expr_boring and measure what it saves.
+ * Every candidate the Canonicalizer rejects must be rejected by
+ * is_expr_boring too, or the generators would lose operators; the benchmark
+ * fails if one is not. Then it times filtering the candidates with
+ * is_expr_boring alone, and with the Canonicalizer in front of it the way
+ * CandidatePool does. Candidates are random trees over the TupleGenerator
+ * alphabet. Build it with optimizations, e.g.
+ *   g++ -std=c++11 -O3 CanonicalizerBenchmark.cpp Utilities.cpp AssociativityProver.cpp HalideToZ3.cpp -I<halide>/include -I../../benchmarks -lHalide -lz3 -lpthread
+ */
+
+enum Node : uint8_t {
+    X0 = 0,
+    Y0,
+    X1,
+    Y1,
+    K0,
+    Add,
+    Sub,
+    Mul,
+    Min,
+    Max,
+    LastNode,
+};
+
+const int NUM_CANDIDATES = 2000;
+
+Halide::Type kType = Halide::UInt(32);
+vector<string> kXNames = {"x0", "x1"};
+vector<string> kYNames = {"y0", "y1"};
+vector<string> kConstantNames = {"k0"};
+
+class TreeExpr : public Expr {
+public:
+    TreeExpr() : Expr(2) {}
+
+    void compile_term(Program &p, int &cursor) const {
+        Node node = nodes[cursor++];
+        switch(node) {
+        case X0:
+        case X1:
+            p.push(OpCode::LoadX, node / 2);
+            break;
+        case Y0:
+        case Y1:
+            p.push(OpCode::LoadY, node / 2);
+            break;
+        case K0:
+            p.push(OpCode::LoadK);
+            break;
+        default:
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push((OpCode)(node - Add + (int)OpCode::Add));
+            break;
+        }
+    }
+
+    Program compile() const {
+        Program p;
+        int cursor = 0;
+        compile_term(p, cursor);
+        return p;
+    }
+
+    Halide::Expr get_expr_term(int &cursor) const {
+        Node node = nodes[cursor++];
+        switch(node) {
+        case X0:
+        case X1:
+            return Variable::make(kType, kXNames[node / 2]);
+        case Y0:
+        case Y1:
+            return Variable::make(kType, kYNames[node / 2]);
+        case K0:
+            return Variable::make(kType, kConstantNames[0]);
+        default:
+            break;
+        }
+        Halide::Expr lhs = get_expr_term(cursor);
+        Halide::Expr rhs = get_expr_term(cursor);
+        switch(node) {
+        case Add:
+            return lhs + rhs;
+        case Sub:
+            return lhs - rhs;
+        case Mul:
+            return lhs * rhs;
+        case Min:
+            return Halide::min(lhs, rhs);
+        default:
+            return Halide::max(lhs, rhs);
+        }
+    }
+
+    Halide::Expr get_expr() const {
+        int cursor = 0;
+        return get_expr_term(cursor);
+    }
+
+    // Random tree with the given number of leaves
+    void create_random(int leaves) {
+        assert(size < 64);
+        assert(leaves > 0);
+        std::mt19937 &engine = random_engine();
+        if (leaves == 1) {
+            nodes[size++] = (Node)(engine() % (K0 + 1));
+        } else {
+            nodes[size++] = (Node)(Add + engine() % (LastNode - Add));
+            int left = 1 + engine() % (leaves - 1);
+            create_random(left);
+            create_random(leaves - left);
+        }
+    }
+};
+
+bool boring_halide(const TreeExpr &e) {
+    Halide::Expr simplified;
+    return is_expr_boring(e.get_expr(), simplified, kXNames, kYNames, kConstantNames);
+}
+
+bool boring_hybrid(Canonicalizer &canonicalizer, const TreeExpr &e, const Program &p) {
+    return canonicalizer.is_boring(p) || boring_halide(e);
+}
+
+int main(int argc, char **argv) {
+    int max_leaves = (argc > 1) ? atoi(argv[1]) : 7;
+
+    Canonicalizer canonicalizer;
+    for (int leaves = 2; leaves <= max_leaves; ++leaves) {
+        seed_random_value(leaves);
+        vector<TreeExpr> candidates(NUM_CANDIDATES);
+        vector<Program> programs(NUM_CANDIDATES);
+        for (size_t c = 0; c < candidates.size(); ++c) {
+            candidates[c].create_random(leaves);
+            programs[c] = candidates[c].compile();
+        }
+
+        int native = 0, halide = 0;
+        for (size_t c = 0; c < candidates.size(); ++c) {
+            bool a = canonicalizer.is_boring(programs[c]);
+            bool b = boring_halide(candidates[c]);
+            if (a && !b) {
+                std::cerr << "The Canonicalizer rejects " << candidates[c].get_expr()
+                          << ", which is_expr_boring keeps\n";
+                return -1;
+            }
+            native += a;
+            halide += b;
+        }
+
+        volatile int sink = 0;
+        double t_halide = benchmark(1, 1, [&]() {
+            for (const TreeExpr &e : candidates) {
+                sink += boring_halide(e);
+            }
+        });
+        double t_hybrid = benchmark(1, 1, [&]() {
+            for (size_t c = 0; c < candidates.size(); ++c) {
+                sink += boring_hybrid(canonicalizer, candidates[c], programs[c]);
+            }
+        });
+
+        std::cout << "Leaves: " << leaves << " (" << halide << " boring, " << native
+                  << " caught natively)"
+                  << "\tis_expr_boring: " << 1e6 * t_halide / NUM_CANDIDATES << " us/candidate"
+                  << "\twith Canonicalizer: " << 1e6 * t_hybrid / NUM_CANDIDATES << " us/candidate ("
+                  << t_halide / t_hybrid << "x)\n";
+    }
+    return 0;
+}
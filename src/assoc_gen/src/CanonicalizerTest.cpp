@@ -0,0 +1,206 @@
+#include "Halide.h"
+#include "Bytecode.h"
+#include "Canonicalizer.h"
+#include "CommonClass.h"
+#include "Enumerator.h"
+#include "Utilities.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+using namespace Halide::Internal;
+using std::string;
+using std::vector;
+
+/**
+ * Regression test of the Canonicalizer against is_expr_boring: every program
+ * it flags must be rejected by is_expr_boring too, or the generators would
+ * lose operators when it is enabled (see native_canonicalizer_enabled). The
+ * corpus is every tree over the TupleGenerator alphabet of up to
+ * EXHAUSTIVE_LEAVES leaves, in every operand order, and NUM_RANDOM random
+ * trees for each larger leaf count up to MAX_LEAVES, from fixed seeds. It
+ * prints the programs the two disagree on, and returns non-zero if there are
+ * any. Build it like the generators, e.g.
+ *   g++ -std=c++11 -O3 CanonicalizerTest.cpp Utilities.cpp AssociativityProver.cpp HalideToZ3.cpp -I<halide>/include -lHalide -lz3 -lpthread
+ */
+
+enum Node : uint8_t {
+    X0 = 0,
+    Y0,
+    X1,
+    Y1,
+    K0,
+    Add,
+    Sub,
+    Mul,
+    Min,
+    Max,
+    LastNode,
+};
+
+const uint64_t EXHAUSTIVE_LEAVES = 4;
+const uint64_t MAX_LEAVES = 7;
+const int NUM_RANDOM = 20000;
+
+Halide::Type kType = Halide::UInt(32);
+vector<string> kXNames = {"x0", "x1"};
+vector<string> kYNames = {"y0", "y1"};
+vector<string> kConstantNames = {"k0"};
+
+// Any leaf anywhere, so that the corpus holds the trees the generators prune
+int leaf_choices(int, int, uint8_t *choices) {
+    int n = 0;
+    for (int leaf = X0; leaf <= K0; ++leaf) {
+        choices[n++] = leaf;
+    }
+    return n;
+}
+
+class TreeExpr : public Expr {
+public:
+    TreeExpr() : Expr(2) {}
+
+    void compile_term(Program &p, int &cursor) const {
+        Node node = nodes[cursor++];
+        switch(node) {
+        case X0:
+        case X1:
+            p.push(OpCode::LoadX, node / 2);
+            break;
+        case Y0:
+        case Y1:
+            p.push(OpCode::LoadY, node / 2);
+            break;
+        case K0:
+            p.push(OpCode::LoadK);
+            break;
+        default:
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push((OpCode)(node - Add + (int)OpCode::Add));
+            break;
+        }
+    }
+
+    Program compile() const {
+        Program p;
+        int cursor = 0;
+        compile_term(p, cursor);
+        return p;
+    }
+
+    Halide::Expr get_expr_term(int &cursor) const {
+        Node node = nodes[cursor++];
+        switch(node) {
+        case X0:
+        case X1:
+            return Variable::make(kType, kXNames[node / 2]);
+        case Y0:
+        case Y1:
+            return Variable::make(kType, kYNames[node / 2]);
+        case K0:
+            return Variable::make(kType, kConstantNames[0]);
+        default:
+            break;
+        }
+        Halide::Expr lhs = get_expr_term(cursor);
+        Halide::Expr rhs = get_expr_term(cursor);
+        switch(node) {
+        case Add:
+            return lhs + rhs;
+        case Sub:
+            return lhs - rhs;
+        case Mul:
+            return lhs * rhs;
+        case Min:
+            return Halide::min(lhs, rhs);
+        default:
+            return Halide::max(lhs, rhs);
+        }
+    }
+
+    Halide::Expr get_expr() const {
+        int cursor = 0;
+        return get_expr_term(cursor);
+    }
+
+    void create(const Enumerator &enumerator, uint64_t leaves, uint64_t index) {
+        uint8_t codes[MAX_NODES];
+        size = enumerator.unrank(leaves, index, codes);
+        for (int j = 0; j < size; ++j) {
+            nodes[j] = (Node)codes[j];
+        }
+    }
+
+    // Random tree with the given number of leaves
+    void create_random(int leaves) {
+        assert(size < 64);
+        assert(leaves > 0);
+        std::mt19937 &engine = random_engine();
+        if (leaves == 1) {
+            nodes[size++] = (Node)(engine() % (K0 + 1));
+        } else {
+            nodes[size++] = (Node)(Add + engine() % (LastNode - Add));
+            int left = 1 + engine() % (leaves - 1);
+            create_random(left);
+            create_random(leaves - left);
+        }
+    }
+};
+
+struct Counts {
+    int programs = 0, native = 0, halide = 0, mismatches = 0;
+};
+
+void check(Canonicalizer &canonicalizer, const TreeExpr &e, Counts &counts) {
+    Program p = e.compile();
+    Halide::Expr simplified;
+    bool native = canonicalizer.is_boring(p);
+    bool halide = is_expr_boring(e.get_expr(), simplified, kXNames, kYNames, kConstantNames);
+    counts.programs++;
+    counts.native += native;
+    counts.halide += halide;
+    if (native && !halide) {
+        if (counts.mismatches < 20) {
+            std::cerr << "The Canonicalizer rejects " << e.get_expr() << ", which is_expr_boring keeps\n";
+        }
+        counts.mismatches++;
+    }
+}
+
+int main() {
+    // No operator is marked commutative, so that every operand order is there
+    const Enumerator enumerator({{Add, false}, {Sub, false}, {Mul, false}, {Min, false}, {Max, false}},
+                                leaf_choices, EXHAUSTIVE_LEAVES);
+    Canonicalizer canonicalizer;
+    int mismatches = 0;
+    for (uint64_t leaves = 2; leaves <= MAX_LEAVES; ++leaves) {
+        Counts counts;
+        if (leaves <= EXHAUSTIVE_LEAVES) {
+            for (uint64_t i = 0; i < enumerator.count(leaves); ++i) {
+                TreeExpr e;
+                e.create(enumerator, leaves, i);
+                check(canonicalizer, e, counts);
+            }
+        } else {
+            seed_random_value(leaves);
+            for (int i = 0; i < NUM_RANDOM; ++i) {
+                TreeExpr e;
+                e.create_random(leaves);
+                check(canonicalizer, e, counts);
+            }
+        }
+        std::cout << "Leaves: " << leaves << "\tprograms: " << counts.programs << "\tboring: " << counts.halide
+                  << "\tcaught natively: " << counts.native << "\tmismatches: " << counts.mismatches << "\n";
+        mismatches += counts.mismatches;
+    }
+    if (mismatches > 0) {
+        std::cerr << mismatches << " programs rejected by the Canonicalizer only\n";
+        return -1;
+    }
+    std::cout << "OK\n";
+    return 0;
+}
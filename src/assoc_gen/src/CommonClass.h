@@ -9,6 +9,10 @@
 #include "Halide.h"
 #include "z3++.h"
 
+#include <cassert>
+#include <cstring>
+#include <random>
+#include <type_traits>
 #include <vector>
 #include <boost/icl/interval_set.hpp>
 
@@ -17,8 +21,20 @@ typedef IntervalSet::interval_type IntervalVal;
 
 typedef int Value;
 
+// Each thread draws from its own generator, so the parallel sweeps neither
+// race on rand() nor make their trials depend on thread scheduling.
+inline std::mt19937 &random_engine() {
+    thread_local std::mt19937 engine;
+    return engine;
+}
+
+inline void seed_random_value(uint32_t seed) {
+    random_engine().seed(seed);
+}
+
 inline Value random_value() {
-    return (((rand() << 16) ^ (rand() << 8) ^ rand()) & 0x0ffffff) - 0x07fffff;
+    std::mt19937 &engine = random_engine();
+    return Value(((engine() << 16) ^ (engine() << 8) ^ engine()) & 0x0ffffff) - 0x07fffff;
 }
 
 typedef enum {
@@ -55,28 +71,92 @@ struct Point {
     uint64_t i;
 };
 
-enum Node : long;
+enum Node : uint8_t;
+
+const int MAX_NODES = 64;
+
+// The tuple slots (x0, x1, ... or y0, y1, ...) an expression refers to,
+// packed into a bitmask. Indexing works like the vector<bool> it replaces.
+class UsesMask {
+    uint8_t bits;
+    uint8_t count;
+
+public:
+    class Reference {
+        UsesMask &mask;
+        int index;
+
+    public:
+        Reference(UsesMask &mask, int index) : mask(mask), index(index) {}
+        operator bool() const { return (mask.bits >> index) & 1; }
+        Reference &operator=(bool b) {
+            mask.bits = b ? (mask.bits | (1 << index)) : (mask.bits & ~(1 << index));
+            return *this;
+        }
+    };
+
+    UsesMask(int count = 0) : bits(0), count(count) { assert(count <= 8); }
+
+    bool operator[](int i) const { return (bits >> i) & 1; }
+    Reference operator[](int i) { return Reference(*this, i); }
+
+    uint8_t mask() const { return bits; }
+    int size() const { return count; }
+
+    operator std::vector<bool>() const {
+        std::vector<bool> v(count);
+        for (int i = 0; i < count; ++i) {
+            v[i] = (*this)[i];
+        }
+        return v;
+    }
+};
 
+// Candidate expression as a prefix list of nodes, stored inline so that
+// copying one is a plain memcpy.
 class Expr {
 public:
-	std::vector<Node> nodes;
-    int size;
+    Node nodes[MAX_NODES];
+    uint8_t size;
     bool fail;
-    std::vector<bool> uses_x;
-    std::vector<bool> uses_y;
+    UsesMask uses_x;
+    UsesMask uses_y;
 
     Expr() : Expr(1) {}
-    Expr(int tuple_size) : nodes(64), size(0), fail(false), uses_x(tuple_size, false), uses_y(tuple_size, false) {}
+    Expr(int tuple_size) : size(0), fail(false), uses_x(tuple_size), uses_y(tuple_size) {
+        memset(nodes, 0, sizeof(nodes));
+    }
+
+    // Nodes past 'size' are always zero, so comparing the whole array orders
+    // the same way as comparing the used prefix. Node 0 is indistinguishable
+    // from the padding, hence the explicit size check.
+    bool operator==(const Expr &rhs) const {
+        return (size == rhs.size) && (memcmp(rhs.nodes, nodes, sizeof(nodes)) == 0);
+    }
+    bool operator<(const Expr &rhs) const {
+        int c = memcmp(rhs.nodes, nodes, sizeof(nodes));
+        return (c != 0) ? (c < 0) : (size < rhs.size);
+    }
 
-    bool operator==(const Expr &rhs) const { return rhs.nodes == nodes; }
-    bool operator<(const Expr &rhs) const { return rhs.nodes < nodes; }
+    // FNV-1a over the used nodes
+    uint64_t hash() const {
+        uint64_t h = 14695981039346656037ULL;
+        for (int i = 0; i < size; ++i) {
+            h = (h ^ (uint8_t)nodes[i]) * 1099511628211ULL;
+        }
+        return h;
+    }
 };
 
+static_assert(std::is_trivially_copyable<Expr>::value, "Expr should be trivially copyable");
+
 template<class T>
 class AssociativeTuple {
 public:
     std::vector<T> exprs;
 
+    AssociativeTuple() {}
+
     AssociativeTuple(const T &e0, const T &e1) {
         exprs.push_back(e0);
         exprs.push_back(e1);
@@ -118,9 +198,19 @@ public:
             if (exprs[i] < rhs.exprs[i]) {
                 return true;
             }
-            return false;
+            if (rhs.exprs[i] < exprs[i]) {
+                return false;
+            }
         }
-        return true;
+        return false;
+    }
+
+    uint64_t hash() const {
+        uint64_t h = exprs.size();
+        for (size_t i = 0; i < exprs.size(); ++i) {
+            h = (h ^ exprs[i].hash()) * 1099511628211ULL;
+        }
+        return h;
     }
 };
 
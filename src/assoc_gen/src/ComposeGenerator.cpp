@@ -0,0 +1,477 @@
+#include "Halide.h"
+#include "Error.h"
+#include "Utilities.h"
+#include "AssociativityProver.h"
+#include "ProverWorkers.h"
+#include "Enumerator.h"
+#include "DependencyGraph.h"
+#include "SimdEval.h"
+
+#include <chrono>
+#include <iostream>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+using std::map;
+using std::string;
+using std::vector;
+using Halide::Internal::Variable;
+
+/**
+ * Tuple generator that composes proven operators instead of searching the
+ * trees of every element from scratch. The structured tuple operators
+ * (argmin/argmax, complex multiplication, affine composition, ...) are
+ * single-element operators coupled across the slots by a few terms, but
+ * they sit far too deep in the tree space of ThreeGenerator and
+ * FourGenerator to ever be reached. Here the single-element operators with
+ * up to 'max base leaves' leaves are enumerated and proven first (the
+ * proof cache answers for the ones the single-element generators already
+ * settled), and each slot of a tuple is one of:
+ *  - a base operator on its own slot, or none, plus up to 'max cross
+ *    terms' terms +/- x_j*y_k, x_j or y_j (e.g. x0*y0 - x1*y1 and
+ *    x0*y1 + x1*y0);
+ *  - a choice between its x and y by the order of another slot, as in
+ *    argmin, select(x_j < y_j, x_i, y_i), the ties possibly broken by a
+ *    base operator like min: select(x_j == y_j, f(x_i, y_i), select(...)).
+ * Only the non-decomposable compositions (see DependencyGraph.h) that pass
+ * the fast associativity check go to Z3. The type is signed for the
+ * comparisons to order the way select does. Run it as
+ *   compose_gen [tuple size] [max base leaves] [max cross terms]
+ * (2, 3 and 2 by default; the number of compositions grows quickly with
+ * each) and build it like the other generators, e.g.
+ *   g++ -std=c++11 -O3 ComposeGenerator.cpp Utilities.cpp AssociativityProver.cpp HalideToZ3.cpp -I<halide>/include -lHalide -lz3 -lpthread
+ * The coordinates printed for a proven tuple are the leaf count of each
+ * slot's base operator (0 if none) and the index of the slot's composition.
+ */
+
+Halide::Type kType = Halide::Int(32);
+vector<string> kXNames, kYNames;
+vector<string> kConstantNames = {"k0"};
+vector<Halide::Expr> kXVars, kYVars;
+vector<Halide::Expr> kConstants = {Variable::make(kType, "k0")};
+
+enum Node : uint8_t {
+    X0 = 0,
+    Y0,
+    K0,
+    Add,
+    Sub,
+    Mul,
+    Min,
+    Max,
+    LastNode,
+};
+
+// The leaves that may follow 'prev' and 'prevprev' in the prefix node list
+int leaf_choices(int prev, int prevprev, uint8_t *choices) {
+    bool after_op = (prevprev == Min) || (prevprev == Max) || (prevprev == Add) || (prevprev == Sub);
+    int n = 0;
+    if (after_op && (prev == X0)) {
+        // avoid min(x, x)
+        choices[n++] = K0;
+        choices[n++] = Y0;
+    } else if (after_op && (prev == Y0)) {
+        // avoid min(y, y)
+        choices[n++] = K0;
+        choices[n++] = X0;
+    } else if ((prevprev != Enumerator::NONE) && (prev == K0)) {
+        choices[n++] = Y0;
+        choices[n++] = X0;
+    } else {
+        choices[n++] = X0;
+        choices[n++] = Y0;
+        choices[n++] = K0;
+    }
+    return n;
+}
+
+// Single-element operator over x0, y0 and k0
+class SingleExpr : public Expr {
+public:
+    SingleExpr() : Expr(1) {}
+
+    void compile_term(Program &p, int &cursor) const {
+        Node node = (Node)nodes[cursor++];
+        switch(node) {
+        case X0:
+            p.push(OpCode::LoadX, 0);
+            break;
+        case Y0:
+            p.push(OpCode::LoadY, 0);
+            break;
+        case K0:
+            p.push(OpCode::LoadK);
+            break;
+        default:
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push((OpCode)(node - Add + (int)OpCode::Add));
+            break;
+        }
+    }
+
+    Program compile() const {
+        Program p;
+        int cursor = 0;
+        compile_term(p, cursor);
+        return p;
+    }
+
+    // Build the index-th tree with the given number of leaves
+    void create(const Enumerator &enumerator, uint64_t leaves, uint64_t index) {
+        uint8_t codes[MAX_NODES];
+        size = enumerator.unrank(leaves, index, codes);
+        for (int j = 0; j < size; ++j) {
+            nodes[j] = (Node)codes[j];
+            if (nodes[j] == X0) {
+                uses_x[0] = true;
+            } else if (nodes[j] == Y0) {
+                uses_y[0] = true;
+            }
+        }
+    }
+
+    Halide::Expr get_expr_term(int &cursor) const {
+        Node node = (Node)nodes[cursor++];
+        switch(node) {
+        case X0:
+            return kXVars[0];
+        case Y0:
+            return kYVars[0];
+        case K0:
+            return kConstants[0];
+        default:
+            break;
+        }
+        Halide::Expr lhs = get_expr_term(cursor);
+        Halide::Expr rhs = get_expr_term(cursor);
+        switch(node) {
+        case Add:
+            return lhs + rhs;
+        case Sub:
+            return lhs - rhs;
+        case Mul:
+            return lhs * rhs;
+        case Min:
+            return Halide::min(lhs, rhs);
+        default:
+            return Halide::max(lhs, rhs);
+        }
+    }
+
+    Halide::Expr get_expr() const {
+        int cursor = 0;
+        return get_expr_term(cursor);
+    }
+};
+
+// A proven single-element operator
+struct BaseOp {
+    uint64_t leaves;
+    Halide::Expr expr;
+    Program program;
+    // Always returns one of its arguments, like min and max
+    bool selective;
+};
+
+// One slot of a composed tuple
+struct Slot {
+    uint64_t leaves;  // Of its base operator, 0 if none
+    Halide::Expr expr;
+    Program program;
+    uint32_t row;     // Its row of the dependency graph
+};
+
+void append(Program &p, const Program &q) {
+    for (int pc = 0; pc < q.size; ++pc) {
+        p.push(q.code[pc].op, q.code[pc].index);
+    }
+}
+
+// Append 'op' to 'p' with its x0 and y0 renamed to the given slot
+void append_relabeled(Program &p, const Program &op, int slot) {
+    for (int pc = 0; pc < op.size; ++pc) {
+        const Instr &in = op.code[pc];
+        bool is_var = (in.op == OpCode::LoadX) || (in.op == OpCode::LoadY);
+        p.push(in.op, is_var ? slot : in.index);
+    }
+}
+
+Halide::Expr relabeled(const Halide::Expr &e, int slot) {
+    map<string, Halide::Expr> renames = {{kXNames[0], kXVars[slot]}, {kYNames[0], kYVars[slot]}};
+    return Halide::Internal::substitute(renames, e);
+}
+
+bool is_selective(const Program &p) {
+    Value x[MAX_TUPLE_SIZE] = {0}, y[MAX_TUPLE_SIZE] = {0};
+    for (int trial = 0; trial < 250; ++trial) {
+        x[0] = random_value();
+        y[0] = random_value();
+        Value v = p.run(x, y, random_value());
+        if ((v != x[0]) && (v != y[0])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The single-element operators with up to 'max_leaves' leaves that the
+// prover shows to be associative
+vector<BaseOp> find_base_ops(uint64_t max_leaves) {
+    const Enumerator enumerator({{Add, true}, {Sub, false}, {Mul, true}, {Min, true}, {Max, true}},
+                                leaf_choices, max_leaves);
+    vector<Halide::Expr> xvars = {kXVars[0]}, yvars = {kYVars[0]};
+    vector<BaseOp> ops;
+    for (uint64_t leaves = 1; leaves <= max_leaves; ++leaves) {
+        for (uint64_t i = 0; i < enumerator.count(leaves); ++i) {
+            SingleExpr e;
+            e.create(enumerator, leaves, i);
+            Halide::Expr expr = e.get_expr();
+            if (should_skip_expression(0, expr, e.fail, e.uses_x, e.uses_y, kXNames, kYNames, kConstantNames)) {
+                continue;
+            }
+            Program program = e.compile();
+            bool uses_x = false, uses_y = false;
+            if (!simd_check_associativity(&program, 1, 250, uses_x, uses_y) || !uses_x || !uses_y) {
+                continue;
+            }
+            if (prove_associativity(expr, xvars, yvars, kConstants).first == IsAssociative::YES) {
+                ops.push_back({leaves, expr, program, is_selective(program)});
+            }
+        }
+    }
+    return ops;
+}
+
+// A term coupling slot 'i' to the others: x_j*y_k, x_j or y_j
+struct Term {
+    Halide::Expr expr;
+    Program program;
+    uint32_t row;
+};
+
+vector<Term> coupling_terms(size_t size) {
+    vector<Term> terms;
+    for (size_t j = 0; j < size; ++j) {
+        for (size_t k = 0; k < size; ++k) {
+            Term t = {kXVars[j] * kYVars[k], Program(), (1u << j) | (1u << k)};
+            t.program.push(OpCode::LoadX, j);
+            t.program.push(OpCode::LoadY, k);
+            t.program.push(OpCode::Mul);
+            terms.push_back(t);
+        }
+    }
+    for (size_t j = 0; j < size; ++j) {
+        Term tx = {kXVars[j], Program(), 1u << j};
+        tx.program.push(OpCode::LoadX, j);
+        terms.push_back(tx);
+        Term ty = {kYVars[j], Program(), 1u << j};
+        ty.program.push(OpCode::LoadY, j);
+        terms.push_back(ty);
+    }
+    return terms;
+}
+
+// Add the terms, with their signs, to the slot
+void append_sum(Slot &slot, const vector<const Term *> &terms, const vector<bool> &negated) {
+    for (size_t t = 0; t < terms.size(); ++t) {
+        if (slot.program.size == 0) {
+            // A leading term keeps its sign positive, its negation being
+            // the same coupling
+            slot.expr = terms[t]->expr;
+            slot.program = terms[t]->program;
+        } else {
+            slot.expr = negated[t] ? (slot.expr - terms[t]->expr) : (slot.expr + terms[t]->expr);
+            append(slot.program, terms[t]->program);
+            slot.program.push(negated[t] ? OpCode::Sub : OpCode::Add);
+        }
+        slot.row |= terms[t]->row;
+    }
+}
+
+// The compositions slot 'i' of a tuple of 'size' elements can take
+vector<Slot> slot_choices(size_t i, size_t size, const vector<BaseOp> &ops, int max_terms) {
+    vector<Slot> slots;
+    const vector<Term> terms = coupling_terms(size);
+
+    // A base operator, or none, plus up to 'max_terms' distinct terms with
+    // their signs, each set of terms in increasing order
+    vector<vector<const Term *>> sets = {{}};
+    vector<vector<bool>> signs = {{}};
+    for (size_t s = 0; s < sets.size(); ++s) {
+        if ((int)sets[s].size() >= max_terms) {
+            continue;
+        }
+        size_t first = sets[s].empty() ? 0 : (sets[s].back() - &terms[0]) + 1;
+        for (size_t t = first; t < terms.size(); ++t) {
+            for (int sign = 0; sign < 2; ++sign) {
+                sets.push_back(sets[s]);
+                sets.back().push_back(&terms[t]);
+                signs.push_back(signs[s]);
+                signs.back().push_back(sign);
+            }
+        }
+    }
+    for (int b = -1; b < (int)ops.size(); ++b) {
+        for (size_t s = 0; s < sets.size(); ++s) {
+            Slot slot = {0, Halide::Expr(), Program(), 0};
+            if (b >= 0) {
+                slot = {ops[b].leaves, relabeled(ops[b].expr, i), Program(), 1u << i};
+                append_relabeled(slot.program, ops[b].program, i);
+            } else if (sets[s].empty() || signs[s][0]) {
+                continue;
+            }
+            append_sum(slot, sets[s], signs[s]);
+            slots.push_back(slot);
+        }
+    }
+
+    // Picks by the order of another slot. select(c, a, b) runs as
+    // b + c*(a - b), which is exact for a condition of 0 or 1.
+    for (size_t j = 0; j < size; ++j) {
+        if (j == i) {
+            continue;
+        }
+        for (int swap = 0; swap < 2; ++swap) {
+            Halide::Expr a = swap ? kYVars[j] : kXVars[j];
+            Halide::Expr b = swap ? kXVars[j] : kYVars[j];
+            Slot pick = {0, Halide::select(a < b, kXVars[i], kYVars[i]), Program(), (1u << i) | (1u << j)};
+            pick.program.push(OpCode::LoadY, i);
+            pick.program.push(swap ? OpCode::LoadY : OpCode::LoadX, j);
+            pick.program.push(swap ? OpCode::LoadX : OpCode::LoadY, j);
+            pick.program.push(OpCode::LT);
+            pick.program.push(OpCode::LoadX, i);
+            pick.program.push(OpCode::LoadY, i);
+            pick.program.push(OpCode::Sub);
+            pick.program.push(OpCode::Mul);
+            pick.program.push(OpCode::Add);
+            slots.push_back(pick);
+
+            // Ties broken by a base operator that returns one of its
+            // arguments, as min does for argmin
+            for (const BaseOp &op : ops) {
+                if (!op.selective) {
+                    continue;
+                }
+                Slot tie = {op.leaves, Halide::select(kXVars[j] == kYVars[j], relabeled(op.expr, i), pick.expr),
+                            pick.program, pick.row};
+                tie.program.push(OpCode::LoadX, j);
+                tie.program.push(OpCode::LoadY, j);
+                tie.program.push(OpCode::EQ);
+                append_relabeled(tie.program, op.program, i);
+                append(tie.program, pick.program);
+                tie.program.push(OpCode::Sub);
+                tie.program.push(OpCode::Mul);
+                tie.program.push(OpCode::Add);
+                slots.push_back(tie);
+            }
+        }
+    }
+    return slots;
+}
+
+struct Composer {
+    const vector<vector<Slot>> &choices;
+    const DependencyGraphs graphs;
+    size_t size;
+    vector<size_t> picks;
+    uint64_t tried, fast, valid;
+
+    Composer(const vector<vector<Slot>> &choices)
+        : choices(choices), graphs(choices.size()), size(choices.size()), picks(choices.size()),
+          tried(0), fast(0), valid(0) {}
+
+    void check() {
+        tried++;
+        Program programs[MAX_TUPLE_SIZE];
+        for (size_t i = 0; i < size; ++i) {
+            programs[i] = choices[i][picks[i]].program;
+        }
+        bool uses_x = false, uses_y = false;
+        bool associative = simd_check_associativity(programs, size, 250, uses_x, uses_y);
+        if (!associative || !uses_x || !uses_y) {
+            return;
+        }
+        fast++;
+        vector<Halide::Expr> halide_exprs(size);
+        vector<uint64_t> leaves(size), is(size);
+        for (size_t i = 0; i < size; ++i) {
+            halide_exprs[i] = choices[i][picks[i]].expr;
+            leaves[i] = choices[i][picks[i]].leaves;
+            is[i] = picks[i];
+        }
+        if (z3_check_associativity(halide_exprs, kXVars, kYVars, kConstants, leaves, is)) {
+            valid++;
+        }
+    }
+
+    // Fill the slots from 'i' on, keeping to the non-decomposable graphs
+    void compose(size_t i, uint32_t prefix) {
+        if (i == size) {
+            check();
+            return;
+        }
+        for (size_t k = 0; k < choices[i].size(); ++k) {
+            uint32_t row = choices[i][k].row;
+            if (!graphs.allows(prefix, row)) {
+                continue;
+            }
+            picks[i] = k;
+            compose(i + 1, graphs.extend(prefix, row));
+        }
+    }
+};
+
+int main(int argc, char **argv) {
+    start_prover_workers();
+    size_t TUPLE_SIZE = 2;
+    uint64_t MAX_BASE_LEAVES = 3;
+    int MAX_CROSS_TERMS = 2;
+    if (argc > 1) {
+        TUPLE_SIZE = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        MAX_BASE_LEAVES = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        MAX_CROSS_TERMS = atoi(argv[3]);
+    }
+    ASSERT((TUPLE_SIZE >= 2) && (TUPLE_SIZE <= MAX_TUPLE_SIZE), "Tuple size must be in [2, 4]\n");
+    for (size_t i = 0; i < TUPLE_SIZE; ++i) {
+        kXNames.push_back("x" + std::to_string(i));
+        kYNames.push_back("y" + std::to_string(i));
+        kXVars.push_back(Variable::make(kType, kXNames[i]));
+        kYVars.push_back(Variable::make(kType, kYNames[i]));
+    }
+    std::cout << "Running composing tuple generator of type: " << kType << "\n";
+    std::cout << "Tuple size: " << TUPLE_SIZE << ", max base leaves: " << MAX_BASE_LEAVES
+              << ", max cross terms: " << MAX_CROSS_TERMS << "\n\n";
+
+    auto start = std::chrono::steady_clock::now();
+    vector<BaseOp> ops = find_base_ops(MAX_BASE_LEAVES);
+    int selective = 0;
+    for (const BaseOp &op : ops) {
+        DEBUG_PRINT << "Base operator: " << op.expr << (op.selective ? " (selective)" : "") << "\n";
+        selective += op.selective;
+    }
+    std::cout << "Base operators: " << ops.size() << " (" << selective << " selective)\n";
+
+    vector<vector<Slot>> choices(TUPLE_SIZE);
+    for (size_t i = 0; i < TUPLE_SIZE; ++i) {
+        choices[i] = slot_choices(i, TUPLE_SIZE, ops, MAX_CROSS_TERMS);
+    }
+    std::cout << "Compositions per slot: " << choices[0].size() << "\n\n";
+    std::cout.flush();
+
+    Composer composer(choices);
+    composer.compose(0, DependencyGraphs::kRoot);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "\nTried: " << composer.tried << ", passed the fast check: " << composer.fast << "\n";
+    std::cout << "Valid: " << composer.valid << "\n";
+    std::cout << "Time: " << seconds << " s\n";
+    return 0;
+}
@@ -0,0 +1,112 @@
+#ifndef COUNTEREXAMPLE_BANK_H
+#define COUNTEREXAMPLE_BANK_H
+
+/** \file
+ *
+ * Bank of concrete (x, y, z, k) inputs on which Z3 showed a candidate not to
+ * be associative. The fast associativity check tries them before its random
+ * trials, so that near-misses failing only on corner cases (overflow
+ * boundaries, min/max ties) that random values rarely hit are rejected there
+ * instead of by another solver call.
+ */
+
+#include "Bytecode.h"
+
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <stdint.h>
+
+struct Counterexample {
+    Value x[MAX_TUPLE_SIZE];
+    Value y[MAX_TUPLE_SIZE];
+    Value z[MAX_TUPLE_SIZE];
+    Value k;
+};
+
+/**
+ * Bounded bank of counterexamples per tuple size; once full, the oldest one
+ * is overwritten. Counterexamples are added rarely (on a failed proof), but
+ * read on every fast check from all the threads of a sweep, so each reader
+ * works on its own copy and only takes the lock to refresh it after the bank
+ * has changed.
+ */
+class CounterexampleBank {
+public:
+    static const int kCapacity = 64;
+    // Readers' copies are padded to a multiple of this many trials (the
+    // widest SIMD lane group) by repeating the first counterexample
+    static const int kPadding = 16;
+
+    // A reader's copy of the counterexamples for one tuple size, one array
+    // of trials per tuple slot
+    struct Trials {
+        uint64_t version;
+        int size;
+        Value x[MAX_TUPLE_SIZE][kCapacity];
+        Value y[MAX_TUPLE_SIZE][kCapacity];
+        Value z[MAX_TUPLE_SIZE][kCapacity];
+        Value k[kCapacity];
+
+        Trials() : version(0), size(0) {}
+    };
+
+private:
+    std::mutex mutex;
+    std::atomic<uint64_t> versions[MAX_TUPLE_SIZE];
+    Counterexample entries[MAX_TUPLE_SIZE][kCapacity];
+    int count[MAX_TUPLE_SIZE];
+    int next[MAX_TUPLE_SIZE];
+
+public:
+    CounterexampleBank() {
+        for (size_t i = 0; i < MAX_TUPLE_SIZE; ++i) {
+            versions[i] = 0;
+            count[i] = 0;
+            next[i] = 0;
+        }
+    }
+
+    void add(size_t size, const Counterexample &c) {
+        assert((size >= 1) && (size <= MAX_TUPLE_SIZE));
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t s = size - 1;
+        entries[s][next[s]] = c;
+        next[s] = (next[s] + 1) % kCapacity;
+        if (count[s] < kCapacity) {
+            count[s]++;
+        }
+        versions[s].fetch_add(1, std::memory_order_release);
+    }
+
+    // Refresh 'trials' with the counterexamples for tuples of 'size' if the
+    // bank has changed since it was last filled
+    void load(size_t size, Trials &trials) {
+        assert((size >= 1) && (size <= MAX_TUPLE_SIZE));
+        size_t s = size - 1;
+        if (versions[s].load(std::memory_order_acquire) == trials.version) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        trials.version = versions[s].load(std::memory_order_relaxed);
+        int n = count[s];
+        trials.size = (n + kPadding - 1) / kPadding * kPadding;
+        for (int t = 0; t < trials.size; ++t) {
+            const Counterexample &c = entries[s][(t < n) ? t : 0];
+            for (size_t i = 0; i < size; ++i) {
+                trials.x[i][t] = c.x[i];
+                trials.y[i][t] = c.y[i];
+                trials.z[i][t] = c.z[i];
+            }
+            trials.k[t] = c.k;
+        }
+    }
+};
+
+// The bank shared by the prover and the fast checks of all the threads
+inline CounterexampleBank &counterexample_bank() {
+    static CounterexampleBank bank;
+    return bank;
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef DEPENDENCY_GRAPH_H
+#define DEPENDENCY_GRAPH_H
+
+/** \file
+ *
+ * Dependency graphs of tuple operators as bitmask adjacency matrices: bit j
+ * of row i is set if element i uses x_j or y_j. A tuple is decomposable if
+ * no element reaches every element through the graph, in which case it is
+ * several smaller operators side by side and not worth proving. The tuple
+ * generators enumerate only the non-decomposable graphs, so decomposable
+ * tuples are never built.
+ */
+
+#include "Bytecode.h"
+#include "Error.h"
+
+#include <cassert>
+#include <vector>
+#include <stdint.h>
+
+// Close the graph of 'size' rows over paths of one or more edges
+inline void transitive_closure(uint32_t *rows, size_t size) {
+    for (size_t k = 0; k < size; ++k) {
+        for (size_t i = 0; i < size; ++i) {
+            if ((rows[i] >> k) & 1) {
+                rows[i] |= rows[k];
+            }
+        }
+    }
+}
+
+inline bool is_decomposable_graph(const uint32_t *rows, size_t size) {
+    assert(size <= 32);
+    uint32_t closure[32];
+    for (size_t i = 0; i < size; ++i) {
+        closure[i] = rows[i];
+    }
+    transitive_closure(closure, size);
+    uint32_t all = (size == 32) ? ~0u : ((1u << size) - 1);
+    for (size_t i = 0; i < size; ++i) {
+        if (closure[i] == all) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * The non-decomposable graphs of a tuple size, as a trie over their rows in
+ * element order. A prefix stands for the rows of the first elements, which
+ * narrows down what the next element may use: the tuple search only draws
+ * candidates whose row leads to some non-decomposable graph.
+ */
+class DependencyGraphs {
+    size_t size;
+    // Bit r of next[prefix] is set if row r can follow the prefix
+    std::vector<uint32_t> next;
+
+public:
+    // The prefix of no rows
+    static const uint32_t kRoot = 1;
+
+    explicit DependencyGraphs(size_t size) : size(size) {
+        ASSERT((size > 0) && (size <= MAX_TUPLE_SIZE), "Tuple is too large for the dependency graphs\n");
+        // Prefixes carry a leading one so that their length is implied
+        next.resize((size_t)1 << (size * (size - 1) + 1));
+        uint32_t row_mask = (1u << size) - 1;
+        uint32_t rows[MAX_TUPLE_SIZE];
+        for (uint32_t g = 0; g < (1u << (size * size)); ++g) {
+            for (size_t i = 0; i < size; ++i) {
+                rows[i] = (g >> (size * i)) & row_mask;
+            }
+            if (is_decomposable_graph(rows, size)) {
+                continue;
+            }
+            uint32_t prefix = kRoot;
+            for (size_t i = 0; i < size; ++i) {
+                next[prefix] |= 1u << rows[i];
+                prefix = extend(prefix, rows[i]);
+            }
+        }
+    }
+
+    uint32_t extend(uint32_t prefix, uint32_t row) const { return (prefix << size) | row; }
+
+    // The rows the next element can have after the ones in 'prefix'
+    uint32_t next_rows(uint32_t prefix) const { return next[prefix]; }
+
+    bool allows(uint32_t prefix, uint32_t row) const { return (next[prefix] >> row) & 1; }
+};
+
+// Iterate over the set bits of a mask, lowest first
+class SetBits {
+    uint32_t bits;
+
+public:
+    class iterator {
+        uint32_t bits;
+
+    public:
+        explicit iterator(uint32_t bits) : bits(bits) {}
+        uint32_t operator*() const { return __builtin_ctz(bits); }
+        iterator &operator++() {
+            bits &= bits - 1;
+            return *this;
+        }
+        bool operator!=(const iterator &rhs) const { return bits != rhs.bits; }
+    };
+
+    explicit SetBits(uint32_t bits) : bits(bits) {}
+    iterator begin() const { return iterator(bits); }
+    iterator end() const { return iterator(0); }
+};
+
+#endif
@@ -0,0 +1,213 @@
+#ifndef ENUMERATOR_H
+#define ENUMERATOR_H
+
+/** \file
+ *
+ * Dense ranking of the expression trees enumerated by the generators. Unlike
+ * decoding an arbitrary integer through a DecisionSource, which only yields a
+ * tree for the indices that happen to use up all their digits, every index in
+ * [0, count(leaves)) unranks to a distinct tree and every tree has an index.
+ */
+
+#include "CommonClass.h"
+#include "Error.h"
+
+#include <map>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+/**
+ * The trees are prefix lists of nodes. An internal node is one of the binary
+ * ops; a commutative op only splits its leaves so that the right operand has
+ * at most as many leaves as the left one, a non-commutative op splits them
+ * any way. Which leaves may come next depends on the two nodes emitted right
+ * before it (e.g. to avoid min(x, x)), so the trees are counted per
+ * (leaves, context in, context out) where a context is that pair of nodes.
+ */
+class Enumerator {
+public:
+    // No node (at the start of the expression)
+    static const int NONE = -1;
+
+    // Fill 'choices' with the leaves that may follow 'prev' and 'prevprev'
+    // (either may be NONE) and return how many there are.
+    typedef int (*LeafChoices)(int prev, int prevprev, uint8_t *choices);
+
+    struct OpRule {
+        uint8_t op;
+        bool commutative;
+    };
+
+    Enumerator(const std::vector<OpRule> &ops, LeafChoices leaf_choices, int max_leaves)
+        : ops(ops), leaf_choices(leaf_choices), max_leaves(max_leaves) {
+        // Fill all the tables up front; after this the enumerator is only
+        // read, so it can be shared by the worker threads.
+        for (int leaves = 1; leaves <= max_leaves; ++leaves) {
+            totals.push_back(total(leaves, context(NONE, NONE)));
+        }
+    }
+
+    // Number of trees with the given number of leaves
+    uint64_t count(uint64_t leaves) const {
+        ASSERT((leaves >= 1) && (leaves <= (uint64_t)max_leaves), "Leaves out of range of the enumerator\n");
+        return totals[leaves - 1];
+    }
+
+    // The indices in [i_start, i_end] that have a tree with the given number
+    // of leaves
+    IntervalSet index_range(uint64_t leaves, uint64_t i_start, uint64_t i_end) const {
+        IntervalSet range;
+        uint64_t n = count(leaves);
+        if ((i_start < n) && (i_start <= i_end)) {
+            range.insert(IntervalVal::closed(i_start, std::min(i_end, n - 1)));
+        }
+        return range;
+    }
+
+    // Last index of the tile of 'tile' indices starting at 'i_start', clipped
+    // to the largest class with a leaf count in [leaves_start, leaves_end].
+    // Comes out below i_start if the tile holds no tree at all.
+    uint64_t tile_end(uint64_t leaves_start, uint64_t leaves_end, uint64_t i_start, uint64_t tile) const {
+        uint64_t n = 0;
+        for (uint64_t leaves = leaves_start; leaves <= leaves_end; ++leaves) {
+            n = std::max(n, count(leaves));
+        }
+        if (n == 0) {
+            return i_start + tile - 1;
+        }
+        return std::min(i_start + tile, n) - 1;
+    }
+
+    // Write the index-th tree with the given number of leaves to 'nodes' and
+    // return the number of nodes written
+    int unrank(uint64_t leaves, uint64_t index, uint8_t *nodes) const {
+        ASSERT(index < count(leaves), "Index out of range of the enumerator\n");
+        int size = 0;
+        unrank(leaves, context(NONE, NONE), ANY, index, nodes, size);
+        return size;
+    }
+
+private:
+    // Matches any context out
+    static const int ANY = -1;
+
+    typedef std::map<int, uint64_t> Counts;
+
+    std::vector<OpRule> ops;
+    LeafChoices leaf_choices;
+    int max_leaves;
+
+    std::vector<uint64_t> totals;
+    // Number of trees per context out, for each (leaves, context in). Only
+    // written while constructing.
+    std::map<std::pair<int, int>, Counts> table;
+
+    static int context(int prev, int prevprev) {
+        return (prev + 1) * 257 + (prevprev + 1);
+    }
+    static int prev_of(int ctx) {
+        return ctx / 257 - 1;
+    }
+    static int prevprev_of(int ctx) {
+        return ctx % 257 - 1;
+    }
+
+    const Counts &counts(int leaves, int ctx_in) {
+        auto key = std::make_pair(leaves, ctx_in);
+        auto iter = table.find(key);
+        if (iter != table.end()) {
+            return iter->second;
+        }
+
+        Counts result;
+        if (leaves == 1) {
+            uint8_t choices[256];
+            int n = leaf_choices(prev_of(ctx_in), prevprev_of(ctx_in), choices);
+            for (int c = 0; c < n; ++c) {
+                result[context(choices[c], prev_of(ctx_in))]++;
+            }
+        } else {
+            for (const OpRule &rule : ops) {
+                int ctx_left = context(rule.op, prev_of(ctx_in));
+                int max_right = rule.commutative ? leaves / 2 : leaves - 1;
+                for (int right = 1; right <= max_right; ++right) {
+                    // References into a std::map stay valid while the
+                    // recursive calls insert into it
+                    const Counts &left_counts = counts(leaves - right, ctx_left);
+                    for (const auto &left : left_counts) {
+                        const Counts &right_counts = counts(right, left.first);
+                        for (const auto &r : right_counts) {
+                            result[r.first] += left.second * r.second;
+                        }
+                    }
+                }
+            }
+        }
+        return table[key] = result;
+    }
+
+    uint64_t total(int leaves, int ctx_in) {
+        uint64_t n = 0;
+        for (const auto &c : counts(leaves, ctx_in)) {
+            n += c.second;
+        }
+        return n;
+    }
+
+    uint64_t lookup(int leaves, int ctx_in, int ctx_out) const {
+        const Counts &c = table.at(std::make_pair(leaves, ctx_in));
+        if (ctx_out == ANY) {
+            uint64_t n = 0;
+            for (const auto &iter : c) {
+                n += iter.second;
+            }
+            return n;
+        }
+        auto iter = c.find(ctx_out);
+        return (iter == c.end()) ? 0 : iter->second;
+    }
+
+    // Unrank among the trees that start in 'ctx_in' and end in 'ctx_out'
+    int unrank(int leaves, int ctx_in, int ctx_out, uint64_t index, uint8_t *nodes, int &size) const {
+        assert(size < MAX_NODES);
+        if (leaves == 1) {
+            uint8_t choices[256];
+            int n = leaf_choices(prev_of(ctx_in), prevprev_of(ctx_in), choices);
+            for (int c = 0; c < n; ++c) {
+                int ctx = context(choices[c], prev_of(ctx_in));
+                if ((ctx_out == ANY) || (ctx_out == ctx)) {
+                    if (index == 0) {
+                        nodes[size++] = choices[c];
+                        return ctx;
+                    }
+                    index--;
+                }
+            }
+            ASSERT(false, "Leaf index out of range\n");
+            return ANY;
+        }
+
+        for (const OpRule &rule : ops) {
+            int ctx_left = context(rule.op, prev_of(ctx_in));
+            int max_right = rule.commutative ? leaves / 2 : leaves - 1;
+            for (int right = 1; right <= max_right; ++right) {
+                const Counts &left_counts = table.at(std::make_pair(leaves - right, ctx_left));
+                for (const auto &left : left_counts) {
+                    uint64_t num_right = lookup(right, left.first, ctx_out);
+                    uint64_t block = left.second * num_right;
+                    if (index < block) {
+                        nodes[size++] = rule.op;
+                        unrank(leaves - right, ctx_left, left.first, index / num_right, nodes, size);
+                        return unrank(right, left.first, ctx_out, index % num_right, nodes, size);
+                    }
+                    index -= block;
+                }
+            }
+        }
+        ASSERT(false, "Tree index out of range\n");
+        return ANY;
+    }
+};
+
+#endif
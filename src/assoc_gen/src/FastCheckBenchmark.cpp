@@ -0,0 +1,311 @@
+#include "CommonClass.h"
+#include "SimdEval.h"
+#include "benchmark.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <stdint.h>
+
+using std::vector;
+
+/**
+ * Measure the candidates-per-second throughput of the random-trial stage of
+ * fast_check_associativity: once with the recursive tree walk the generators
+ * used to evaluate their nodes with, and once with the compiled postfix
+ * programs from Bytecode.h, and once with SIMD_LANES trials per batch from
+ * SimdEval.h (add -mavx2 or -mavx512f to use vector registers). Candidates are random 2-tuples over the
+ * TupleGenerator alphabet. Build it with optimizations, e.g.
+ *   g++ -std=c++11 -O3 FastCheckBenchmark.cpp -I<halide>/include -I../../benchmarks -lz3
+ */
+
+enum Node : uint8_t {
+    X0 = 0,
+    Y0,
+    X1,
+    Y1,
+    K0,
+    Add,
+    Sub,
+    Mul,
+    Min,
+    Max,
+    LastNode,
+};
+
+const int NUM_CANDIDATES = 2000;
+const int NUM_TRIALS = 250;
+
+class TupleExpr : public Expr {
+public:
+    TupleExpr() : Expr(2) {}
+
+    // The recursive evaluation the generators used before compiling to programs
+    Value evaluate_term(const vector<Value> &xvalues, const vector<Value> &yvalues, Value k, int &cursor) const {
+        Value v1, v2;
+        switch(nodes[cursor++]) {
+        case X0:
+            return xvalues[0];
+        case X1:
+            return xvalues[1];
+        case Y0:
+            return yvalues[0];
+        case Y1:
+            return yvalues[1];
+        case K0:
+            return k;
+        case Add:
+            v1 = evaluate_term(xvalues, yvalues, k, cursor);
+            v2 = evaluate_term(xvalues, yvalues, k, cursor);
+            return wrap_add(v1, v2);
+        case Sub:
+            v1 = evaluate_term(xvalues, yvalues, k, cursor);
+            v2 = evaluate_term(xvalues, yvalues, k, cursor);
+            return wrap_sub(v1, v2);
+        case Mul:
+            v1 = evaluate_term(xvalues, yvalues, k, cursor);
+            v2 = evaluate_term(xvalues, yvalues, k, cursor);
+            return wrap_mul(v1, v2);
+        case Min:
+            v1 = evaluate_term(xvalues, yvalues, k, cursor);
+            v2 = evaluate_term(xvalues, yvalues, k, cursor);
+            return std::min(v1, v2);
+        case Max:
+            v1 = evaluate_term(xvalues, yvalues, k, cursor);
+            v2 = evaluate_term(xvalues, yvalues, k, cursor);
+            return std::max(v1, v2);
+        default:
+            return 0;
+        }
+    }
+
+    Value evaluate(const vector<Value> &xvalues, const vector<Value> &yvalues, Value k) const {
+        int cursor = 0;
+        return evaluate_term(xvalues, yvalues, k, cursor);
+    }
+
+    void compile_term(Program &p, int &cursor) const {
+        switch(nodes[cursor++]) {
+        case X0:
+            p.push(OpCode::LoadX, 0);
+            break;
+        case X1:
+            p.push(OpCode::LoadX, 1);
+            break;
+        case Y0:
+            p.push(OpCode::LoadY, 0);
+            break;
+        case Y1:
+            p.push(OpCode::LoadY, 1);
+            break;
+        case K0:
+            p.push(OpCode::LoadK);
+            break;
+        case Add:
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Add);
+            break;
+        case Sub:
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Sub);
+            break;
+        case Mul:
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Mul);
+            break;
+        case Min:
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Min);
+            break;
+        case Max:
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Max);
+            break;
+        default:
+            break;
+        }
+    }
+
+    Program compile() const {
+        Program p;
+        int cursor = 0;
+        compile_term(p, cursor);
+        return p;
+    }
+
+    // Random tree with the given number of leaves
+    void create_random(int leaves) {
+        assert(size < 64);
+        assert(leaves > 0);
+        std::mt19937 &engine = random_engine();
+        if (leaves == 1) {
+            nodes[size++] = (Node)(engine() % (K0 + 1));
+        } else {
+            nodes[size++] = (Node)(Add + engine() % (LastNode - Add));
+            int left = 1 + engine() % (leaves - 1);
+            create_random(left);
+            create_random(leaves - left);
+        }
+    }
+};
+
+bool check_recursive(const vector<TupleExpr> &eqs) {
+    size_t size = eqs.size();
+    bool associative = true;
+    bool uses_y = false, uses_x = false;
+    for (int trial = 0; trial < NUM_TRIALS; trial++) {
+        vector<Value> xvalues(size), yvalues(size), zvalues(size);
+        for (size_t i = 0; i < size; ++i) {
+            xvalues[i] = random_value();
+            yvalues[i] = random_value();
+            zvalues[i] = random_value();
+        }
+        Value k = random_value();
+
+        vector<Value> v_xy(size), v_yz(size), v_xz(size);
+        for (size_t i = 0; i < size; ++i) {
+            v_xy[i] = eqs[i].evaluate(xvalues, yvalues, k);
+            v_yz[i] = eqs[i].evaluate(yvalues, zvalues, k);
+            v_xz[i] = eqs[i].evaluate(xvalues, zvalues, k);
+            if (v_xy[i] != v_xz[i]) {
+                uses_y = true;
+            }
+            if (v_xz[i] != v_yz[i]) {
+                uses_x = true;
+            }
+        }
+
+        vector<Value> v_x_yz(size), v_xy_z(size);
+        for (size_t i = 0; i < size; ++i) {
+            v_x_yz[i] = eqs[i].evaluate(xvalues, v_yz, k);
+            v_xy_z[i] = eqs[i].evaluate(v_xy, zvalues, k);
+            if (v_x_yz[i] != v_xy_z[i]) {
+                associative = false;
+                break;
+            }
+        }
+    }
+    return !(associative && uses_x && uses_y);
+}
+
+bool check_compiled(const vector<TupleExpr> &eqs) {
+    size_t size = eqs.size();
+    Program programs[MAX_TUPLE_SIZE];
+    for (size_t i = 0; i < size; ++i) {
+        programs[i] = eqs[i].compile();
+    }
+
+    bool associative = true;
+    bool uses_y = false, uses_x = false;
+    Value xvalues[MAX_TUPLE_SIZE], yvalues[MAX_TUPLE_SIZE], zvalues[MAX_TUPLE_SIZE];
+    Value v_xy[MAX_TUPLE_SIZE], v_yz[MAX_TUPLE_SIZE], v_xz[MAX_TUPLE_SIZE];
+    Value v_x_yz[MAX_TUPLE_SIZE], v_xy_z[MAX_TUPLE_SIZE];
+    for (int trial = 0; trial < NUM_TRIALS; trial++) {
+        for (size_t i = 0; i < size; ++i) {
+            xvalues[i] = random_value();
+            yvalues[i] = random_value();
+            zvalues[i] = random_value();
+        }
+        Value k = random_value();
+
+        for (size_t i = 0; i < size; ++i) {
+            v_xy[i] = programs[i].run(xvalues, yvalues, k);
+            v_yz[i] = programs[i].run(yvalues, zvalues, k);
+            v_xz[i] = programs[i].run(xvalues, zvalues, k);
+            if (v_xy[i] != v_xz[i]) {
+                uses_y = true;
+            }
+            if (v_xz[i] != v_yz[i]) {
+                uses_x = true;
+            }
+        }
+
+        for (size_t i = 0; i < size; ++i) {
+            v_x_yz[i] = programs[i].run(xvalues, v_yz, k);
+            v_xy_z[i] = programs[i].run(v_xy, zvalues, k);
+            if (v_x_yz[i] != v_xy_z[i]) {
+                associative = false;
+                break;
+            }
+        }
+    }
+    return !(associative && uses_x && uses_y);
+}
+
+bool check_simd(const vector<TupleExpr> &eqs) {
+    size_t size = eqs.size();
+    Program programs[MAX_TUPLE_SIZE];
+    for (size_t i = 0; i < size; ++i) {
+        programs[i] = eqs[i].compile();
+    }
+    bool uses_y = false, uses_x = false;
+    bool associative = simd_check_associativity(programs, size, NUM_TRIALS, uses_x, uses_y);
+    return !(associative && uses_x && uses_y);
+}
+
+int main(int argc, char **argv) {
+    int max_leaves = (argc > 1) ? atoi(argv[1]) : 7;
+
+    for (int leaves = 2; leaves <= max_leaves; ++leaves) {
+        seed_random_value(leaves);
+        vector<vector<TupleExpr>> candidates(NUM_CANDIDATES, vector<TupleExpr>(2));
+        for (auto &eqs : candidates) {
+            for (auto &e : eqs) {
+                e.create_random(leaves);
+            }
+        }
+
+        // Both paths must reach the same verdict given the same random trials
+        int skipped = 0;
+        for (size_t c = 0; c < candidates.size(); ++c) {
+            seed_random_value(c);
+            bool a = check_recursive(candidates[c]);
+            seed_random_value(c);
+            bool b = check_compiled(candidates[c]);
+            if (a != b) {
+                std::cerr << "Mismatch at leaves " << leaves << ", candidate " << c << "\n";
+                return -1;
+            }
+            skipped += a;
+        }
+
+        // The batched check draws its trials differently, so only count how
+        // many candidates it lets through
+        int simd_skipped = 0;
+        for (size_t c = 0; c < candidates.size(); ++c) {
+            seed_random_value(c);
+            simd_skipped += check_simd(candidates[c]);
+        }
+
+        volatile int sink = 0;
+        double t_recursive = benchmark(5, 1, [&]() {
+            for (const auto &eqs : candidates) {
+                sink += check_recursive(eqs);
+            }
+        });
+        double t_compiled = benchmark(5, 1, [&]() {
+            for (const auto &eqs : candidates) {
+                sink += check_compiled(eqs);
+            }
+        });
+        double t_simd = benchmark(5, 1, [&]() {
+            for (const auto &eqs : candidates) {
+                sink += check_simd(eqs);
+            }
+        });
+
+        std::cout << "Leaves: " << leaves << " (" << NUM_CANDIDATES - skipped << " pass, "
+                  << NUM_CANDIDATES - simd_skipped << " pass batched)"
+                  << "\trecursive: " << NUM_CANDIDATES / t_recursive << " candidates/s"
+                  << "\tcompiled: " << NUM_CANDIDATES / t_compiled << " candidates/s ("
+                  << t_recursive / t_compiled << "x)"
+                  << "\tbatched x" << SIMD_LANES << ": " << NUM_CANDIDATES / t_simd << " candidates/s ("
+                  << t_recursive / t_simd << "x)\n";
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+#ifndef FINGERPRINT_H
+#define FINGERPRINT_H
+
+/** \file
+ *
+ * Behavioural fingerprints of the compiled generator expressions, used to
+ * keep only one representative of the trees that compute the same function
+ * (e.g. min(x, y) and min(y, x)) before anything is sent to the simplifier.
+ */
+
+#include "Bytecode.h"
+#include "SimdEval.h"
+
+#include <cstring>
+#include <random>
+#include <stdint.h>
+
+struct Fingerprint {
+    uint64_t value;
+
+    Fingerprint() : value(0) {}
+    explicit Fingerprint(uint64_t value) : value(value) {}
+
+    bool operator==(const Fingerprint &rhs) const {
+        return value == rhs.value;
+    }
+
+    uint64_t hash() const {
+        return value;
+    }
+};
+
+/**
+ * A fixed bank of random inputs. The fingerprint of a program is a hash of
+ * its outputs on the whole bank, evaluated with the same wrap-around
+ * semantics as the fast associativity check, so equivalent expressions
+ * always share a fingerprint. Different functions only share one if they
+ * agree on every input of the bank; with full-range 32-bit inputs that
+ * does not happen for the polynomial/min/max trees the generators build.
+ */
+class FingerprintBank {
+    static const int kBatches = 4;
+
+    VecValue x[kBatches][MAX_TUPLE_SIZE];
+    VecValue y[kBatches][MAX_TUPLE_SIZE];
+    VecValue k[kBatches];
+
+public:
+    FingerprintBank() {
+        // Its own engine, so building the bank does not shift the random
+        // trials of whichever thread gets to build it
+        std::mt19937 engine(0x5eed);
+        auto draw = [&]() {
+            Value lanes[SIMD_LANES];
+            for (int l = 0; l < SIMD_LANES; ++l) {
+                lanes[l] = (Value)engine();
+            }
+            return vec_load(lanes);
+        };
+        for (int b = 0; b < kBatches; ++b) {
+            for (size_t i = 0; i < MAX_TUPLE_SIZE; ++i) {
+                x[b][i] = draw();
+                y[b][i] = draw();
+            }
+            k[b] = draw();
+        }
+    }
+
+    Fingerprint fingerprint(const Program &p) const {
+        // FNV-1a over the output words
+        uint64_t h = 14695981039346656037ULL;
+        for (int b = 0; b < kBatches; ++b) {
+            VecValue v = run_batch(p, x[b], y[b], k[b]);
+            Value lanes[SIMD_LANES];
+            static_assert(sizeof(v) == sizeof(lanes), "Unexpected vector layout");
+            memcpy(lanes, &v, sizeof(lanes));
+            for (int l = 0; l < SIMD_LANES; ++l) {
+                h ^= (uint32_t)lanes[l];
+                h *= 1099511628211ULL;
+            }
+        }
+        return Fingerprint(h);
+    }
+};
+
+// The bank shared by all generators and threads; it is only read once built
+inline const FingerprintBank &fingerprint_bank() {
+    static const FingerprintBank bank;
+    return bank;
+}
+
+#endif
@@ -1,6 +1,13 @@
 #include "Halide.h"
 #include "Error.h"
 #include "Utilities.h"
+#include "ProverWorkers.h"
+#include "HashSet.h"
+#include "Enumerator.h"
+#include "CandidatePool.h"
+#include "DependencyGraph.h"
+#include "SimdEval.h"
+#include "WorkStealingPool.h"
 
 #include <algorithm>
 #include <iostream>
@@ -10,6 +17,8 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <sstream>
+#include <thread>
 #include <stdint.h>
 
 using std::pair;
@@ -25,6 +34,8 @@ const uint64_t START_LEAVES = 2;
 const uint64_t MAX_LEAVES = 7;
 const uint64_t LEAVES_TILE = 3;
 const uint64_t ITER_TILE = 62000;
+// Number of i0 values handed out as one unit of work to the thread pool
+const uint64_t I0_CHUNK = 1000;
 
 Halide::Type kType = Halide::Int(32);
 vector<string> kXNames = {"x0", "x1", "x2", "x3"};
@@ -44,7 +55,7 @@ vector<Halide::Expr> kYVars = {
 };
 vector<Halide::Expr> kConstants;
 
-enum Node : long {
+enum Node : uint8_t {
     X0 = 0,
     Y0,
     X1,
@@ -62,532 +73,111 @@ enum Node : long {
     Max,
 };
 
+const Node kVarNodes[] = {X0, X1, X2, X3, Y0, Y1, Y2, Y3};
+
+// The leaves that may follow 'prev' and 'prevprev' in the prefix node list.
+// There are no constants in the four-element tuples.
+int leaf_choices(int prev, int prevprev, uint8_t *choices) {
+    bool after_op = (prevprev == Min) || (prevprev == Max) || (prevprev == Sub) || (prevprev == Add);
+    int n = 0;
+    for (Node v : kVarNodes) {
+        // avoid min(x, x) and min(y, y)
+        if (!after_op || (v != prev)) {
+            choices[n++] = v;
+        }
+    }
+    return n;
+}
+
+// Every tree of up to MAX_LEAVES leaves, ranked densely
+const Enumerator kEnumerator({{Add, true}, {Mul, true}}, leaf_choices, MAX_LEAVES);
+
 class TupleExpr : public Expr {
 public:
     TupleExpr() : Expr(4) {}
 
-    Value evaluate_term(const vector<Value> &xvalues, const vector<Value> &yvalues, Value k, int &cursor) const {
-        Value v1, v2;
+    void compile_term(Program &p, int &cursor) const {
         switch(nodes[cursor++]) {
         case X0:
-            return xvalues[0];
+            p.push(OpCode::LoadX, 0);
+            break;
         case X1:
-            return xvalues[1];
+            p.push(OpCode::LoadX, 1);
+            break;
         case X2:
-            return xvalues[2];
+            p.push(OpCode::LoadX, 2);
+            break;
         case X3:
-            return xvalues[3];
+            p.push(OpCode::LoadX, 3);
+            break;
         case Y0:
-            return yvalues[0];
+            p.push(OpCode::LoadY, 0);
+            break;
         case Y1:
-            return yvalues[1];
+            p.push(OpCode::LoadY, 1);
+            break;
         case Y2:
-            return yvalues[2];
+            p.push(OpCode::LoadY, 2);
+            break;
         case Y3:
-            return yvalues[3];
+            p.push(OpCode::LoadY, 3);
+            break;
         case K0:
-            return k;
+            p.push(OpCode::LoadK);
+            break;
         case Add:
-            v1 = evaluate_term(xvalues, yvalues, k, cursor);
-            v2 = evaluate_term(xvalues, yvalues, k, cursor);
-            return v1 + v2;
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Add);
+            break;
         case Sub:
-            v1 = evaluate_term(xvalues, yvalues, k, cursor);
-            v2 = evaluate_term(xvalues, yvalues, k, cursor);
-            return v1 - v2;
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Sub);
+            break;
         case Mul:
-            v1 = evaluate_term(xvalues, yvalues, k, cursor);
-            v2 = evaluate_term(xvalues, yvalues, k, cursor);
-            return v1 * v2;
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Mul);
+            break;
         case Min:
-            v1 = evaluate_term(xvalues, yvalues, k, cursor);
-            v2 = evaluate_term(xvalues, yvalues, k, cursor);
-            return std::min(v1, v2);
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Min);
+            break;
         case Max:
-            v1 = evaluate_term(xvalues, yvalues, k, cursor);
-            v2 = evaluate_term(xvalues, yvalues, k, cursor);
-            return std::max(v1, v2);
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Max);
+            break;
         default:
-            return 0;
+            break;
         }
     }
 
-    Value evaluate(const vector<Value> &xvalues, const vector<Value> &yvalues, Value k) const {
+    // Flatten the prefix node list into a postfix program, so that the
+    // random trials of the fast associativity check run without recursion
+    Program compile() const {
+        Program p;
         int cursor = 0;
-        return evaluate_term(xvalues, yvalues, k, cursor);
+        compile_term(p, cursor);
+        return p;
     }
 
-    void create(DecisionSource &dec, int leaves) {
-        assert(size < 64);
-        assert(leaves > 0);
-        if (leaves == 1) {
-            /*if (size > 1 && nodes[size-1] == X0 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Mul ||
-                 nodes[size-2] == Sub ||
-                 nodes[size-2] == Add)) {
-                // avoid min(x, x)
-                int d = dec.get(4);
-                if (d == 0) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 1) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                } else if (d == 2) {
-                    uses_y[2] = true;
-                    nodes[size++] = Y2;
-                } else {
-                    uses_y[3] = true;
-                    nodes[size++] = Y3;
-                }
-
-            } else if (size > 1 && nodes[size-1] == X1 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Mul ||
-                 nodes[size-2] == Sub ||
-                 nodes[size-2] == Add)) {
-                // avoid min(x, x)
-                int d = dec.get(4);
-                if (d == 0) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 1) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                } else if (d == 2) {
-                    uses_y[2] = true;
-                    nodes[size++] = Y2;
-                } else {
-                    uses_y[3] = true;
-                    nodes[size++] = Y3;
-                }
-            } else if (size > 1 && nodes[size-1] == X2 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Mul ||
-                 nodes[size-2] == Sub ||
-                 nodes[size-2] == Add)) {
-                // avoid min(x, x)
-                int d = dec.get(4);
-                if (d == 0) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 1) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                } else if (d == 2) {
-                    uses_y[2] = true;
-                    nodes[size++] = Y2;
-                } else {
-                    uses_y[3] = true;
-                    nodes[size++] = Y3;
-                }
-
-            } else if (size > 1 && nodes[size-1] == X3 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Mul ||
-                 nodes[size-2] == Sub ||
-                 nodes[size-2] == Add)) {
-                // avoid min(x, x)
-                int d = dec.get(4);
-                if (d == 0) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 1) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                } else if (d == 2) {
-                    uses_y[2] = true;
-                    nodes[size++] = Y2;
-                } else {
-                    uses_y[3] = true;
-                    nodes[size++] = Y3;
-                }
-
-            } else if (size > 1 && nodes[size-1] == Y0 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Mul ||
-                 nodes[size-2] == Sub ||
-                 nodes[size-2] == Add)) {
-                // avoid min(y, y)
-                int d = dec.get(4);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_x[2] = true;
-                    nodes[size++] = X2;
-                } else if (d == 3) {
-                    uses_x[3] = true;
-                    nodes[size++] = X3;
-                }
-            } else if (size > 1 && nodes[size-1] == Y1 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Mul ||
-                 nodes[size-2] == Sub ||
-                 nodes[size-2] == Add)) {
-                // avoid min(y, y)
-                int d = dec.get(4);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_x[2] = true;
-                    nodes[size++] = X2;
-                } else if (d == 3) {
-                    uses_x[3] = true;
-                    nodes[size++] = X3;
-                }
-            } else if (size > 1 && nodes[size-1] == Y2 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Mul ||
-                 nodes[size-2] == Sub ||
-                 nodes[size-2] == Add)) {
-                // avoid min(y, y)
-                int d = dec.get(4);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_x[2] = true;
-                    nodes[size++] = X2;
-                } else if (d == 3) {
-                    uses_x[3] = true;
-                    nodes[size++] = X3;
-                }
-            } else {
-                int d = dec.get(8);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_x[2] = true;
-                    nodes[size++] = X2;
-                } else if (d == 3) {
-                    uses_x[3] = true;
-                    nodes[size++] = X3;
-                } else if (d == 4) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 5) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                } else if (d == 6) {
-                    uses_y[2] = true;
-                    nodes[size++] = Y2;
-                } else {
-                    uses_y[3] = true;
-                    nodes[size++] = Y3;
-                }
-            }*/
-
-            if (size > 1 && nodes[size-1] == X0 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Sub ||
-                 nodes[size-2] == Add)) {
-                // avoid min(x, x)
-                int d = dec.get(7);
-                if (d == 0) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 1) {
-                    uses_x[2] = true;
-                    nodes[size++] = X2;
-                } else if (d == 2) {
-                    uses_x[3] = true;
-                    nodes[size++] = X3;
-                } else if (d == 3) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 4) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                } else if (d == 5) {
-                    uses_y[2] = true;
-                    nodes[size++] = Y2;
-                } else {
-                    uses_y[3] = true;
-                    nodes[size++] = Y3;
-                }
-
-            } else if (size > 1 && nodes[size-1] == X1 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Sub ||
-                 nodes[size-2] == Add)) {
-                int d = dec.get(7);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[2] = true;
-                    nodes[size++] = X2;
-                } else if (d == 2) {
-                    uses_x[3] = true;
-                    nodes[size++] = X3;
-                } else if (d == 3) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 4) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                } else if (d == 5) {
-                    uses_y[2] = true;
-                    nodes[size++] = Y2;
-                } else {
-                    uses_y[3] = true;
-                    nodes[size++] = Y3;
-                }
-            } else if (size > 1 && nodes[size-1] == X2 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Sub ||
-                 nodes[size-2] == Add)) {
-                int d = dec.get(7);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_x[3] = true;
-                    nodes[size++] = X3;
-                } else if (d == 3) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 4) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                } else if (d == 5) {
-                    uses_y[2] = true;
-                    nodes[size++] = Y2;
-                } else {
-                    uses_y[3] = true;
-                    nodes[size++] = Y3;
-                }
-
-            } else if (size > 1 && nodes[size-1] == X3 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Sub ||
-                 nodes[size-2] == Add)) {
-                // avoid min(x, x)
-                int d = dec.get(7);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_x[2] = true;
-                    nodes[size++] = X2;
-                } else if (d == 3) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 4) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                } else if (d == 5) {
-                    uses_y[2] = true;
-                    nodes[size++] = Y2;
-                } else {
-                    uses_y[3] = true;
-                    nodes[size++] = Y3;
-                }
-
-            } else if (size > 1 && nodes[size-1] == Y0 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Sub ||
-                 nodes[size-2] == Add)) {
-                // avoid min(y, y)
-                int d = dec.get(7);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_x[2] = true;
-                    nodes[size++] = X2;
-                } else if (d == 3) {
-                    uses_x[3] = true;
-                    nodes[size++] = X3;
-                } else if (d == 4) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                } else if (d == 5) {
-                    uses_y[2] = true;
-                    nodes[size++] = Y2;
-                } else {
-                    uses_y[3] = true;
-                    nodes[size++] = Y3;
-                }
-            } else if (size > 1 && nodes[size-1] == Y1 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Sub ||
-                 nodes[size-2] == Add)) {
-                // avoid min(y, y)
-                int d = dec.get(7);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_x[2] = true;
-                    nodes[size++] = X2;
-                } else if (d == 3) {
-                    uses_x[3] = true;
-                    nodes[size++] = X3;
-                } else if (d == 4) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 5) {
-                    uses_y[2] = true;
-                    nodes[size++] = Y2;
-                } else {
-                    uses_y[3] = true;
-                    nodes[size++] = Y3;
-                }
-            } else if (size > 1 && nodes[size-1] == Y2 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Sub ||
-                 nodes[size-2] == Add)) {
-                // avoid min(y, y)
-                int d = dec.get(7);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_x[2] = true;
-                    nodes[size++] = X2;
-                } else if (d == 3) {
-                    uses_x[3] = true;
-                    nodes[size++] = X3;
-                } else if (d == 4) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 5) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                } else {
-                    uses_y[3] = true;
-                    nodes[size++] = Y3;
-                }
-            } else if (size > 1 && nodes[size-1] == Y3 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Sub ||
-                 nodes[size-2] == Add)) {
-                // avoid min(y, y)
-                int d = dec.get(7);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_x[2] = true;
-                    nodes[size++] = X2;
-                } else if (d == 3) {
-                    uses_x[3] = true;
-                    nodes[size++] = X3;
-                } else if (d == 4) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 5) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                } else {
-                    uses_y[2] = true;
-                    nodes[size++] = Y2;
-                }
-            } else {
-                int d = dec.get(8);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_x[2] = true;
-                    nodes[size++] = X2;
-                } else if (d == 3) {
-                    uses_x[3] = true;
-                    nodes[size++] = X3;
-                } else if (d == 4) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 5) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                } else if (d == 6) {
-                    uses_y[2] = true;
-                    nodes[size++] = Y2;
+    // Build the index-th tree with the given number of leaves
+    void create(const Enumerator &enumerator, uint64_t leaves, uint64_t index) {
+        uint8_t codes[MAX_NODES];
+        size = enumerator.unrank(leaves, index, codes);
+        for (int j = 0; j < size; ++j) {
+            nodes[j] = (Node)codes[j];
+            // The variables alternate X0, Y0, X1, Y1, ...
+            if (nodes[j] < K0) {
+                if (nodes[j] % 2 == 0) {
+                    uses_x[nodes[j] / 2] = true;
                 } else {
-                    uses_y[3] = true;
-                    nodes[size++] = Y3;
+                    uses_y[nodes[j] / 2] = true;
                 }
             }
-        } else {
-            // TODO make a list of reasonable options
-            int d = dec.get(LastNode - Add) + Add;
-            nodes[size++] = Node(d);
-            switch(d) {
-            case Add:
-            case Mul:
-            case Min:
-            case Max:
-                {
-                    int leaves_on_right = dec.get(leaves/2) + 1;
-                    int leaves_on_left = leaves - leaves_on_right;
-                    create(dec, leaves_on_left);
-                    create(dec, leaves_on_right);
-                }
-                break;
-            case Sub:
-                {
-                    int leaves_on_right = dec.get(leaves - 1) + 1;
-                    int leaves_on_left = leaves - leaves_on_right;
-                    create(dec, leaves_on_left);
-                    create(dec, leaves_on_right);
-                }
-                break;
-            default:
-                std::cerr << "Unreachable\n";
-            }
         }
     }
 
@@ -744,85 +334,37 @@ public:
     }
 };
 
-bool generate_expr(int index, uint64_t leaves, uint64_t i, set<TupleExpr> &seen, TupleExpr &e) {
-    string shift = "";
-    for (int a = 0; a < index; ++a) {
-        shift += "\t";
-    }
-
-    e = TupleExpr();
-    DecisionSource dec;
-    dec.val = i;
-    e.create(dec, leaves);
-
-    if (dec.val == 0) {
-        if (seen.find(e) != seen.end()) {
-            return true;
-        }
-        seen.insert(e);
-        return false;
-    } else {
-        return true;
-    }
-}
-
-bool fast_check_associativity(vector<TupleExpr> &eqs, const set<AssocTuple> &associative_set) {
+bool fast_check_associativity(const vector<const Candidate<TupleExpr> *> &eqs, const HashSet<AssocTuple> &associative_set) {
     size_t size = eqs.size();
 
-    if (associative_set.find(AssocTuple(eqs)) != associative_set.end()) {
+    AssocTuple tuple;
+    for (size_t i = 0; i < size; ++i) {
+        tuple.exprs.push_back(eqs[i]->e);
+    }
+    if (associative_set.contains(tuple)) {
         // We've already proved it's associative, no need to redo things
         vector<Halide::Expr> temp(size);
         for (size_t i = 0; i < size; ++i) {
-            temp[i] = eqs[i].get_expr();
+            temp[i] = eqs[i]->expr;
         }
-        DEBUG_PRINT2 << "......Skip proven non-associative exprs: " << Halide::Tuple(temp) << "\n";
-        return false;
+        DEBUG_PRINT2 << "......Skip proven associative exprs: " << Halide::Tuple(temp) << "\n";
+        return true;
     }
 
-    bool associative = true;
-    bool uses_y = false, uses_x = false;
-    for (int trial = 0; trial < 250; trial++) {
-        vector<Value> xvalues(size), yvalues(size), zvalues(size);
-        for (size_t i = 0; i < size; ++i) {
-            xvalues[i] = random_value();
-            yvalues[i] = random_value();
-            zvalues[i] = random_value();
-        }
-        Value k = random_value();
-
-        // Check it depends on x and y in some meaningful way
-        vector<Value> v_xy(size), v_yz(size), v_xz(size);
-
-        for (size_t i = 0; i < size; ++i) {
-            v_xy[i] = eqs[i].evaluate(xvalues, yvalues, k);
-            v_yz[i] = eqs[i].evaluate(yvalues, zvalues, k);
-            v_xz[i] = eqs[i].evaluate(xvalues, zvalues, k);
-
-            if (v_xy[i] != v_xz[i]) {
-                uses_y = true;
-            }
-            if (v_xz[i] != v_yz[i]) {
-                uses_x = true;
-            }
-        }
-
-        // Check if it's associative
-        vector<Value> v_x_yz(size), v_xy_z(size);
-        for (size_t i = 0; i < size; ++i) {
-            v_x_yz[i] = eqs[i].evaluate(xvalues, v_yz, k);
-            v_xy_z[i] = eqs[i].evaluate(v_xy, zvalues, k);
-            if (v_x_yz[i] != v_xy_z[i]) {
-                associative = false;
-                break;
-            }
-        }
+    ASSERT(size <= MAX_TUPLE_SIZE, "Tuple is too large for the fast associativity check\n");
+    Program programs[MAX_TUPLE_SIZE];
+    for (size_t i = 0; i < size; ++i) {
+        programs[i] = eqs[i]->program;
     }
 
+    bool uses_y = false, uses_x = false;
+    bool associative = simd_check_associativity(programs, size, 250, uses_x, uses_y);
+
     bool skip = !(associative && uses_x && uses_y);
     if (skip) {
         vector<Halide::Expr> temp(size);
         for (size_t i = 0; i < size; ++i) {
-            temp[i] = eqs[i].get_expr();
+            temp[i] = eqs[i]->expr;
         }
         DEBUG_PRINT3 << "...Skip " << Halide::Tuple(temp) << "\t; associative? " << associative
                      << "; uses_x: " << uses_x << "; uses_y: " << uses_y << "\n";
@@ -844,10 +386,128 @@ Point morton_to_coordinate(uint32_t morton) {
     return {leaves, i};
 }
 
+// Per-worker search state. The associative sets only ever let the sweep skip
+// work it would otherwise redo, so giving each worker its own copy does not
+// change what is found.
+struct SweepState {
+    vector<HashSet<AssocTuple>> associative_sets;
+
+    SweepState() : associative_sets(9) {}
+};
+
+// A sub-range of i0 within one Morton tile
+struct SweepTask {
+    uint32_t morton;
+    uint64_t leaves_start, leaves_end;
+    uint64_t i_start, i_end;
+    uint64_t i0_start, i0_end;
+};
+
+struct SweepResult {
+    std::ostringstream out;
+    int valid = 0;
+};
+
+void sweep(const SweepTask &task, const CandidatePool<TupleExpr> &candidates, const DependencyGraphs &graphs,
+           SweepState &state, SweepResult &result) {
+    // Seed from the task so the random trials do not depend on which worker
+    // runs it or on what that worker ran before.
+    seed_random_value(task.morton * 1000003u + task.i0_start);
+
+    for (uint64_t leaves0 = task.leaves_start; leaves0 <= task.leaves_end; ++leaves0) {
+        const vector<Candidate<TupleExpr>> &pool0 = candidates[leaves0];
+        pair<size_t, size_t> range0 = candidates.range(leaves0, task.i0_start, task.i0_end);
+        for (size_t k0 = range0.first; k0 < range0.second; ++k0) {
+            const Candidate<TupleExpr> &c0 = pool0[k0];
+            // The later elements are only drawn from the rows that can still
+            // make the tuple non-decomposable
+            if (!graphs.allows(DependencyGraphs::kRoot, c0.row)) {
+                continue;
+            }
+            uint32_t prefix0 = graphs.extend(DependencyGraphs::kRoot, c0.row);
+
+            //Halide::Expr expr = (kXVars[0] * kYVars[0]) + (kXVars[1] * kYVars[2]);
+            //Halide::Expr expr = (kXVars[0] * kYVars[1]) + (kXVars[1] * kYVars[3]);
+            //Halide::Expr expr = (kXVars[2] * kYVars[0]) + (kXVars[3] * kYVars[2]);
+            /*Halide::Expr expr = (kXVars[2] * kYVars[1]) + (kXVars[3] * kYVars[3]);
+            if (equal(c0.expr, expr)) {
+                std::cout << "***FOUND EXPR after i0: " << c0.i << "; expr: " << c0.expr << "\n";
+                return 0;
+            }*/
+
+            //std::cout << "Leaves0: " << leaves0 << ", i0: " << c0.i << ", expr: " << c0.expr << ", valid: " << valid << "\n";
+
+            for (uint64_t leaves1 = task.leaves_start; leaves1 <= task.leaves_end; ++leaves1) {
+                const vector<Candidate<TupleExpr>> &pool1 = candidates[leaves1];
+                for (uint32_t row1 : SetBits(graphs.next_rows(prefix0))) {
+                    for (size_t k1 : candidates.with_row(leaves1, row1)) {
+                        const Candidate<TupleExpr> &c1 = pool1[k1];
+                        uint32_t prefix1 = graphs.extend(prefix0, c1.row);
+                        if (Halide::Internal::equal(c0.expr, c1.expr)) {
+                            DEBUG_PRINT2 << "......Skip leaves1 equal: " << leaves1 << ", i1: " << c1.i << "\n";
+                            continue;
+                        }
+                        //std::cout << "Leaves1: " << leaves1 << ", i1: " << c1.i << ", expr: " << c1.expr << "\n";
+
+                        for (uint64_t leaves2 = task.leaves_start; leaves2 <= task.leaves_end; ++leaves2) {
+                            const vector<Candidate<TupleExpr>> &pool2 = candidates[leaves2];
+                            for (uint32_t row2 : SetBits(graphs.next_rows(prefix1))) {
+                                for (size_t k2 : candidates.with_row(leaves2, row2)) {
+                                    const Candidate<TupleExpr> &c2 = pool2[k2];
+                                    uint32_t prefix2 = graphs.extend(prefix1, c2.row);
+                                    if (Halide::Internal::equal(c0.expr, c2.expr) ||
+                                        Halide::Internal::equal(c1.expr, c2.expr)) {
+                                        DEBUG_PRINT2 << "......Skip leaves2 equal: " << leaves2 << ", i2: " << c2.i << "\n";
+                                        continue;
+                                    }
+                                    //std::cout << "Leaves2: " << leaves2 << ", i2: " << c2.i << ", expr: " << c2.expr << "\n";
+
+                                    for (uint64_t leaves3 = task.leaves_start; leaves3 <= task.leaves_end; ++leaves3) {
+                                        const vector<Candidate<TupleExpr>> &pool3 = candidates[leaves3];
+                                        for (uint32_t row3 : SetBits(graphs.next_rows(prefix2))) {
+                                            for (size_t k3 : candidates.with_row(leaves3, row3)) {
+                                                const Candidate<TupleExpr> &c3 = pool3[k3];
+                                                if (Halide::Internal::equal(c0.expr, c3.expr) ||
+                                                    Halide::Internal::equal(c1.expr, c3.expr) ||
+                                                    Halide::Internal::equal(c2.expr, c3.expr)) {
+                                                    DEBUG_PRINT2 << "......Skip leaves3 equal: " << leaves3 << ", i3: " << c3.i << "\n";
+                                                    continue;
+                                                }
+                                                //std::cout << "Leaves3: " << leaves3 << ", i3: " << c3.i << ", expr: " << c3.expr << "\n";
+
+                                                // Check asssociativity
+                                                vector<const Candidate<TupleExpr> *> eqs = {&c0, &c1, &c2, &c3};
+                                                if (!candidates.is_canonical(eqs)) {
+                                                    DEBUG_PRINT2 << "......Skip relabeled tuple of leaves0: " << leaves0 << ", i0: " << c0.i << "\n";
+                                                    continue;
+                                                }
+                                                if (!fast_check_associativity(eqs, state.associative_sets[leaves0])) {
+                                                    vector<Halide::Expr> halide_exprs = {c0.expr, c1.expr, c2.expr, c3.expr};
+                                                    if (z3_check_associativity(halide_exprs, kXVars, kYVars, kConstants,
+                                                                               {leaves0, leaves1, leaves2, leaves3},
+                                                                               {c0.i, c1.i, c2.i, c3.i}, result.out)) {
+                                                        state.associative_sets[leaves0].insert(AssocTuple(c0.e, c1.e, c2.e, c3.e));
+                                                        result.valid++;
+                                                    }
+                                                }
+                                            }
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
 int main(int argc, char **argv) {
-    vector<set<TupleExpr>> seen(4);
+    start_prover_workers();
     uint32_t MORTON_MIN = 0;
     uint32_t MORTON_MAX = 0;
+    int num_threads = std::max(1u, std::thread::hardware_concurrency());
 
     if (argc > 1) {
         MORTON_MIN = atoi(argv[1]);
@@ -855,177 +515,58 @@ int main(int argc, char **argv) {
     if (argc > 2) {
         MORTON_MAX = atoi(argv[2]);
     }
-    std::cout << "Morton min: " << MORTON_MIN << ", Morton max: " << MORTON_MAX << "\n\n";
-
-    vector<IntervalSet> invalid(9);
-    vector<set<TupleExpr>> seen0(9);
+    if (argc > 3) {
+        num_threads = std::max(1, atoi(argv[3]));
+    }
+    std::cout << "Morton min: " << MORTON_MIN << ", Morton max: " << MORTON_MAX << "\n";
+    std::cout << "Threads: " << num_threads << "\n\n";
 
-    vector<set<AssocTuple>> associative_sets(9);
+    WorkStealingPool pool(num_threads);
+    vector<SweepState> states(pool.size());
+    // The dependency graphs a tuple may have without being decomposable
+    const DependencyGraphs graphs(4);
 
     for (uint32_t morton = MORTON_MIN; morton <= MORTON_MAX; ++morton) {
         Point point = morton_to_coordinate(morton);
         //uint64_t leaves_start = std::max(point.leaves, START_LEAVES);
         //uint64_t leaves_end =  std::min(point.leaves + LEAVES_TILE - 1, MAX_LEAVES);
         uint64_t leaves_start = 4, leaves_end = 4;
-        //uint64_t i_start = point.i;
-        uint64_t i_start = 50000;
-        uint64_t i_end = point.i + ITER_TILE - 1;
+        uint64_t i_start = point.i;
+        uint64_t i_end = kEnumerator.tile_end(leaves_start, leaves_end, i_start, ITER_TILE);
 
         std::cout << "Morton: " << morton << ", leaves: [" << leaves_start
                   << ", " << leaves_end << "], i: [" << i_start << ", "
                   << i_end << "]" << "\n";
 
-        int valid = 0, decomposable = 0;
-        Halide::Expr expr0, expr1, expr2, expr3;
-        for (uint64_t leaves0 = leaves_start; leaves0 <= leaves_end; ++leaves0) {
-            IntervalSet i0_range;
-            i0_range.insert(IntervalVal::closed(i_start, i_end));
-            i0_range -= invalid[leaves0];
-            for (auto it0 = i0_range.begin(); it0 != i0_range.end(); it0++) {
-                for (uint64_t i0 = it0->lower(); i0 <= it0->upper(); ++i0) {
-                    if (boost::icl::contains(invalid[leaves0], i0)) {
-                        DEBUG_PRINT2 << "...Skip leaves0: " << leaves0 << ", i0: " << i0 << "\n";
-                        continue;
-                    }
-
-                    TupleExpr e0;
-                    bool skip_e0 = generate_expr(0, leaves0, i0, seen0[leaves0], e0);
-                    expr0 = e0.get_expr();
-                    skip_e0 = skip_e0 || should_skip_expression(0, expr0, e0.fail, e0.uses_x, e0.uses_y, kXNames, kYNames, kConstantNames);
-                    if (skip_e0) {
-                        invalid[leaves0].insert(i0);
-                        continue;
-                    }
-
-                    //Halide::Expr expr = (kXVars[0] * kYVars[0]) + (kXVars[1] * kYVars[2]);
-                    //Halide::Expr expr = (kXVars[0] * kYVars[1]) + (kXVars[1] * kYVars[3]);
-                    //Halide::Expr expr = (kXVars[2] * kYVars[0]) + (kXVars[3] * kYVars[2]);
-                    /*Halide::Expr expr = (kXVars[2] * kYVars[1]) + (kXVars[3] * kYVars[3]);
-                    if (equal(expr0, expr)) {
-                        std::cout << "***FOUND EXPR after i0: " << i0 << "; expr: " << expr0 << "\n";
-                        return 0;
-                    }*/
-
-                    //std::cout << "Leaves0: " << leaves0 << ", i0: " << i0 << ", expr: " << expr0 << ", valid: " << valid << "\n";
-
-                    for (uint64_t leaves1 = leaves_start; leaves1 <= leaves_end; ++leaves1) {
-                        IntervalSet i1_range;
-                        i1_range.insert(IntervalVal::closed(i_start, i_end));
-                        //i1_range.insert(IntervalVal::closed(59206, 59206));
-                        i1_range -= invalid[leaves1];
-                        for (auto it1 = i1_range.begin(); it1 != i1_range.end(); it1++) {
-                            for (uint64_t i1 = it1->lower(); i1 <= it1->upper(); ++i1) {
-                                if (boost::icl::contains(invalid[leaves1], i1)) {
-                                    DEBUG_PRINT2 << "......Previously invalid skip leaves1: " << leaves1 << ", i1: " << i1 << "\n";
-                                    continue;
-                                }
-                                TupleExpr e1;
-                                bool skip_e1 = generate_expr(1, leaves1, i1, seen[1], e1);
-                                expr1 = e1.get_expr();
-                                if (Halide::Internal::equal(expr0, expr1)) {
-                                    DEBUG_PRINT2 << "......Skip leaves1 equal: " << leaves1 << ", i1: " << i1 << "\n";
-                                    continue;
-                                }
-                                skip_e1 = skip_e1 || should_skip_expression(1, expr0, e1.fail, e1.uses_x, e1.uses_y, kXNames, kYNames, kConstantNames);
-                                if (skip_e1) {
-                                    DEBUG_PRINT2 << "......Skip leaves1: " << leaves1 << ", i1: " << i1 << "\n";
-                                    invalid[leaves1].insert(i1);
-                                    continue;
-                                }
-                                //std::cout << "Leaves1: " << leaves1 << ", i1: " << i1 << ", expr: " << expr1 << "\n";
-
-                                for (uint64_t leaves2 = leaves_start; leaves2 <= leaves_end; ++leaves2) {
-                                    IntervalSet i2_range;
-                                    i2_range.insert(IntervalVal::closed(i_start, i_end));
-                                    //i2_range.insert(IntervalVal::closed(53014, 53014));
-                                    i2_range -= invalid[leaves2];
-                                    for (auto it2 = i2_range.begin(); it2 != i2_range.end(); it2++) {
-                                        for (uint64_t i2 = it2->lower(); i2 <= it2->upper(); ++i2) {
-                                            if (boost::icl::contains(invalid[leaves2], i2)) {
-                                                DEBUG_PRINT2 << "......Skip leaves2: " << leaves2 << ", i2: " << i2 << "\n";
-                                                continue;
-                                            }
-                                            TupleExpr e2;
-                                            bool skip_e2 = generate_expr(2, leaves2, i2, seen[2], e2);
-                                            expr2 = e2.get_expr();
-                                            if (Halide::Internal::equal(expr0, expr2) ||
-                                                Halide::Internal::equal(expr1, expr2)) {
-                                                DEBUG_PRINT2 << "......Skip leaves2 equal: " << leaves2 << ", i2: " << i2 << "\n";
-                                                continue;
-                                            }
-                                            skip_e2 = skip_e2 || should_skip_expression(2, expr2, e2.fail, e2.uses_x, e2.uses_y, kXNames, kYNames, kConstantNames);
-                                            if (skip_e2) {
-                                                invalid[leaves2].insert(i2);
-                                                continue;
-                                            }
-                                            //std::cout << "Leaves2: " << leaves2 << ", i2: " << i2 << ", expr: " << expr2 << "\n";
-
-                                            for (uint64_t leaves3 = leaves_start; leaves3 <= leaves_end; ++leaves3) {
-                                                IntervalSet i3_range;
-                                                i3_range.insert(IntervalVal::closed(i_start, i_end));
-                                                //i3_range.insert(IntervalVal::closed(61270, 61270));
-                                                i3_range -= invalid[leaves3];
-                                                for (auto it3 = i3_range.begin(); it3 != i3_range.end(); it3++) {
-                                                    for (uint64_t i3 = it3->lower(); i3 <= it3->upper(); ++i3) {
-                                                        if (boost::icl::contains(invalid[leaves3], i3)) {
-                                                            DEBUG_PRINT2 << "......Skip leaves3: " << leaves3 << ", i3: " << i3 << "\n";
-                                                            continue;
-                                                        }
-                                                        TupleExpr e3;
-                                                        bool skip_e3 = generate_expr(3, leaves3, i3, seen[3], e3);
-                                                        expr3 = e3.get_expr();
-                                                        if (Halide::Internal::equal(expr0, expr3) ||
-                                                            Halide::Internal::equal(expr1, expr3) ||
-                                                            Halide::Internal::equal(expr2, expr3)) {
-                                                            DEBUG_PRINT2 << "......Skip leaves3 equal: " << leaves3 << ", i3: " << i3 << "\n";
-                                                            continue;
-                                                        }
-                                                        skip_e3 = skip_e3 || should_skip_expression(3, expr3, e3.fail, e3.uses_x, e3.uses_y, kXNames, kYNames, kConstantNames);
-                                                        if (skip_e3) {
-                                                            invalid[leaves3].insert(i3);
-                                                            continue;
-                                                        }
-                                                        //std::cout << "Leaves3: " << leaves3 << ", i3: " << i3 << ", expr: " << expr3 << "\n";
-
-                                                        // Check asssociativity
-                                                        vector<TupleExpr> eqs = {e0, e1, e2, e3};
-                                                        if (!fast_check_associativity(eqs, associative_sets[leaves0])) {
-                                                            vector<Halide::Expr> halide_exprs = {expr0, expr1, expr2, expr3};
-                                                            vector<vector<bool>> eqs_uses_x = {e0.uses_x, e1.uses_x, e2.uses_x, e3.uses_x};
-                                                            vector<vector<bool>> eqs_uses_y = {e0.uses_y, e1.uses_y, e2.uses_y, e3.uses_y};
-                                                            //if (is_decomposable(eqs_uses_x, eqs_uses_y)) {
-                                                            //    DEBUG_PRINT2 << "......Skip decomposable exprs: " << Halide::Tuple(halide_exprs) << "\n";
-                                                            //    continue;
-                                                            //}
-                                                            if (z3_check_associativity(halide_exprs, kXVars, kYVars, kConstants,
-                                                                                       {leaves0, leaves1, leaves2, leaves3},
-                                                                                       {i0, i1, i2, i3})) {
-                                                                associative_sets[leaves0].insert(AssocTuple(e0, e1, e2, e3));
-                                                                valid++;
-                                                                if (is_decomposable(eqs_uses_x, eqs_uses_y)) {
-                                                                    std::cout << "......Skip decomposable exprs: " << Halide::Tuple(halide_exprs) << "\n\n";
-                                                                    decomposable++;
-                                                                    continue;
-                                                                }
-                                                            }
-                                                        }
-                                                    }
-                                                }
-                                            }
-                                            seen[3] = set<TupleExpr>();
-                                        }
-                                    }
-                                }
-                                seen[2] = set<TupleExpr>();
-                            }
-                        }
-                    }
-                    seen[1] = set<TupleExpr>();
-                }
-            }
+        // Every element of a tuple comes from this tile, so filter its
+        // candidates once up front
+        CandidatePool<TupleExpr> candidates(leaves_start, leaves_end);
+        candidates.build(pool, kEnumerator, i_start, i_end, kXNames, kYNames, kConstantNames);
+        DEBUG_PRINT << "Candidates: " << candidates.size() << "\n";
+
+        // Split the tile into chunks of i0
+        vector<SweepTask> tasks;
+        for (uint64_t i0 = i_start; i0 <= i_end; i0 += I0_CHUNK) {
+            tasks.push_back({morton, leaves_start, leaves_end, i_start, i_end,
+                             i0, std::min(i0 + I0_CHUNK - 1, i_end)});
         }
-        std::cout << "Valid: " << valid << ", decomposable: " << decomposable << "\n";
+        vector<SweepResult> results(tasks.size());
+
+        int valid = 0;
+        pool.run(tasks.size(),
+            [&](int worker, size_t t) {
+                sweep(tasks[t], candidates, graphs, states[worker], results[t]);
+            },
+            [&](size_t t) {
+                std::cout << results[t].out.str();
+                valid += results[t].valid;
+                results[t].out.str("");
+                std::cout.flush();
+            });
+
+        std::cout << "Valid: " << valid << "\n";
         std::cout << "**************************************************************************\n\n";
+        std::cout.flush();
     }
     return 0;
 }
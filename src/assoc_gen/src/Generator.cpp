@@ -1,7 +1,11 @@
 #include "Halide.h"
 #include "Error.h"
 #include "Utilities.h"
+#include "ProverWorkers.h"
+#include "Enumerator.h"
+#include "SimdEval.h"
 
+#include <chrono>
 #include <iostream>
 #include <cstdlib>
 #include <cassert>
@@ -24,7 +28,7 @@ vector<Halide::Expr> kXVars = {Variable::make(kType, "x0")};
 vector<Halide::Expr> kYVars = {Variable::make(kType, "y0")};
 vector<Halide::Expr> kConstants = {Variable::make(kType, "k0")};
 
-enum Node : long {
+enum Node : uint8_t {
     X0 = 0,
     Y0,
     K0,
@@ -36,191 +40,97 @@ enum Node : long {
     LastNode,
 };
 
+// The leaves that may follow 'prev' and 'prevprev' in the prefix node list
+int leaf_choices(int prev, int prevprev, uint8_t *choices) {
+    bool after_op = (prevprev == Min) || (prevprev == Max) || (prevprev == Add) || (prevprev == Sub);
+    int n = 0;
+    if (after_op && (prev == X0)) {
+        // avoid min(x, x)
+        choices[n++] = K0;
+        choices[n++] = Y0;
+    } else if (after_op && (prev == Y0)) {
+        // avoid min(y, y)
+        choices[n++] = K0;
+        choices[n++] = X0;
+    } else if ((prevprev != Enumerator::NONE) && (prev == K0)) {
+        choices[n++] = Y0;
+        choices[n++] = X0;
+    } else {
+        choices[n++] = X0;
+        choices[n++] = Y0;
+        choices[n++] = K0;
+    }
+    return n;
+}
+
 class SingleExpr : public Expr {
 public:
     SingleExpr() : Expr(1) {}
 
-    Value evaluate_term(const vector<Value> &xvalues, const vector<Value> &yvalues, Value k, int &cursor) const {
-        Value v1, v2;
+    void compile_term(Program &p, int &cursor) const {
         switch(nodes[cursor++]) {
         case X0:
-            return xvalues[0];
+            p.push(OpCode::LoadX, 0);
+            break;
         case Y0:
-            return yvalues[0];
+            p.push(OpCode::LoadY, 0);
+            break;
         case K0:
-            return k;
+            p.push(OpCode::LoadK);
+            break;
         case Add:
-            v1 = evaluate_term(xvalues, yvalues, k, cursor);
-            v2 = evaluate_term(xvalues, yvalues, k, cursor);
-            return v1 + v2;
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Add);
+            break;
         case Sub:
-            v1 = evaluate_term(xvalues, yvalues, k, cursor);
-            v2 = evaluate_term(xvalues, yvalues, k, cursor);
-            return v1 - v2;
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Sub);
+            break;
         case Mul:
-            v1 = evaluate_term(xvalues, yvalues, k, cursor);
-            v2 = evaluate_term(xvalues, yvalues, k, cursor);
-            return v1 * v2;
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Mul);
+            break;
         case Min:
-            v1 = evaluate_term(xvalues, yvalues, k, cursor);
-            v2 = evaluate_term(xvalues, yvalues, k, cursor);
-            return std::min(v1, v2);
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Min);
+            break;
         case Max:
-            v1 = evaluate_term(xvalues, yvalues, k, cursor);
-            v2 = evaluate_term(xvalues, yvalues, k, cursor);
-            return std::max(v1, v2);
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Max);
+            break;
         default:
-            return 0;
+            break;
         }
     }
 
-    Value evaluate(const vector<Value> &xvalues, const vector<Value> &yvalues, Value k) const {
+    // Flatten the prefix node list into a postfix program, so that the
+    // random trials of the fast associativity check run without recursion
+    Program compile() const {
+        Program p;
         int cursor = 0;
-        return evaluate_term(xvalues, yvalues, k, cursor);
+        compile_term(p, cursor);
+        return p;
     }
 
-    void create(DecisionSource &dec, int leaves) {
-        assert(size < 64);
-        assert(leaves > 0);
-        if (leaves == 1) {
-            /*if (size > 1 && nodes[size-1] == X0 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Add ||
-                 nodes[size-2] == Sub)) {
-                // avoid min(x, x)
-                if (dec.get(2)) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
+    // Build the index-th tree with the given number of leaves
+    void create(const Enumerator &enumerator, uint64_t leaves, uint64_t index) {
+        uint8_t codes[MAX_NODES];
+        size = enumerator.unrank(leaves, index, codes);
+        for (int j = 0; j < size; ++j) {
+            nodes[j] = (Node)codes[j];
+            // The variables alternate X0, Y0, X1, Y1, ...
+            if (nodes[j] < K0) {
+                if (nodes[j] % 2 == 0) {
+                    uses_x[nodes[j] / 2] = true;
                 } else {
-                    nodes[size++] = K0;
-                }
-            } else if (size > 1 && nodes[size-1] == Y0 &&
-                       (nodes[size-2] == Min ||
-                        nodes[size-2] == Max ||
-                        nodes[size-2] == Add ||
-                        nodes[size-2] == Sub)) {
-                // avoid min(y, y)
-                uses_x[0] = true;
-                nodes[size++] = X0;
-            } else if (size > 1 && nodes[size-1] == K0) {
-                uses_x[0] = true;
-                nodes[size++] = X0;
-            } else {
-                int code = dec.get(3);
-                if (code == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (code == 1) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else {
-                    nodes[size++] = K0;
-                }
-            }*/
-
-            if (size > 1 && nodes[size-1] == X0 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Add ||
-                 nodes[size-2] == Sub)) {
-                // avoid min(x, x)
-                if (dec.get(2)) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else {
-                    nodes[size++] = K0;
-                }
-            } else if (size > 1 && nodes[size-1] == Y0 &&
-                       (nodes[size-2] == Min ||
-                        nodes[size-2] == Max ||
-                        nodes[size-2] == Add ||
-                        nodes[size-2] == Sub)) {
-                // avoid min(y, y)
-                if (dec.get(2)) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else {
-                    nodes[size++] = K0;
-                }
-            } else if (size > 1 && nodes[size-1] == K0) {
-                if (dec.get(2)) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                }
-            } else {
-                int code = dec.get(3);
-                if (code == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (code == 1) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else {
-                    nodes[size++] = K0;
+                    uses_y[nodes[j] / 2] = true;
                 }
             }
-
-            // No constants
-            /*if (size > 1 && nodes[size-1] == X0 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Add ||
-                 nodes[size-2] == Sub)) {
-                // avoid min(x, x)
-                uses_y[0] = true;
-                nodes[size++] = Y0;
-            } else if (size > 1 && nodes[size-1] == Y0 &&
-                       (nodes[size-2] == Min ||
-                        nodes[size-2] == Max ||
-                        nodes[size-2] == Add ||
-                        nodes[size-2] == Sub)) {
-                // avoid min(y, y)
-                uses_x[0] = true;
-                nodes[size++] = X0;
-            } else if (size > 1 && nodes[size-1] == K0) {
-                uses_x[0] = true;
-                nodes[size++] = X0;
-            } else {
-                int code = dec.get(2);
-                if (code == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                }
-            }*/
-        } else {
-            // TODO make a list of reasonable options
-            int d = dec.get(LastNode - Add) + Add;
-            nodes[size++] = Node(d);
-            switch(d) {
-            case Add:
-            case Mul:
-            case Min:
-            case Max:
-                {
-                    int leaves_on_right = dec.get(leaves/2) + 1;
-                    int leaves_on_left = leaves - leaves_on_right;
-                    create(dec, leaves_on_left);
-                    create(dec, leaves_on_right);
-                }
-                break;
-            case Sub:
-                {
-                    int leaves_on_right = dec.get(leaves - 1) + 1;
-                    int leaves_on_left = leaves - leaves_on_right;
-                    create(dec, leaves_on_left);
-                    create(dec, leaves_on_right);
-                }
-                break;
-            default:
-                std::cerr << "Unreachable\n";
-            }
         }
     }
 
@@ -342,9 +252,7 @@ public:
 };
 
 int main(int argc, char **argv) {
-    vector<SingleExpr> leave_start_expr;
-    leave_start_expr.reserve(32);
-
+    start_prover_workers();
     uint64_t MIN_LEAVES = 8;
     uint64_t MAX_LEAVES = 8;
     if (argc > 1) {
@@ -356,92 +264,56 @@ int main(int argc, char **argv) {
     std::cout << "Running single element generator of type: " << kType << "\n";
     std::cout << "Min leaves: " << MIN_LEAVES << ", max leaves: " << MAX_LEAVES << "\n\n";
 
-    uint64_t fails = 0, valid = 0;
-    uint64_t leaves = MIN_LEAVES;
-    std::cout << "\n******************************************************************\n";
-    std::cout << "Leaves: " << leaves << "\n";
-    for (uint64_t i = 0;; i++) {
-        SingleExpr e;
-        DecisionSource dec;
-        dec.val = i;
-        e.create(dec, leaves);
+    const Enumerator enumerator({{Add, true}, {Sub, false}, {Mul, true}, {Min, true}, {Max, true}},
+                                leaf_choices, MAX_LEAVES);
 
-        //std::cout << "Leaves: " << leaves << ", i: " << i << ", expr: " << e.get_expr() << ", valid: " << valid << "\n";
+    uint64_t valid = 0;
+    for (uint64_t leaves = MIN_LEAVES; leaves <= MAX_LEAVES; ++leaves) {
+        auto start = std::chrono::steady_clock::now();
+        std::cout << "\n******************************************************************\n";
+        std::cout << "Leaves: " << leaves << "\n";
+        std::cout.flush();
 
-        //Halide::Expr expected = Halide::max(Halide::min(kXVars[0], kConstants[0]), kYVars[0]);
-        /*Halide::Expr expected = Halide::min(kXVars[0], kConstants[0]);
-        if (equal(e.get_expr(), expected)) {
-            std::cout << "***FOUND EXPR after i: " << i << "; expr: " << expected << "\n";
-            return 0;
-        }*/
+        uint64_t fails = 0;
+        uint64_t num_trees = enumerator.count(leaves);
+        for (uint64_t i = 0; i < num_trees; i++) {
+            SingleExpr e;
+            e.create(enumerator, leaves, i);
 
-        bool repeat = false;
-        if (leave_start_expr.size() < leaves) {
-            leave_start_expr.push_back(e);
-        } else {
-            SingleExpr prev = leave_start_expr[leaves - 1];
-            repeat = (prev == e);
-        }
-        if (repeat) {
-            std::cout << "Total: " << i << ", fails: " << fails << ", repeat at: " << e.get_expr() << "\n";
-            std::cout << "Valid: " << valid << "\n";
-            std::cout << "**************************************************************************\n";
-            leaves++;
-            i = 0;
-            fails = 0;
-            std::cout << "\n******************************************************************\n";
-            std::cout << "Leaves: " << leaves << "\n";
-            std::cout.flush();
-            dec.val = i;
-            e = SingleExpr();
-            e.create(dec, leaves);
-            assert(leave_start_expr.size() < leaves);
-            leave_start_expr.push_back(e);
-        }
-
-        if (leaves > MAX_LEAVES) {
-            return 0;
-        }
+            //std::cout << "Leaves: " << leaves << ", i: " << i << ", expr: " << e.get_expr() << ", valid: " << valid << "\n";
 
-        bool skip = should_skip_expression(0, e.get_expr(), e.fail, e.uses_x, e.uses_y, kXNames, kYNames, kConstantNames);
-        if (skip) {
-            continue;
-        }
+            //Halide::Expr expected = Halide::max(Halide::min(kXVars[0], kConstants[0]), kYVars[0]);
+            /*Halide::Expr expected = Halide::min(kXVars[0], kConstants[0]);
+            if (equal(e.get_expr(), expected)) {
+                std::cout << "***FOUND EXPR after i: " << i << "; expr: " << expected << "\n";
+                return 0;
+            }*/
 
-        bool associative = true;
-        bool uses_x = false, uses_y = false;
-        for (int trial = 0; trial < 250; trial++) {
-            Value x = random_value(), y = random_value(), z = random_value(), k = random_value();
-            // Check it depends on x and y in some meaningful way
-            Value v_xy = e.evaluate({x}, {y}, k);
-            Value v_yz = e.evaluate({y}, {z}, k);
-            Value v_xz = e.evaluate({x}, {z}, k);
-            if (v_xy != v_xz) {
-                uses_y = true;
-            }
-            if (v_xz != v_yz) {
-                uses_x = true;
+            bool skip = should_skip_expression(0, e.get_expr(), e.fail, e.uses_x, e.uses_y, kXNames, kYNames, kConstantNames);
+            if (skip) {
+                continue;
             }
 
-            // Check it's associative
-            Value v_x_yz = e.evaluate({x}, {v_yz}, k);
-            Value v_xy_z = e.evaluate({v_xy}, {z}, k);
-            if (v_x_yz != v_xy_z) {
-                associative = false;
-                break;
-            }
-        }
+            bool uses_x = false, uses_y = false;
+            Program program = e.compile();
+            bool associative = simd_check_associativity(&program, 1, 250, uses_x, uses_y);
 
-        if (associative && uses_x && uses_y) {
-            vector<Halide::Expr> halide_exprs = {e.get_expr()};
-            if (z3_check_associativity(halide_exprs, kXVars, kYVars, kConstants, {leaves}, {i})) {
-                valid++;
+            if (associative && uses_x && uses_y) {
+                vector<Halide::Expr> halide_exprs = {e.get_expr()};
+                if (z3_check_associativity(halide_exprs, kXVars, kYVars, kConstants, {leaves}, {i})) {
+                    valid++;
+                }
+            } else {
+                fails++;
+                DEBUG_PRINT2 << "...Skip " << i << ": " << e.get_expr() << "\t; uses_x: " << uses_x
+                             << "; uses_y: " << uses_y << "; associative: " << associative << "\n";
             }
-        } else {
-            fails++;
-            DEBUG_PRINT2 << "...Skip " << i << ": " << e.get_expr() << "\t; uses_x: " << uses_x
-                         << "; uses_y: " << uses_y << "; associative: " << associative << "\n";
         }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Total: " << num_trees << ", fails: " << fails << "\n";
+        std::cout << "Valid: " << valid << "\n";
+        std::cout << "Time: " << seconds << " s\n";
+        std::cout << "**************************************************************************\n";
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -2,7 +2,9 @@
 #include "Z3OpsHelper.h"
 #include "Error.h"
 
+#include <cmath>
 #include <map>
+#include <unordered_map>
 
 using namespace Halide;
 using namespace Halide::Internal;
@@ -17,7 +19,13 @@ class HalideToZ3 : public IRVisitor {
 private:
     z3::context *ctx_ptr;
     bool use_bv;
+    int narrow_bits;
+    FloatSemantics floats;
     map<string, z3::expr> variables; // Map of name -> z3 variables we have made so far
+    // Map of IR node -> z3 expr it was converted to. The associativity
+    // conjecture substitutes f into itself, so the same nodes appear under
+    // many parents; each is only converted once.
+    std::unordered_map<const IRNode *, z3::expr> converted;
 
     void error() {
         ASSERT(false, "Can't convert to z3 expr\n");
@@ -25,24 +33,44 @@ private:
 
     void assert_type(Type t) {
         ASSERT(t.is_scalar(), "Can only handle scalar variable");
-        ASSERT(t.is_int() || t.is_uint(),
-               "Can only handle int/uint variable");
-        //TODO(psuriana): floating-point to be implemented later
+        ASSERT(t.is_int() || t.is_uint() || t.is_float(),
+               "Can only handle int/uint/float variable");
+    }
+
+    // Whether ops on values of type 't' are IEEE float ops
+    bool is_ieee(Type t) const {
+        return t.is_float() && (floats == FloatSemantics::IEEE);
+    }
+
+    // The real 'value', which must be finite
+    z3::expr real_val(double value) {
+        ASSERT(std::isfinite(value), "Reals can't represent " << value << "\n");
+        z3::expr fp = z3::fp_val(*ctx_ptr, value, 64);
+        return z3::expr(*ctx_ptr, Z3_mk_fpa_to_real(*ctx_ptr, fp)).simplify();
+    }
+
+    int bits_of(Type t) const {
+        return (narrow_bits != 0) ? narrow_bits : t.bits();
     }
 
 public:
     z3::expr expr;
 
-    HalideToZ3(z3::context *c, bool use_bv) : ctx_ptr(c), use_bv(use_bv), expr(*c) {}
+    HalideToZ3(z3::context *c, bool use_bv, int narrow_bits, FloatSemantics floats)
+        : ctx_ptr(c), use_bv(use_bv), narrow_bits(narrow_bits), floats(floats), expr(*c) {}
 
     ~HalideToZ3() { ctx_ptr = nullptr; }
 
     z3::expr mutate(Expr e) {
         ASSERT(e.defined(), "HalideToZ3 can't convert undefined expr\n");
         assert_type(e.type());
-        if (e.defined()) {
-            e.accept(this);
+        const auto &iter = converted.find(e.get());
+        if (iter != converted.end()) {
+            expr = iter->second;
+            return expr;
         }
+        e.accept(this);
+        converted.emplace(e.get(), expr);
         return expr;
     }
 
@@ -91,21 +119,47 @@ protected:
 };
 
 void HalideToZ3::visit(const IntImm *op) {
-    expr = ctx_ptr->bv_val((int)op->value, op->type.bits());
+    expr = ctx_ptr->bv_val((int)op->value, bits_of(op->type));
 }
 
 void HalideToZ3::visit(const UIntImm *op) {
-    expr = ctx_ptr->bv_val((unsigned)op->value, op->type.bits());
+    expr = ctx_ptr->bv_val((unsigned)op->value, bits_of(op->type));
 }
 
 void HalideToZ3::visit(const FloatImm *op) {
-    //TODO(psuriana): support floating point
-    ASSERT(false, "Other types besides int/uint are not currently supported\n");
+    if (is_ieee(op->type)) {
+        expr = z3::fp_val(*ctx_ptr, op->value, op->type.bits());
+    } else {
+        expr = real_val(op->value);
+    }
 }
 
 void HalideToZ3::visit(const Cast *op) {
     z3::expr value = mutate(op->value);
-    expr = bvcast(value, op->value.type().bits(), op->type.bits(), !op->type.is_uint());
+    const Type &from = op->value.type();
+    const Type &to = op->type;
+    if (!from.is_float() && !to.is_float()) {
+        expr = bvcast(value, bits_of(from), bits_of(to), !to.is_uint());
+    } else if (from.is_float() && to.is_float()) {
+        expr = is_ieee(to) ? z3::fp_cast(value, to.bits()) : value;
+    } else if (to.is_float()) {
+        if (is_ieee(to)) {
+            expr = z3::bv_to_fp(value, to.bits(), from.is_int());
+        } else {
+            z3::expr i(*ctx_ptr, Z3_mk_bv2int(*ctx_ptr, value, from.is_int()));
+            expr = z3::expr(*ctx_ptr, Z3_mk_int2real(*ctx_ptr, i));
+        }
+    } else {
+        if (is_ieee(from)) {
+            expr = z3::fp_to_bv(value, bits_of(to), to.is_int());
+        } else {
+            // Truncate towards zero; real2int rounds down
+            z3::expr down(*ctx_ptr, Z3_mk_real2int(*ctx_ptr, value));
+            z3::expr up = -z3::expr(*ctx_ptr, Z3_mk_real2int(*ctx_ptr, -value));
+            z3::expr i = z3::ite(value >= 0, down, up);
+            expr = z3::expr(*ctx_ptr, Z3_mk_int2bv(*ctx_ptr, bits_of(to), i));
+        }
+    }
 }
 
 void HalideToZ3::visit(const Variable *op) {
@@ -119,11 +173,12 @@ void HalideToZ3::visit(const Variable *op) {
             if (!use_bv && op->type.bits() >= 32) {
                 expr = ctx_ptr->int_const(op->name.c_str());
             } else {
-                expr = ctx_ptr->bv_const(op->name.c_str(), op->type.bits());
+                expr = ctx_ptr->bv_const(op->name.c_str(), bits_of(op->type));
             }
+        } else if (is_ieee(op->type)) {
+            expr = ctx_ptr->constant(op->name.c_str(), z3::fp_sort(*ctx_ptr, op->type.bits()));
         } else {
-            //TODO(psuriana): support floating point
-            ASSERT(false, "Other types besides int/uint are not currently supported\n");
+            expr = ctx_ptr->real_const(op->name.c_str());
         }
         variables.emplace(op->name, expr);
     }
@@ -132,19 +187,31 @@ void HalideToZ3::visit(const Variable *op) {
 void HalideToZ3::visit(const Add *op) {
     z3::expr a = mutate(op->a);
     z3::expr b = mutate(op->b);
-    expr = a + b;
+    if (is_ieee(op->type)) {
+        expr = z3::fp_add(a, b);
+    } else {
+        expr = a + b;
+    }
 }
 
 void HalideToZ3::visit(const Sub *op) {
     z3::expr a = mutate(op->a);
     z3::expr b = mutate(op->b);
-    expr = a - b;
+    if (is_ieee(op->type)) {
+        expr = z3::fp_sub(a, b);
+    } else {
+        expr = a - b;
+    }
 }
 
 void HalideToZ3::visit(const Mul *op) {
     z3::expr a = mutate(op->a);
     z3::expr b = mutate(op->b);
-    expr = a * b;
+    if (is_ieee(op->type)) {
+        expr = z3::fp_mul(a, b);
+    } else {
+        expr = a * b;
+    }
 }
 
 void HalideToZ3::visit(const Div *op) {
@@ -152,6 +219,8 @@ void HalideToZ3::visit(const Div *op) {
     z3::expr b = mutate(op->b);
     if (op->type.is_uint()) {
         expr = z3::udiv(a, b);
+    } else if (is_ieee(op->type)) {
+        expr = z3::fp_div(a, b);
     } else {
         expr = a / b;
     }
@@ -164,6 +233,12 @@ void HalideToZ3::visit(const Mod *op) {
         expr = z3::bvumod(a, b);
     } else if (op->type.is_int()) {
         expr = z3::bvsmod(a, b);
+    } else if (is_ieee(op->type)) {
+        expr = z3::fp_mod(a, b);
+    } else if (op->type.is_float()) {
+        // a - b * floor(a / b)
+        z3::expr floor(*ctx_ptr, Z3_mk_int2real(*ctx_ptr, Z3_mk_real2int(*ctx_ptr, a / b)));
+        expr = a - b * floor;
     } else {
         expr = z3::mod(a, b);
     }
@@ -174,6 +249,8 @@ void HalideToZ3::visit(const Min *op) {
     z3::expr b = mutate(op->b);
     if (op->type.is_uint()) {
         expr = z3::umin(a, b);
+    } else if (is_ieee(op->type)) {
+        expr = z3::fp_min(a, b);
     } else {
         expr = z3::min(a, b);
     }
@@ -184,6 +261,8 @@ void HalideToZ3::visit(const Max *op) {
     z3::expr b = mutate(op->b);
     if (op->type.is_uint()) {
         expr = z3::umax(a, b);
+    } else if (is_ieee(op->type)) {
+        expr = z3::fp_max(a, b);
     } else {
         expr = z3::max(a, b);
     }
@@ -192,13 +271,21 @@ void HalideToZ3::visit(const Max *op) {
 void HalideToZ3::visit(const EQ *op) {
     z3::expr a = mutate(op->a);
     z3::expr b = mutate(op->b);
-    expr = (a == b);
+    if (is_ieee(op->a.type())) {
+        expr = z3::fp_equal(a, b);
+    } else {
+        expr = (a == b);
+    }
 }
 
 void HalideToZ3::visit(const NE *op) {
     z3::expr a = mutate(op->a);
     z3::expr b = mutate(op->b);
-    expr = (a != b);
+    if (is_ieee(op->a.type())) {
+        expr = !z3::fp_equal(a, b);
+    } else {
+        expr = (a != b);
+    }
 }
 
 void HalideToZ3::visit(const LT *op) {
@@ -206,6 +293,8 @@ void HalideToZ3::visit(const LT *op) {
     z3::expr b = mutate(op->b);
     if (op->a.type().is_uint()) {
         expr = z3::ult(a, b);
+    } else if (is_ieee(op->a.type())) {
+        expr = z3::fp_lt(a, b);
     } else {
         expr = (a < b);
     }
@@ -216,6 +305,8 @@ void HalideToZ3::visit(const LE *op) {
     z3::expr b = mutate(op->b);
     if (op->a.type().is_uint()) {
         expr = z3::ule(a, b);
+    } else if (is_ieee(op->a.type())) {
+        expr = z3::fp_le(a, b);
     } else {
         expr = (a <= b);
     }
@@ -226,6 +317,8 @@ void HalideToZ3::visit(const GT *op) {
     z3::expr b = mutate(op->b);
     if (op->a.type().is_uint()) {
         expr = z3::ugt(a, b);
+    } else if (is_ieee(op->a.type())) {
+        expr = z3::fp_gt(a, b);
     } else {
         expr = (a > b);
     }
@@ -236,6 +329,8 @@ void HalideToZ3::visit(const GE *op) {
     z3::expr b = mutate(op->b);
     if (op->a.type().is_uint()) {
         expr = z3::uge(a, b);
+    } else if (is_ieee(op->a.type())) {
+        expr = z3::fp_ge(a, b);
     } else {
         expr = (a >= b);
     }
@@ -267,15 +362,16 @@ void HalideToZ3::visit(const Select *op) {
 
 } // anonymous namespace
 
-z3::expr convert_halide_to_z3(Expr e, z3::context *ctx_ptr, bool use_bv) {
-    HalideToZ3 converter(ctx_ptr, use_bv);
+z3::expr convert_halide_to_z3(Expr e, z3::context *ctx_ptr, bool use_bv, int bits, FloatSemantics floats) {
+    HalideToZ3 converter(ctx_ptr, use_bv, bits, floats);
     e.accept(&converter);
     return converter.expr;
 }
 
 namespace {
 
-void basic_tests(Type t, z3::context *ctx_ptr, const vector<Expr> &additional_tests) {
+void basic_tests(Type t, z3::context *ctx_ptr, const vector<Expr> &additional_tests,
+                 FloatSemantics floats = FloatSemantics::IEEE) {
     Expr x = Variable::make(t, "x");
     Expr y = Variable::make(t, "y");
     Expr z = Variable::make(t, "z");
@@ -303,7 +399,7 @@ void basic_tests(Type t, z3::context *ctx_ptr, const vector<Expr> &additional_te
     halide_exprs.insert(halide_exprs.end(), additional_tests.begin(), additional_tests.end());
     for (const auto &e : halide_exprs) {
         std::cout << "Halide expr: " << e << ", ";
-        z3::expr z3_expr = convert_halide_to_z3(e, ctx_ptr, true);
+        z3::expr z3_expr = convert_halide_to_z3(e, ctx_ptr, true, 0, floats);
         std::cout << "\tZ3 expr: " << z3_expr << "\n";
     }
 }
@@ -350,4 +446,21 @@ void halide_to_z3_test() {
         std::cout << "\nRun tests for unsigned integers\n";
         basic_tests(t, &ctx, additional_tests);
     }
+
+    {
+        // Float
+        Type t = Float(32);
+        Expr x = Variable::make(t, "x");
+
+        vector<Expr> additional_tests = {
+            FloatImm::make(t, 1.5),
+            Cast::make(Float(64), x),
+            Cast::make(Int(32), x),
+            Cast::make(t, Variable::make(Int(32), "i")),
+        };
+        std::cout << "\nRun tests for floats\n";
+        basic_tests(t, &ctx, additional_tests);
+        std::cout << "\nRun tests for floats as reals\n";
+        basic_tests(t, &ctx, additional_tests, FloatSemantics::REAL);
+    }
 }
@@ -10,12 +10,29 @@
 #include "z3++.h"
 
 
+/**
+ * How floats are represented in Z3: as IEEE floats of their width, which
+ * round every op, or as reals. Under the latter, a float operator is
+ * associative if it would be with exact arithmetic, i.e. associative up to
+ * the rounding error of reassociating it (which is what e.g. summing floats
+ * in parallel assumes).
+ */
+enum class FloatSemantics {
+	IEEE = 0,
+	REAL = 1
+};
+
 /**
  * Convert a Halide Expr into an equivalent Z3 Expr. All integers (signed or
- * unsigned) are represented as bitvectors with appropriate bit size.
+ * unsigned) are represented as bitvectors with appropriate bit size. If
+ * 'bits' is non-zero, every integer type is narrowed to that many bits
+ * instead (so casts between them become no-ops); the result is then only an
+ * approximation of 'e', cheaper to bit-blast. Floats are represented as
+ * given by 'floats'.
  *
  */
-z3::expr convert_halide_to_z3(Halide::Expr e, z3::context *ctx, bool use_bv);
+z3::expr convert_halide_to_z3(Halide::Expr e, z3::context *ctx, bool use_bv, int bits = 0,
+                              FloatSemantics floats = FloatSemantics::IEEE);
 
 void halide_to_z3_test();
 
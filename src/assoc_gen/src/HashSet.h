@@ -0,0 +1,107 @@
+#ifndef HASH_SET_H
+#define HASH_SET_H
+
+/** \file
+ *
+ * Open-addressing hash set used by the generators to dedup candidate
+ * expressions and already-proven tuples.
+ */
+
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Set of T with linear probing over a power-of-two table. T must provide
+ * 'uint64_t hash() const' and operator==; a hash match is always confirmed
+ * with a full equality check, so colliding keys are kept apart.
+ */
+template<class T>
+class HashSet {
+    static const size_t kMinCapacity = 16;
+
+    // 0 marks an empty slot; stored hashes are forced to be non-zero
+    std::vector<uint64_t> hashes;
+    std::vector<T> keys;
+    size_t count;
+
+    static uint64_t hash_of(const T &key) {
+        uint64_t h = key.hash();
+        return (h == 0) ? 1 : h;
+    }
+
+    // Slot holding 'key', or the empty slot where it would go
+    size_t probe(const T &key, uint64_t h) const {
+        size_t mask = hashes.size() - 1;
+        size_t idx = h & mask;
+        while ((hashes[idx] != 0) && ((hashes[idx] != h) || !(keys[idx] == key))) {
+            idx = (idx + 1) & mask;
+        }
+        return idx;
+    }
+
+    void grow() {
+        std::vector<uint64_t> old_hashes(hashes.size() * 2, 0);
+        std::vector<T> old_keys(keys.size() * 2);
+        old_hashes.swap(hashes);
+        old_keys.swap(keys);
+        size_t mask = hashes.size() - 1;
+        for (size_t i = 0; i < old_hashes.size(); ++i) {
+            if (old_hashes[i] != 0) {
+                size_t idx = old_hashes[i] & mask;
+                while (hashes[idx] != 0) {
+                    idx = (idx + 1) & mask;
+                }
+                hashes[idx] = old_hashes[i];
+                keys[idx] = old_keys[i];
+            }
+        }
+    }
+
+public:
+    HashSet() : hashes(kMinCapacity, 0), keys(kMinCapacity), count(0) {}
+
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    bool contains(const T &key) const {
+        uint64_t h = hash_of(key);
+        return hashes[probe(key, h)] != 0;
+    }
+
+    // Return true if 'key' was not in the set yet
+    bool insert(const T &key) {
+        // Keep the load factor under 1/2 so probe sequences stay short
+        if (2 * (count + 1) > hashes.size()) {
+            grow();
+        }
+        uint64_t h = hash_of(key);
+        size_t idx = probe(key, h);
+        if (hashes[idx] != 0) {
+            return false;
+        }
+        hashes[idx] = h;
+        keys[idx] = key;
+        count++;
+        return true;
+    }
+
+    void clear() {
+        // Don't hold on to (and keep re-zeroing) a table sized for a much
+        // larger fill than the one it is being reset after
+        if (hashes.size() > 8 * std::max(count, kMinCapacity)) {
+            HashSet().swap(*this);
+            return;
+        }
+        std::fill(hashes.begin(), hashes.end(), 0);
+        count = 0;
+    }
+
+    void swap(HashSet &other) {
+        hashes.swap(other.hashes);
+        keys.swap(other.keys);
+        std::swap(count, other.count);
+    }
+};
+
+#endif
@@ -0,0 +1,305 @@
+#ifndef PROOF_CACHE_H
+#define PROOF_CACHE_H
+
+/** \file
+ *
+ * Persistent cache of the prover's verdicts, so that a sweep does not
+ * re-prove the operators an earlier run (of any generator) already settled.
+ * It is a hash table kept in a memory-mapped file: records are written in
+ * place and outlive the process even if it is killed. Any number of
+ * processes can share the file. They synchronize with flock on a companion
+ * lock file, shared for lookups and exclusive for inserts. Growing the table
+ * writes a new file and renames it over the old one, so the file is always
+ * a whole table; the other processes notice the new file on their next
+ * access.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A canonical structural hash of the operator (see proof_key in
+// AssociativityProver.cpp), with its element types and bit widths
+struct ProofKey {
+    uint64_t lo, hi;
+};
+
+struct ProofRecord {
+    static const int kMaxIdentities = 4;
+
+    uint64_t key_lo, key_hi;
+    uint8_t used;           // 0 in an empty slot
+    uint8_t result;         // IsAssociative
+    uint8_t associativity;  // AssociativeIds::Associativity
+    uint8_t size;           // Number of identities
+    float seconds;          // Time the prover took
+    int64_t identities[kMaxIdentities];
+};
+
+class ProofCache {
+    static const uint64_t kInitialCapacity = 1 << 12;
+
+    struct Header {
+        char magic[8];
+        uint64_t capacity;
+        uint64_t count;
+        uint64_t padding[5];
+    };
+
+    // Holds a flock on the lock file for its lifetime
+    class FileLock {
+        int fd;
+
+    public:
+        FileLock(int fd, int operation) : fd(fd) {
+            while ((flock(fd, operation) != 0) && (errno == EINTR)) {
+            }
+        }
+        ~FileLock() { flock(fd, LOCK_UN); }
+    };
+
+    std::mutex mutex;
+    std::string path;
+    int lock_fd;
+    // The table file as last mapped
+    int fd;
+    dev_t device;
+    ino_t inode;
+    Header *header;
+    ProofRecord *records;
+
+    static size_t file_size(uint64_t capacity) {
+        return sizeof(Header) + capacity * sizeof(ProofRecord);
+    }
+
+    static ProofRecord *slot(ProofRecord *records, uint64_t capacity, const ProofKey &key) {
+        uint64_t mask = capacity - 1;
+        for (uint64_t i = key.lo & mask; ; i = (i + 1) & mask) {
+            ProofRecord &r = records[i];
+            if (!r.used || ((r.key_lo == key.lo) && (r.key_hi == key.hi))) {
+                return &r;
+            }
+        }
+    }
+
+    ProofRecord *slot(const ProofKey &key) {
+        return slot(records, header->capacity, key);
+    }
+
+    void unmap() {
+        if (header != nullptr) {
+            munmap(header, file_size(header->capacity));
+            header = nullptr;
+            records = nullptr;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    // Write a table holding 'old' to a temporary file and rename it over
+    // 'path', so that a run killed on the way leaves the previous file
+    bool replace(const std::vector<ProofRecord> &old, uint64_t capacity) {
+        std::string tmp = path + ".tmp." + std::to_string(getpid());
+        int tmp_fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (tmp_fd < 0) {
+            return false;
+        }
+        // The file starts out zeroed: every slot is empty
+        bool ok = (ftruncate(tmp_fd, file_size(capacity)) == 0);
+        void *addr = ok ? mmap(nullptr, file_size(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, tmp_fd, 0)
+                        : MAP_FAILED;
+        if (addr != MAP_FAILED) {
+            Header *h = (Header *)addr;
+            memcpy(h->magic, "PROOFS01", 8);
+            h->capacity = capacity;
+            h->count = old.size();
+            for (const ProofRecord &r : old) {
+                *slot((ProofRecord *)(h + 1), capacity, {r.key_lo, r.key_hi}) = r;
+            }
+            ok = (msync(addr, file_size(capacity), MS_SYNC) == 0);
+            munmap(addr, file_size(capacity));
+        } else {
+            ok = false;
+        }
+        ::close(tmp_fd);
+        if (!ok || (rename(tmp.c_str(), path.c_str()) != 0)) {
+            unlink(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Map the table file currently at 'path', which another process may
+    // have replaced since the last access, creating it if it is missing and
+    // 'create' is set. Must hold the lock file.
+    bool refresh(bool create) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            bool missing = (errno == ENOENT);
+            unmap();
+            if (!create || !missing || !replace({}, kInitialCapacity) ||
+                (stat(path.c_str(), &st) != 0)) {
+                return false;
+            }
+        }
+        if ((header != nullptr) && (st.st_dev == device) && (st.st_ino == inode)) {
+            return true;
+        }
+        unmap();
+        fd = ::open(path.c_str(), O_RDWR);
+        Header h;
+        if ((fd < 0) || (fstat(fd, &st) != 0) || (pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h)) ||
+            (memcmp(h.magic, "PROOFS01", 8) != 0) || ((size_t)st.st_size != file_size(h.capacity))) {
+            unmap();
+            return false;
+        }
+        void *addr = mmap(nullptr, file_size(h.capacity), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            unmap();
+            return false;
+        }
+        header = (Header *)addr;
+        records = (ProofRecord *)(header + 1);
+        device = st.st_dev;
+        inode = st.st_ino;
+        return true;
+    }
+
+    // Double the capacity of the table, rehashing its records into a new
+    // file. Must hold the lock file exclusively.
+    bool grow() {
+        std::vector<ProofRecord> old;
+        for (uint64_t i = 0; i < header->capacity; ++i) {
+            if (records[i].used) {
+                old.push_back(records[i]);
+            }
+        }
+        return replace(old, 2 * header->capacity) && refresh(false);
+    }
+
+    void close() {
+        unmap();
+        if (lock_fd >= 0) {
+            ::close(lock_fd);
+            lock_fd = -1;
+        }
+    }
+
+public:
+    ProofCache() : lock_fd(-1), fd(-1), device(0), inode(0), header(nullptr), records(nullptr) {}
+    ProofCache(const ProofCache &) = delete;
+    ProofCache &operator=(const ProofCache &) = delete;
+    ~ProofCache() { close(); }
+
+    // Open (or create) the cache at 'path', along with its lock file
+    // 'path'.lock. A file not in this format is left alone, and the cache
+    // stays closed.
+    bool open(const std::string &path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        close();
+        this->path = path;
+        lock_fd = ::open((path + ".lock").c_str(), O_RDWR | O_CREAT, 0644);
+        if (lock_fd < 0) {
+            std::cerr << "Cannot open the lock file of proof cache " << path << "\n";
+            return false;
+        }
+        FileLock file_lock(lock_fd, LOCK_EX);
+        if (!refresh(true)) {
+            std::cerr << "Cannot open proof cache " << path << ", or it is not one; not using it\n";
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    bool is_open() const { return lock_fd >= 0; }
+
+    uint64_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!is_open()) {
+            return 0;
+        }
+        FileLock file_lock(lock_fd, LOCK_SH);
+        return refresh(false) ? header->count : 0;
+    }
+
+    bool find(const ProofKey &key, ProofRecord &record) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!is_open()) {
+            return false;
+        }
+        FileLock file_lock(lock_fd, LOCK_SH);
+        if (!refresh(false)) {
+            return false;
+        }
+        const ProofRecord *r = slot(key);
+        if (!r->used) {
+            return false;
+        }
+        record = *r;
+        return true;
+    }
+
+    void insert(const ProofKey &key, const ProofRecord &record) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!is_open()) {
+            return;
+        }
+        FileLock file_lock(lock_fd, LOCK_EX);
+        if (!refresh(true)) {
+            return;
+        }
+        // Another process may have proven the same operator. Its record is
+        // left as it is: emptying a used slot, even for a moment, would cut
+        // the probe chains running through it.
+        if (slot(key)->used) {
+            return;
+        }
+        if ((header->count + 1) * 4 > header->capacity * 3) {
+            if (!grow()) {
+                std::cerr << "Cannot grow the proof cache; not using it\n";
+                close();
+                return;
+            }
+        }
+        // Mark the slot as used last, so a killed run never leaves a record
+        // half-written, and count it once it is there
+        ProofRecord *r = slot(key);
+        ProofRecord copy = record;
+        copy.key_lo = key.lo;
+        copy.key_hi = key.hi;
+        copy.used = 0;
+        *r = copy;
+        r->used = 1;
+        header->count++;
+    }
+};
+
+// The cache shared by all the threads: the file named by the PROOF_CACHE
+// environment variable. There is none if it is unset or empty.
+inline ProofCache &proof_cache() {
+    static ProofCache cache;
+    static std::once_flag opened;
+    std::call_once(opened, []() {
+        const char *path = getenv("PROOF_CACHE");
+        if ((path != nullptr) && (*path != '\0') && cache.open(path)) {
+            std::cerr << "Using proof cache " << path << " (" << cache.size() << " proofs)\n";
+        }
+    });
+    return cache;
+}
+
+#endif
@@ -0,0 +1,120 @@
+#include "Halide.h"
+#include "AssociativityProver.h"
+#include "Utilities.h"
+#include "benchmark.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using std::vector;
+using Halide::Expr;
+using Halide::Internal::Variable;
+
+/**
+ * Measure the proofs-per-second throughput of prove_associativity over a
+ * sweep of the single-element generator's operators: once with a fresh
+ * ProverSession (and so a fresh Z3 context and solver) per proof, which is
+ * what every proof used to pay for, and once with one session reused for the
+ * whole sweep. Both must reach the same verdicts. With "race" as second
+ * argument, it instead proves each operator once racing the associativity
+ * pipelines against each other, and prints which won for each operator
+ * family. Build it like the generators, e.g.
+ *   g++ -std=c++11 -O3 ProverBenchmark.cpp AssociativityProver.cpp HalideToZ3.cpp Utilities.cpp -I<halide>/include -I../../benchmarks -lHalide -lz3
+ */
+
+Halide::Type kType = Halide::Int(32);
+vector<Expr> kXVars = {Variable::make(kType, "x0")};
+vector<Expr> kYVars = {Variable::make(kType, "y0")};
+vector<Expr> kConstants = {Variable::make(kType, "k0")};
+
+// All the trees with the given number of leaves over x0, y0, k0 and the
+// generator's binary operators
+vector<Expr> all_trees(int leaves) {
+    if (leaves == 1) {
+        return {kXVars[0], kYVars[0], kConstants[0]};
+    }
+    vector<Expr> result;
+    for (int left = 1; left < leaves; ++left) {
+        vector<Expr> lhs = all_trees(left), rhs = all_trees(leaves - left);
+        for (const Expr &a : lhs) {
+            for (const Expr &b : rhs) {
+                result.push_back(a + b);
+                result.push_back(a - b);
+                result.push_back(a * b);
+                result.push_back(Halide::min(a, b));
+                result.push_back(Halide::max(a, b));
+            }
+        }
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    int max_leaves = (argc > 1) ? atoi(argv[1]) : 3;
+    bool race = (argc > 2) && (std::string(argv[2]) == "race");
+
+    vector<Halide::Tuple> candidates;
+    for (int leaves = 2; leaves <= max_leaves; ++leaves) {
+        for (const Expr &e : all_trees(leaves)) {
+            if (uses_vars(e, {"x0"}) && uses_vars(e, {"y0"})) {
+                candidates.push_back(Halide::Tuple(e));
+            }
+        }
+    }
+
+    if (race) {
+        ProverStrategy strategy;
+        strategy.race = {"default", "smt", "bit-blast"};
+        set_prover_strategy(strategy);
+        int families[kNumOperatorFamilies] = {0};
+        for (const auto &tuple : candidates) {
+            prove_associativity(tuple, kXVars, kYVars, kConstants);
+            families[(int)operator_family(tuple)]++;
+        }
+        std::cout << "Candidates: " << candidates.size() << " (";
+        for (int f = 0; f < kNumOperatorFamilies; ++f) {
+            std::cout << (f ? ", " : "") << families[f] << " " << operator_family_name((OperatorFamily)f);
+        }
+        std::cout << ")\n";
+        print_tactic_report(std::cout);
+        return 0;
+    }
+
+    // Both must reach the same verdicts
+    int associative = 0;
+    {
+        ProverSession session;
+        for (size_t c = 0; c < candidates.size(); ++c) {
+            ProverSession fresh;
+            IsAssociative a = prove_associativity(candidates[c], kXVars, kYVars, kConstants, fresh).first;
+            IsAssociative b = prove_associativity(candidates[c], kXVars, kYVars, kConstants, session).first;
+            if (a != b) {
+                std::cerr << "Mismatch at candidate " << c << ": " << candidates[c][0] << "\n";
+                return -1;
+            }
+            associative += (a == IsAssociative::YES);
+        }
+    }
+
+    volatile int sink = 0;
+    double t_fresh = benchmark(3, 1, [&]() {
+        for (const auto &tuple : candidates) {
+            ProverSession fresh;
+            sink += (int)prove_associativity(tuple, kXVars, kYVars, kConstants, fresh).first;
+        }
+    });
+    ProverSession session;
+    double t_reused = benchmark(3, 1, [&]() {
+        for (const auto &tuple : candidates) {
+            sink += (int)prove_associativity(tuple, kXVars, kYVars, kConstants, session).first;
+        }
+    });
+
+    std::cout << "Candidates: " << candidates.size() << " (" << associative << " associative)"
+              << "\tfresh session: " << candidates.size() / t_fresh << " proofs/s"
+              << "\treused session: " << candidates.size() / t_reused << " proofs/s ("
+              << t_fresh / t_reused << "x)\n";
+    return 0;
+}
@@ -0,0 +1,434 @@
+#ifndef PROVER_WORKERS_H
+#define PROVER_WORKERS_H
+
+/** \file
+ *
+ * A pool of worker processes to run Z3 queries in, so that a query that
+ * ignores its timeout or eats all the memory only takes its worker down
+ * rather than stalling a sweep that runs for days. Queries are sent as
+ * SMT-LIB2 text over a socket. A worker that overruns its query's timeout
+ * (by more than a grace period) or its memory limit is killed and replaced,
+ * and the query is unknown. Workers are also replaced after a fixed number
+ * of queries, so that none lives long enough for Z3's memory to fragment.
+ *
+ * The workers are forked by a zygote: a process forked from the generator
+ * before it starts any thread, since a fork of a process with other threads
+ * may copy Z3's locks while they are held.
+ */
+
+#include "z3++.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Z3WorkerPool {
+    // Queries a worker runs before it is replaced
+    static const int kMaxQueriesPerWorker = 2000;
+    // Time (in ms) a worker gets past its query's timeout before it is killed
+    static const unsigned kGracePeriod = 2000;
+    // Interval (in ms) at which a busy worker's memory is checked
+    static const int kPollInterval = 50;
+
+    struct Worker {
+        pid_t pid;
+        int fd;     // -1 until the worker is (re)started
+        int queries;
+        bool busy;
+    };
+
+    std::mutex mutex;
+    std::condition_variable idle;
+    std::vector<Worker> workers;
+    int zygote_fd;
+    size_t max_rss;
+    uint64_t killed;
+
+    static bool write_all(int fd, const void *data, size_t size) {
+        const char *p = (const char *)data;
+        while (size > 0) {
+            // Don't raise SIGPIPE if the worker is dead
+            ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+            if (n <= 0) {
+                return false;
+            }
+            p += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    static bool read_all(int fd, void *data, size_t size) {
+        char *p = (char *)data;
+        while (size > 0) {
+            ssize_t n = read(fd, p, size);
+            if (n <= 0) {
+                return false;
+            }
+            p += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    static bool write_string(int fd, const std::string &s) {
+        uint32_t size = s.size();
+        return write_all(fd, &size, sizeof(size)) && write_all(fd, s.data(), size);
+    }
+
+    static bool read_string(int fd, std::string &s) {
+        uint32_t size;
+        if (!read_all(fd, &size, sizeof(size))) {
+            return false;
+        }
+        s.resize(size);
+        return read_all(fd, &s[0], size);
+    }
+
+    static bool write_strings(int fd, const std::vector<std::string> &ss) {
+        uint32_t size = ss.size();
+        bool ok = write_all(fd, &size, sizeof(size));
+        for (size_t i = 0; ok && (i < ss.size()); ++i) {
+            ok = write_string(fd, ss[i]);
+        }
+        return ok;
+    }
+
+    static bool read_strings(int fd, std::vector<std::string> &ss) {
+        uint32_t size;
+        if (!read_all(fd, &size, sizeof(size))) {
+            return false;
+        }
+        ss.resize(size);
+        for (std::string &s : ss) {
+            if (!read_string(fd, s)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Pass the socket 'fd' of the worker 'pid' from the zygote to the
+    // generator. A negative pid (for a failed fork) is sent without a socket.
+    static bool send_worker(int socket, pid_t pid, int fd) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        struct iovec iov = {&pid, sizeof(pid)};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        char control[CMSG_SPACE(sizeof(int))];
+        if (pid > 0) {
+            memset(control, 0, sizeof(control));
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_SOCKET;
+            cmsg->cmsg_type = SCM_RIGHTS;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+            memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+        }
+        return sendmsg(socket, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(pid);
+    }
+
+    static int receive_worker(int socket, pid_t &pid) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        struct iovec iov = {&pid, sizeof(pid)};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        char control[CMSG_SPACE(sizeof(int))];
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if ((recvmsg(socket, &msg, 0) != (ssize_t)sizeof(pid)) || (pid <= 0)) {
+            return -1;
+        }
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        if ((cmsg == nullptr) || (cmsg->cmsg_type != SCM_RIGHTS)) {
+            return -1;
+        }
+        int fd;
+        memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        return fd;
+    }
+
+    static z3::solver make_solver(z3::context &ctx, const std::vector<std::string> &tactics) {
+        if (tactics.empty()) {
+            return z3::solver(ctx);
+        }
+        z3::tactic t(ctx, tactics[0].c_str());
+        for (size_t i = 1; i < tactics.size(); ++i) {
+            t = t & z3::tactic(ctx, tactics[i].c_str());
+        }
+        return t.mk_solver();
+    }
+
+    // Answer queries until the generator closes the socket. A request is the
+    // timeout, the tactics, the names of the constants to read off the model
+    // and the assertions; a reply is 0 (unsat), 1 (sat) or 2 (unknown) and
+    // the values of the constants.
+    static void worker_main(int fd) {
+        z3::context ctx;
+        while (true) {
+            uint32_t timeout;
+            std::vector<std::string> tactics, reads;
+            std::string smt2;
+            if (!read_all(fd, &timeout, sizeof(timeout)) || !read_strings(fd, tactics) ||
+                !read_strings(fd, reads) || !read_string(fd, smt2)) {
+                return;
+            }
+            uint8_t result = 2;
+            std::vector<uint64_t> values(reads.size(), 0);
+            try {
+                z3::solver s = make_solver(ctx, tactics);
+                z3::params params(ctx);
+                params.set(":timeout", (unsigned)timeout);
+                s.set(params);
+                s.from_string(smt2.c_str());
+                z3::check_result check = s.check();
+                if (check == z3::unsat) {
+                    result = 0;
+                } else if (check == z3::sat) {
+                    result = 1;
+                    z3::model m = s.get_model();
+                    for (unsigned i = 0; i < m.num_consts(); ++i) {
+                        z3::func_decl decl = m.get_const_decl(i);
+                        std::string name = decl.name().str();
+                        for (size_t j = 0; j < reads.size(); ++j) {
+                            z3::expr val = m.get_const_interp(decl);
+                            if ((name == reads[j]) && val.is_numeral()) {
+                                Z3_get_numeral_uint64(ctx, val, (uint64_t *)&values[j]);
+                            }
+                        }
+                    }
+                }
+            } catch (const z3::exception &) {
+            }
+            if (!write_all(fd, &result, sizeof(result)) ||
+                !write_all(fd, values.data(), values.size() * sizeof(uint64_t))) {
+                return;
+            }
+        }
+    }
+
+    // Fork a worker for each byte read, until the generator closes the
+    // socket
+    static void zygote_main(int fd) {
+        // Reap the workers
+        signal(SIGCHLD, SIG_IGN);
+        char request;
+        while (read(fd, &request, 1) == 1) {
+            int pair[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0) {
+                send_worker(fd, -1, -1);
+                continue;
+            }
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(fd);
+                close(pair[0]);
+                worker_main(pair[1]);
+                _exit(0);
+            }
+            close(pair[1]);
+            send_worker(fd, pid, pair[0]);
+            close(pair[0]);
+        }
+        _exit(0);
+    }
+
+    // Must hold the mutex
+    bool spawn(Worker &w) {
+        char request = 0;
+        if (!write_all(zygote_fd, &request, 1)) {
+            return false;
+        }
+        w.fd = receive_worker(zygote_fd, w.pid);
+        w.queries = 0;
+        return w.fd >= 0;
+    }
+
+    // Close the worker's socket, so it exits, or kill it if it is stuck
+    void retire(Worker &w, bool kill, const char *reason) {
+        if (kill) {
+            ::kill(w.pid, SIGKILL);
+            std::lock_guard<std::mutex> lock(mutex);
+            killed++;
+            std::cerr << "Killed prover worker " << w.pid << " (" << reason << "); "
+                      << killed << " killed so far\n";
+        }
+        close(w.fd);
+        w.fd = -1;
+    }
+
+    Worker *acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            for (Worker &w : workers) {
+                if (!w.busy) {
+                    if ((w.fd < 0) && !spawn(w)) {
+                        std::cerr << "Cannot start a prover worker\n";
+                        return nullptr;
+                    }
+                    w.busy = true;
+                    return &w;
+                }
+            }
+            idle.wait(lock);
+        }
+    }
+
+    void release(Worker *w) {
+        std::lock_guard<std::mutex> lock(mutex);
+        w->busy = false;
+        idle.notify_one();
+    }
+
+    size_t rss(pid_t pid) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/statm", (int)pid);
+        FILE *f = fopen(path, "r");
+        if (f == nullptr) {
+            return 0;
+        }
+        unsigned long size = 0, resident = 0;
+        if (fscanf(f, "%lu %lu", &size, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(f);
+        return resident * sysconf(_SC_PAGESIZE);
+    }
+
+public:
+    Z3WorkerPool() : zygote_fd(-1), max_rss(0), killed(0) {}
+    Z3WorkerPool(const Z3WorkerPool &) = delete;
+    Z3WorkerPool &operator=(const Z3WorkerPool &) = delete;
+
+    ~Z3WorkerPool() {
+        // The zygote and the workers exit once their sockets are closed
+        for (Worker &w : workers) {
+            if (w.fd >= 0) {
+                close(w.fd);
+            }
+        }
+        if (zygote_fd >= 0) {
+            close(zygote_fd);
+        }
+    }
+
+    // Start the zygote of 'count' workers, each limited to 'max_rss_mb' MB
+    // of resident memory. Must be called before the process starts any
+    // thread.
+    bool start(unsigned count, size_t max_rss_mb) {
+        int pair[2];
+        if ((count == 0) || (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0)) {
+            return false;
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+            close(pair[0]);
+            close(pair[1]);
+            return false;
+        } else if (pid == 0) {
+            close(pair[0]);
+            zygote_main(pair[1]);
+        }
+        close(pair[1]);
+        zygote_fd = pair[0];
+        max_rss = max_rss_mb << 20;
+        workers.assign(count, Worker{-1, -1, 0, false});
+        return true;
+    }
+
+    bool is_running() const { return zygote_fd >= 0; }
+
+    /**
+     * Check the satisfiability of the assertions in 'smt2' with the solver
+     * made of 'tactics' (Z3's default solver if there are none) and the
+     * given timeout (in ms), in a worker. If they are satisfiable, 'values'
+     * are those of the bitvector constants named 'reads' in the model (0 if
+     * the model leaves them out). Blocks while all the workers are busy.
+     */
+    z3::check_result check(const std::string &smt2, const std::vector<std::string> &tactics,
+                           unsigned timeout, const std::vector<std::string> &reads,
+                           std::vector<uint64_t> &values) {
+        Worker *w = acquire();
+        if (w == nullptr) {
+            return z3::unknown;
+        }
+        uint32_t t = timeout;
+        if (!write_all(w->fd, &t, sizeof(t)) || !write_strings(w->fd, tactics) ||
+            !write_strings(w->fd, reads) || !write_string(w->fd, smt2)) {
+            retire(*w, true, "died");
+            release(w);
+            return z3::unknown;
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout + kGracePeriod);
+        const char *failure = nullptr;
+        while (true) {
+            struct pollfd p = {w->fd, POLLIN, 0};
+            if (poll(&p, 1, kPollInterval) > 0) {
+                break;
+            } else if (std::chrono::steady_clock::now() > deadline) {
+                failure = "over its timeout";
+                break;
+            } else if (rss(w->pid) > max_rss) {
+                failure = "over its memory limit";
+                break;
+            }
+        }
+
+        uint8_t result = 2;
+        values.assign(reads.size(), 0);
+        if (failure == nullptr) {
+            if (!read_all(w->fd, &result, sizeof(result)) ||
+                !read_all(w->fd, values.data(), values.size() * sizeof(uint64_t))) {
+                result = 2;
+                failure = "died";
+            }
+        }
+        if (failure != nullptr) {
+            retire(*w, true, failure);
+        } else if (++w->queries >= kMaxQueriesPerWorker) {
+            retire(*w, false, nullptr);
+        }
+        release(w);
+        return (result == 0) ? z3::unsat : (result == 1) ? z3::sat : z3::unknown;
+    }
+};
+
+inline Z3WorkerPool &z3_worker_pool() {
+    static Z3WorkerPool pool;
+    return pool;
+}
+
+// Run the prover's associativity queries in worker processes if the
+// PROVER_WORKERS environment variable sets their number, each limited to
+// PROVER_WORKER_MB MB of resident memory (4096 by default). Call it first
+// thing in main, before any thread starts.
+inline void start_prover_workers() {
+    const char *count = getenv("PROVER_WORKERS");
+    if ((count == nullptr) || (atoi(count) <= 0)) {
+        return;
+    }
+    const char *mb = getenv("PROVER_WORKER_MB");
+    size_t max_rss_mb = (mb != nullptr) ? atol(mb) : 4096;
+    if (z3_worker_pool().start(atoi(count), max_rss_mb)) {
+        std::cerr << "Proving in " << atoi(count) << " worker processes of up to " << max_rss_mb << " MB\n";
+    }
+}
+
+#endif
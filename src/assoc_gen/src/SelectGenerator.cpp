@@ -1,6 +1,8 @@
 #include "Halide.h"
 #include "Error.h"
 #include "Utilities.h"
+#include "ProverWorkers.h"
+#include "Bytecode.h"
 
 #include <iostream>
 #include <cstdlib>
@@ -23,7 +25,7 @@ vector<Halide::Expr> kXVars = {Variable::make(kType, "x0")};
 vector<Halide::Expr> kYVars = {Variable::make(kType, "y0")};
 vector<Halide::Expr> kConstants = {Variable::make(kType, "k0")};
 
-enum Node : long {
+enum Node : uint8_t {
     X0 = 0,
     Y0,
     K0,
@@ -46,55 +48,69 @@ public:
     SingleExpr(bool is_cond) : Expr(1), is_cond(is_cond) {}
     SingleExpr() : Expr(1), is_cond(false) {}
 
-    Value evaluate_term(Value x, Value y, Value k, int &cursor) {
-        Value v1, v2;
+    void compile_term(Program &p, int &cursor) const {
         switch(nodes[cursor++]) {
         case X0:
-            return x;
+            p.push(OpCode::LoadX, 0);
+            break;
         case Y0:
-            return y;
+            p.push(OpCode::LoadY, 0);
+            break;
         case K0:
-            return k;
+            p.push(OpCode::LoadK);
+            break;
         case Add:
-            v1 = evaluate_term(x, y, k, cursor);
-            v2 = evaluate_term(x, y, k, cursor);
-            return v1 + v2;
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Add);
+            break;
         case Sub:
-            v1 = evaluate_term(x, y, k, cursor);
-            v2 = evaluate_term(x, y, k, cursor);
-            return v1 - v2;
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Sub);
+            break;
         case Mul:
-            v1 = evaluate_term(x, y, k, cursor);
-            v2 = evaluate_term(x, y, k, cursor);
-            return v1 * v2;
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Mul);
+            break;
         case Min:
-            v1 = evaluate_term(x, y, k, cursor);
-            v2 = evaluate_term(x, y, k, cursor);
-            return std::min(v1, v2);
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Min);
+            break;
         case Max:
-            v1 = evaluate_term(x, y, k, cursor);
-            v2 = evaluate_term(x, y, k, cursor);
-            return std::max(v1, v2);
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Max);
+            break;
         case LT:
-            v1 = evaluate_term(x, y, k, cursor);
-            v2 = evaluate_term(x, y, k, cursor);
-            return v1 < v2;
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::LT);
+            break;
         case EQ:
-            v1 = evaluate_term(x, y, k, cursor);
-            v2 = evaluate_term(x, y, k, cursor);
-            return v1 == v2;
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::EQ);
+            break;
         case NE:
-            v1 = evaluate_term(x, y, k, cursor);
-            v2 = evaluate_term(x, y, k, cursor);
-            return v1 != v2;
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::NE);
+            break;
         default:
-            return 0;
+            break;
         }
     }
 
-    Value evaluate(Value x, Value y, Value k) {
+    // Flatten the prefix node list into a postfix program, so that the
+    // random trials of the fast associativity check run without recursion
+    Program compile() const {
+        Program p;
         int cursor = 0;
-        return evaluate_term(x, y, k, cursor);
+        compile_term(p, cursor);
+        return p;
     }
 
     void create(DecisionSource &dec, int leaves) {
@@ -442,6 +458,7 @@ public:
 };
 
 int main(int argc, char **argv) {
+    start_prover_workers();
     vector<SingleExpr> leave_start_expr_cond;
     leave_start_expr_cond.reserve(32);
 
@@ -592,12 +609,15 @@ int main(int argc, char **argv) {
                 }
 
                 //std::cout  << "Checking associativity of: " << expr << "\n";
+                Program p_cond = e_cond.compile();
+                Program p_true = e_true.compile();
+                Program p_false = e_false.compile();
                 for (int trial = 0; trial < 250; trial++) {
                     Value x = random_value(), y = random_value(), z = random_value(), k = random_value();
                     // Check it depends on x and y in some meaningful way
-                    Value v_xy = e_cond.evaluate(x, y, k) ? e_true.evaluate(x, y, k) : e_false.evaluate(x, y, k);
-                    Value v_yz = e_cond.evaluate(y, z, k) ? e_true.evaluate(y, z, k) : e_false.evaluate(y, z, k);
-                    Value v_xz = e_cond.evaluate(x, z, k) ? e_true.evaluate(x, z, k) : e_false.evaluate(x, z, k);
+                    Value v_xy = p_cond.run(&x, &y, k) ? p_true.run(&x, &y, k) : p_false.run(&x, &y, k);
+                    Value v_yz = p_cond.run(&y, &z, k) ? p_true.run(&y, &z, k) : p_false.run(&y, &z, k);
+                    Value v_xz = p_cond.run(&x, &z, k) ? p_true.run(&x, &z, k) : p_false.run(&x, &z, k);
                     if (v_xy != v_xz) {
                         uses_y = true;
                     }
@@ -606,8 +626,8 @@ int main(int argc, char **argv) {
                     }
 
                     // Check it's associative
-                    Value v_x_yz = e_cond.evaluate(x, v_yz, k) ? e_true.evaluate(x, v_yz, k) : e_false.evaluate(x, v_yz, k);
-                    Value v_xy_z = e_cond.evaluate(v_xy, z, k) ? e_true.evaluate(v_xy, z, k) : e_false.evaluate(v_xy, z, k);
+                    Value v_x_yz = p_cond.run(&x, &v_yz, k) ? p_true.run(&x, &v_yz, k) : p_false.run(&x, &v_yz, k);
+                    Value v_xy_z = p_cond.run(&v_xy, &z, k) ? p_true.run(&v_xy, &z, k) : p_false.run(&v_xy, &z, k);
                     if (v_x_yz != v_xy_z) {
                         associative = false;
                         break;
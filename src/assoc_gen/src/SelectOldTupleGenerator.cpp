@@ -9,6 +9,7 @@ Copyright (c) 2015 Microsoft Corporation
 #include "Z3OpsHelper.h"
 #include "HalideToZ3.h"
 #include "AssociativityProver.h"
+#include "ProverWorkers.h"
 #include "Error.h"
 
 #include <algorithm>
@@ -687,6 +688,7 @@ bool z3_check_associativity(vector<Halide::Expr> &temp, uint64_t &valid) {
 }
 
 int main(int argc, char **argv) {
+    start_prover_workers();
     const uint64_t MAX_LEAVES_COND = 4;
     const uint64_t MAX_LEAVES = 3;
     const uint64_t MAX_LEAVES_0 = 4;
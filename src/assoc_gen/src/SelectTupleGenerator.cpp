@@ -1,6 +1,8 @@
 #include "Halide.h"
 #include "Error.h"
 #include "Utilities.h"
+#include "ProverWorkers.h"
+#include "HashSet.h"
 
 #include <algorithm>
 #include <iostream>
@@ -43,7 +45,7 @@ vector<Halide::Expr> kConstants = {
     Variable::make(kType, "k0"),
 };
 
-enum Node : long {
+enum Node : uint8_t {
     X0 = 0,
     Y0,
     X1,
@@ -451,7 +453,7 @@ public:
     }
 };
 
-bool generate_expr(int index, uint64_t leaves, uint64_t i, set<TupleExpr> &seen, TupleExpr &e) {
+bool generate_expr(int index, uint64_t leaves, uint64_t i, HashSet<TupleExpr> &seen, TupleExpr &e) {
     string shift = "";
     for (int a = 0; a < index; ++a) {
         shift += "\t";
@@ -463,20 +465,18 @@ bool generate_expr(int index, uint64_t leaves, uint64_t i, set<TupleExpr> &seen,
     e.create(dec, leaves);
 
     if (dec.val == 0) {
-        if (seen.find(e) != seen.end()) {
-            return true;
-        }
-        seen.insert(e);
-        return false;
+        // Skip anything generated before
+        return !seen.insert(e);
     } else {
         return true;
     }
 }
 
 bool fast_check_associativity(vector<TupleExpr> &cond_eqs, vector<TupleExpr> &true_eqs,
-                              vector<TupleExpr> &false_eqs, const set<AssocTuple> &associative_sets) {
-    if (associative_sets.find(AssocTuple(cond_eqs)) != associative_sets.end()) {
-        return false;
+                              vector<TupleExpr> &false_eqs, const HashSet<AssocTuple> &associative_sets) {
+    if (associative_sets.contains(AssocTuple(cond_eqs))) {
+        // Already proven associative
+        return true;
     }
     size_t size = cond_eqs.size();
     bool associative = true;
@@ -545,7 +545,8 @@ Point morton_to_coordinate(uint32_t morton) {
 }
 
 int main(int argc, char **argv) {
-    vector<set<TupleExpr>> seen(2);
+    start_prover_workers();
+    vector<HashSet<TupleExpr>> seen(2);
     uint32_t MORTON_MIN = 0;
     uint32_t MORTON_MAX = 2;
 
@@ -558,9 +559,9 @@ int main(int argc, char **argv) {
     std::cout << "Morton min: " << MORTON_MIN << ", Morton max: " << MORTON_MAX << "\n\n";
 
     vector<IntervalSet> invalid(9);
-    vector<set<TupleExpr>> seen0(9);
+    vector<HashSet<TupleExpr>> seen0(9);
 
-    vector<set<AssocTuple>> associative_sets(9);
+    vector<HashSet<AssocTuple>> associative_sets(9);
 
     uint64_t valid = 0;
     for (uint32_t morton = MORTON_MIN; morton <= MORTON_MAX; ++morton) {
@@ -643,7 +644,7 @@ int main(int argc, char **argv) {
                             }
                         }
                     }
-                    seen[1] = set<TupleExpr>();
+                    seen[1].clear();
                 }
             }
         }
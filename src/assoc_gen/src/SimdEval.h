@@ -0,0 +1,241 @@
+#ifndef SIMD_EVAL_H
+#define SIMD_EVAL_H
+
+/** \file
+ *
+ * Batched evaluation of the compiled postfix programs, running a group of
+ * random trials of the fast associativity check at once: 16 trials per lane
+ * group with AVX-512, 8 with AVX2, and 8 in a plain loop otherwise. Which one
+ * is used is decided by the target flags of the build (e.g. -mavx2 or
+ * -march=native).
+ */
+
+#include "Bytecode.h"
+#include "CounterexampleBank.h"
+
+#include <stdint.h>
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX512F__)
+
+const int SIMD_LANES = 16;
+typedef __m512i VecValue;
+
+inline VecValue vec_load(const Value *p) { return _mm512_loadu_si512(p); }
+inline VecValue vec_add(VecValue a, VecValue b) { return _mm512_add_epi32(a, b); }
+inline VecValue vec_sub(VecValue a, VecValue b) { return _mm512_sub_epi32(a, b); }
+inline VecValue vec_mul(VecValue a, VecValue b) { return _mm512_mullo_epi32(a, b); }
+inline VecValue vec_min(VecValue a, VecValue b) { return _mm512_maskz_min_epi32((__mmask16)-1, a, b); }
+inline VecValue vec_max(VecValue a, VecValue b) { return _mm512_maskz_max_epi32((__mmask16)-1, a, b); }
+inline VecValue vec_lt(VecValue a, VecValue b) { return _mm512_maskz_set1_epi32(_mm512_cmplt_epi32_mask(a, b), 1); }
+inline VecValue vec_gt(VecValue a, VecValue b) { return _mm512_maskz_set1_epi32(_mm512_cmpgt_epi32_mask(a, b), 1); }
+inline VecValue vec_eq(VecValue a, VecValue b) { return _mm512_maskz_set1_epi32(_mm512_cmpeq_epi32_mask(a, b), 1); }
+inline VecValue vec_ne(VecValue a, VecValue b) { return _mm512_maskz_set1_epi32(_mm512_cmpneq_epi32_mask(a, b), 1); }
+// True if the two differ in any lane
+inline bool vec_any_ne(VecValue a, VecValue b) { return _mm512_cmpneq_epi32_mask(a, b) != 0; }
+
+#elif defined(__AVX2__)
+
+const int SIMD_LANES = 8;
+typedef __m256i VecValue;
+
+inline VecValue vec_load(const Value *p) { return _mm256_loadu_si256((const __m256i *)p); }
+inline VecValue vec_add(VecValue a, VecValue b) { return _mm256_add_epi32(a, b); }
+inline VecValue vec_sub(VecValue a, VecValue b) { return _mm256_sub_epi32(a, b); }
+inline VecValue vec_mul(VecValue a, VecValue b) { return _mm256_mullo_epi32(a, b); }
+inline VecValue vec_min(VecValue a, VecValue b) { return _mm256_min_epi32(a, b); }
+inline VecValue vec_max(VecValue a, VecValue b) { return _mm256_max_epi32(a, b); }
+inline VecValue vec_lt(VecValue a, VecValue b) { return _mm256_and_si256(_mm256_cmpgt_epi32(b, a), _mm256_set1_epi32(1)); }
+inline VecValue vec_gt(VecValue a, VecValue b) { return _mm256_and_si256(_mm256_cmpgt_epi32(a, b), _mm256_set1_epi32(1)); }
+inline VecValue vec_eq(VecValue a, VecValue b) { return _mm256_and_si256(_mm256_cmpeq_epi32(a, b), _mm256_set1_epi32(1)); }
+inline VecValue vec_ne(VecValue a, VecValue b) { return _mm256_andnot_si256(_mm256_cmpeq_epi32(a, b), _mm256_set1_epi32(1)); }
+// True if the two differ in any lane
+inline bool vec_any_ne(VecValue a, VecValue b) { return _mm256_movemask_epi8(_mm256_cmpeq_epi32(a, b)) != -1; }
+
+#else
+
+const int SIMD_LANES = 8;
+struct VecValue {
+    Value v[SIMD_LANES];
+};
+
+#define SCALAR_VEC_OP(name, expr)                       \
+    inline VecValue name(VecValue a, VecValue b) {      \
+        VecValue r;                                     \
+        for (int l = 0; l < SIMD_LANES; ++l) {          \
+            Value x = a.v[l], y = b.v[l];               \
+            r.v[l] = (expr);                            \
+        }                                               \
+        return r;                                       \
+    }
+
+inline VecValue vec_load(const Value *p) {
+    VecValue r;
+    for (int l = 0; l < SIMD_LANES; ++l) {
+        r.v[l] = p[l];
+    }
+    return r;
+}
+SCALAR_VEC_OP(vec_add, wrap_add(x, y))
+SCALAR_VEC_OP(vec_sub, wrap_sub(x, y))
+SCALAR_VEC_OP(vec_mul, wrap_mul(x, y))
+SCALAR_VEC_OP(vec_min, std::min(x, y))
+SCALAR_VEC_OP(vec_max, std::max(x, y))
+SCALAR_VEC_OP(vec_lt, x < y)
+SCALAR_VEC_OP(vec_gt, x > y)
+SCALAR_VEC_OP(vec_eq, x == y)
+SCALAR_VEC_OP(vec_ne, x != y)
+#undef SCALAR_VEC_OP
+
+// True if the two differ in any lane
+inline bool vec_any_ne(VecValue a, VecValue b) {
+    bool ne = false;
+    for (int l = 0; l < SIMD_LANES; ++l) {
+        ne |= (a.v[l] != b.v[l]);
+    }
+    return ne;
+}
+
+#endif
+
+static_assert(CounterexampleBank::kPadding % SIMD_LANES == 0,
+              "The counterexample trials must fill whole lane groups");
+
+// Run 'p' on SIMD_LANES trials at once; x and y hold one vector per tuple slot
+inline VecValue run_batch(const Program &p, const VecValue *x, const VecValue *y, VecValue k) {
+    VecValue stack[Program::kMaxSize];
+    int sp = 0;
+    for (int pc = 0; pc < p.size; ++pc) {
+        const Instr &in = p.code[pc];
+        switch (in.op) {
+        case OpCode::LoadX:
+            stack[sp++] = x[in.index];
+            break;
+        case OpCode::LoadY:
+            stack[sp++] = y[in.index];
+            break;
+        case OpCode::LoadK:
+            stack[sp++] = k;
+            break;
+        case OpCode::Add:
+            sp--;
+            stack[sp - 1] = vec_add(stack[sp - 1], stack[sp]);
+            break;
+        case OpCode::Sub:
+            sp--;
+            stack[sp - 1] = vec_sub(stack[sp - 1], stack[sp]);
+            break;
+        case OpCode::Mul:
+            sp--;
+            stack[sp - 1] = vec_mul(stack[sp - 1], stack[sp]);
+            break;
+        case OpCode::Min:
+            sp--;
+            stack[sp - 1] = vec_min(stack[sp - 1], stack[sp]);
+            break;
+        case OpCode::Max:
+            sp--;
+            stack[sp - 1] = vec_max(stack[sp - 1], stack[sp]);
+            break;
+        case OpCode::LT:
+            sp--;
+            stack[sp - 1] = vec_lt(stack[sp - 1], stack[sp]);
+            break;
+        case OpCode::GT:
+            sp--;
+            stack[sp - 1] = vec_gt(stack[sp - 1], stack[sp]);
+            break;
+        case OpCode::EQ:
+            sp--;
+            stack[sp - 1] = vec_eq(stack[sp - 1], stack[sp]);
+            break;
+        case OpCode::NE:
+            sp--;
+            stack[sp - 1] = vec_ne(stack[sp - 1], stack[sp]);
+            break;
+        }
+    }
+    assert(sp == 1);
+    return stack[0];
+}
+
+inline VecValue random_vec() {
+    Value lanes[SIMD_LANES];
+    for (int l = 0; l < SIMD_LANES; ++l) {
+        lanes[l] = random_value();
+    }
+    return vec_load(lanes);
+}
+
+// Run one lane group of trials of the fast associativity check; see
+// simd_check_associativity
+inline bool simd_check_batch(const Program *programs, size_t size,
+                             const VecValue *x, const VecValue *y, const VecValue *z, VecValue k,
+                             bool &uses_x, bool &uses_y) {
+    VecValue v_xy[MAX_TUPLE_SIZE], v_yz[MAX_TUPLE_SIZE], v_xz[MAX_TUPLE_SIZE];
+
+    // Check it depends on x and y in some meaningful way
+    for (size_t i = 0; i < size; ++i) {
+        v_xy[i] = run_batch(programs[i], x, y, k);
+        v_yz[i] = run_batch(programs[i], y, z, k);
+        v_xz[i] = run_batch(programs[i], x, z, k);
+        uses_y |= vec_any_ne(v_xy[i], v_xz[i]);
+        uses_x |= vec_any_ne(v_xz[i], v_yz[i]);
+    }
+
+    // Check if it's associative
+    for (size_t i = 0; i < size; ++i) {
+        if (vec_any_ne(run_batch(programs[i], x, v_yz, k),
+                       run_batch(programs[i], v_xy, z, k))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Run the fast associativity check on the compiled tuple elements, SIMD_LANES
+ * trials at a time: first on the counterexamples Z3 found for earlier tuples
+ * of the same size, then (at least) 'trials' random trials. Sets
+ * 'uses_x'/'uses_y' if some trial shows that the tuple depends on x/y.
+ * Returns false as soon as a lane group contains a trial with
+ * f(f(x, y), z) != f(x, f(y, z)), since no later trial can change the
+ * verdict.
+ */
+inline bool simd_check_associativity(const Program *programs, size_t size, int trials,
+                                     bool &uses_x, bool &uses_y) {
+    assert(size <= MAX_TUPLE_SIZE);
+    VecValue x[MAX_TUPLE_SIZE], y[MAX_TUPLE_SIZE], z[MAX_TUPLE_SIZE];
+
+    thread_local CounterexampleBank::Trials bank_trials[MAX_TUPLE_SIZE];
+    CounterexampleBank::Trials &known = bank_trials[size - 1];
+    counterexample_bank().load(size, known);
+    for (int trial = 0; trial < known.size; trial += SIMD_LANES) {
+        for (size_t i = 0; i < size; ++i) {
+            x[i] = vec_load(&known.x[i][trial]);
+            y[i] = vec_load(&known.y[i][trial]);
+            z[i] = vec_load(&known.z[i][trial]);
+        }
+        if (!simd_check_batch(programs, size, x, y, z, vec_load(&known.k[trial]), uses_x, uses_y)) {
+            return false;
+        }
+    }
+
+    for (int trial = 0; trial < trials; trial += SIMD_LANES) {
+        for (size_t i = 0; i < size; ++i) {
+            x[i] = random_vec();
+            y[i] = random_vec();
+            z[i] = random_vec();
+        }
+        VecValue k = random_vec();
+        if (!simd_check_batch(programs, size, x, y, z, k, uses_x, uses_y)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
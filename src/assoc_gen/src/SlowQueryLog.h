@@ -0,0 +1,103 @@
+#ifndef SLOW_QUERY_LOG_H
+#define SLOW_QUERY_LOG_H
+
+/** \file
+ *
+ * Corpus of the prover's slow Z3 queries, to find out which queries the
+ * solver time goes to and to evaluate solver settings on them offline (see
+ * SmtReplay.cpp) rather than by re-running sweeps. Each query that takes
+ * longer than the threshold is written to a file of its own in the corpus
+ * directory: its SMT-LIB2 text, preceded by comments saying what it was,
+ *   ; kind: associativity
+ *   ; pipeline: bit-blast
+ *   ; timeout: 10000
+ *   ; outcome: unknown
+ *   ; seconds: 10.002
+ *   ; operator: {max(min(x0, y0), k0)}
+ */
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+class SlowQueryLog {
+    std::mutex mutex;
+    std::string dir;
+    double threshold;
+    uint64_t count;
+
+public:
+    SlowQueryLog() : threshold(0), count(0) {}
+
+    // Write the queries that take at least 'threshold_ms' ms into 'dir',
+    // which must exist
+    void open(const std::string &corpus, double threshold_ms) {
+        std::lock_guard<std::mutex> lock(mutex);
+        dir = corpus;
+        threshold = threshold_ms / 1000;
+    }
+
+    bool is_open() const { return !dir.empty(); }
+
+    // In seconds
+    double threshold_seconds() const { return threshold; }
+
+    void add(const std::string &kind, const std::string &pipeline, unsigned timeout,
+             const std::string &outcome, double seconds, const std::string &subject,
+             const std::string &smt2) {
+        std::string path;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!is_open()) {
+                return;
+            }
+            // Several sweeps may share a corpus
+            path = dir + "/" + std::to_string(getpid()) + "-" + std::to_string(count++) + ".smt2";
+        }
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Cannot write slow query " << path << "\n";
+            return;
+        }
+        out << "; kind: " << kind << "\n"
+            << "; pipeline: " << pipeline << "\n"
+            << "; timeout: " << timeout << "\n"
+            << "; outcome: " << outcome << "\n"
+            << "; seconds: " << seconds << "\n";
+        // Keep the operator on one comment line
+        std::istringstream lines(subject);
+        std::string line;
+        out << "; operator:";
+        while (std::getline(lines, line)) {
+            out << " " << line;
+        }
+        out << "\n" << smt2;
+    }
+};
+
+// The corpus shared by all the threads: the directory named by the
+// SLOW_QUERIES environment variable, if set, for the queries that take at
+// least SLOW_QUERY_MS ms (1000 by default)
+inline SlowQueryLog &slow_query_log() {
+    static SlowQueryLog log;
+    static std::once_flag opened;
+    std::call_once(opened, []() {
+        const char *dir = getenv("SLOW_QUERIES");
+        if ((dir == nullptr) || (*dir == '\0')) {
+            return;
+        }
+        const char *ms = getenv("SLOW_QUERY_MS");
+        double threshold_ms = (ms != nullptr) ? atof(ms) : 1000;
+        log.open(dir, threshold_ms);
+        std::cerr << "Writing the queries that take over " << threshold_ms << " ms into " << dir << "\n";
+    });
+    return log;
+}
+
+#endif
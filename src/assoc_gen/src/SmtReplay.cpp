@@ -0,0 +1,184 @@
+#include "AssociativityProver.h"
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::map;
+using std::string;
+using std::vector;
+
+/**
+ * Re-run a corpus of slow prover queries (see SlowQueryLog.h) under
+ * different solver settings, and report the percentiles of their solving
+ * times, so a strategy change can be evaluated without re-running sweeps.
+ * The settings are tactic pipelines (see tactic_pipelines), and "recorded"
+ * for the pipeline each query was captured with; all of them by default.
+ * Each query keeps its recorded timeout unless one is given. Run it as
+ *   smt_replay <corpus dir> [-t <timeout ms>] [setting ...]
+ * and build it like the generators, e.g.
+ *   g++ -std=c++11 -O3 SmtReplay.cpp AssociativityProver.cpp HalideToZ3.cpp -o smt_replay -I<halide>/include -lHalide -lz3 -lpthread
+ */
+
+struct Query {
+    string path;
+    map<string, string> info;  // The comments of SlowQueryLog
+    string smt2;
+};
+
+bool read_query(const string &path, Query &query) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    query.path = path;
+    std::ostringstream smt2;
+    string line;
+    while (std::getline(in, line)) {
+        size_t colon = line.find(": ");
+        if ((line.compare(0, 2, "; ") == 0) && (colon != string::npos)) {
+            query.info[line.substr(2, colon - 2)] = line.substr(colon + 2);
+        }
+        smt2 << line << "\n";
+    }
+    query.smt2 = smt2.str();
+    return true;
+}
+
+vector<Query> read_corpus(const string &dir) {
+    vector<string> names;
+    if (DIR *d = opendir(dir.c_str())) {
+        while (struct dirent *entry = readdir(d)) {
+            string name = entry->d_name;
+            if ((name.size() > 5) && (name.compare(name.size() - 5, 5, ".smt2") == 0)) {
+                names.push_back(name);
+            }
+        }
+        closedir(d);
+    }
+    std::sort(names.begin(), names.end());
+    vector<Query> corpus;
+    for (const string &name : names) {
+        Query query;
+        if (read_query(dir + "/" + name, query) && query.info.count("kind") && query.info.count("pipeline") &&
+            query.info.count("timeout") && query.info.count("outcome")) {
+            corpus.push_back(query);
+        } else {
+            std::cerr << "Skipping " << name << ", which is not a captured query\n";
+        }
+    }
+    return corpus;
+}
+
+double percentile(const vector<double> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t i = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+    return sorted[i];
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <corpus dir> [-t <timeout ms>] [setting ...]\n";
+        return -1;
+    }
+    vector<Query> corpus = read_corpus(argv[1]);
+    unsigned timeout = 0;
+    vector<string> settings;
+    for (int i = 2; i < argc; ++i) {
+        if ((string(argv[i]) == "-t") && (i + 1 < argc)) {
+            timeout = atoi(argv[++i]);
+        } else {
+            settings.push_back(argv[i]);
+        }
+    }
+    if (settings.empty()) {
+        settings.push_back("recorded");
+        for (const string &pipeline : tactic_pipelines()) {
+            settings.push_back(pipeline);
+        }
+    }
+    const vector<string> &pipelines = tactic_pipelines();
+    for (const string &setting : settings) {
+        if ((setting != "recorded") && (std::find(pipelines.begin(), pipelines.end(), setting) == pipelines.end())) {
+            std::cerr << "Unknown setting " << setting << "\n";
+            return -1;
+        }
+    }
+
+    map<string, int> kinds;
+    for (const Query &query : corpus) {
+        kinds[query.info.at("kind")]++;
+    }
+    std::cout << "Queries: " << corpus.size() << " (";
+    bool first = true;
+    for (const auto &iter : kinds) {
+        std::cout << (first ? "" : ", ") << iter.second << " " << iter.first;
+        first = false;
+    }
+    std::cout << ")\n";
+
+    for (const string &setting : settings) {
+        vector<double> times;
+        int sat = 0, unsat = 0, unknown = 0, conflicts = 0, skipped = 0;
+        for (const Query &query : corpus) {
+            z3::context ctx;
+            string pipeline = (setting == "recorded") ? query.info.at("pipeline") : setting;
+            z3::solver s = make_solver(ctx, pipeline);
+            z3::params params(ctx);
+            params.set(":timeout", timeout ? timeout : (unsigned)atoi(query.info.at("timeout").c_str()));
+            s.set(params);
+            // A capture cut short (say by a killed sweep) does not parse
+            try {
+                s.from_string(query.smt2.c_str());
+            } catch (const z3::exception &e) {
+                std::cerr << "Skipping " << query.path << ", which z3 cannot parse: " << e.msg() << "\n";
+                skipped++;
+                continue;
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            z3::check_result result = s.check();
+            times.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+            string outcome = (result == z3::sat) ? "sat" : (result == z3::unsat) ? "unsat" : "unknown";
+            sat += (result == z3::sat);
+            unsat += (result == z3::unsat);
+            unknown += (result == z3::unknown);
+            // A setting must never contradict a verdict the capture reached
+            const string &recorded = query.info.at("outcome");
+            if ((outcome != "unknown") && (recorded != "unknown") && (outcome != recorded)) {
+                std::cerr << setting << " contradicts the recorded outcome of " << query.path << "\n";
+                conflicts++;
+            }
+        }
+        double total = 0;
+        for (double t : times) {
+            total += t;
+        }
+        std::sort(times.begin(), times.end());
+        std::cout << setting << ":\tp50 " << 1000 * percentile(times, 0.5) << " ms"
+                  << "\tp90 " << 1000 * percentile(times, 0.9) << " ms"
+                  << "\tp99 " << 1000 * percentile(times, 0.99) << " ms"
+                  << "\tmax " << 1000 * percentile(times, 1.0) << " ms"
+                  << "\ttotal " << total << " s"
+                  << "\t(" << sat << " sat, " << unsat << " unsat, " << unknown << " unknown";
+        if (conflicts > 0) {
+            std::cout << ", " << conflicts << " contradicted";
+        }
+        if (skipped > 0) {
+            std::cout << ", " << skipped << " skipped";
+        }
+        std::cout << ")\n";
+    }
+    return 0;
+}
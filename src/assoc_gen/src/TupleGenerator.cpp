@@ -1,6 +1,12 @@
 #include "Halide.h"
 #include "Error.h"
 #include "Utilities.h"
+#include "ProverWorkers.h"
+#include "HashSet.h"
+#include "Enumerator.h"
+#include "CandidatePool.h"
+#include "DependencyGraph.h"
+#include "SimdEval.h"
 
 #include <algorithm>
 #include <iostream>
@@ -42,7 +48,7 @@ vector<Halide::Expr> kConstants = {
     Variable::make(kType, "k0"),
 };
 
-enum Node : long{
+enum Node : uint8_t {
     X0 = 0,
     Y0,
     X1,
@@ -56,279 +62,109 @@ enum Node : long{
     LastNode,
 };
 
+const Node kVarNodes[] = {X0, X1, Y0, Y1};
+
+// The leaves that may follow 'prev' and 'prevprev' in the prefix node list
+int leaf_choices(int prev, int prevprev, uint8_t *choices) {
+    bool after_op = (prevprev == Min) || (prevprev == Max) || (prevprev == Add) || (prevprev == Sub);
+    int n = 0;
+    if (after_op && (prev < K0)) {
+        // avoid min(x, x) and min(y, y)
+        for (Node v : kVarNodes) {
+            if (v != prev) {
+                choices[n++] = v;
+            }
+        }
+        choices[n++] = K0;
+    } else if ((prevprev != Enumerator::NONE) && (prev == K0)) {
+        for (Node v : kVarNodes) {
+            choices[n++] = v;
+        }
+    } else {
+        for (Node v : kVarNodes) {
+            choices[n++] = v;
+        }
+        choices[n++] = K0;
+    }
+    return n;
+}
+
+// Every tree of up to MAX_LEAVES leaves, ranked densely
+const Enumerator kEnumerator({{Add, true}, {Sub, false}, {Mul, true}, {Min, true}, {Max, true}}, leaf_choices, MAX_LEAVES);
+
 class TupleExpr : public Expr {
 public:
     TupleExpr() : Expr(2) {}
 
-    Value evaluate_term(const vector<Value> &xvalues, const vector<Value> &yvalues, Value k, int &cursor) const {
-        Value v1, v2;
+    void compile_term(Program &p, int &cursor) const {
         switch(nodes[cursor++]) {
         case X0:
-            return xvalues[0];
+            p.push(OpCode::LoadX, 0);
+            break;
         case X1:
-            return xvalues[1];
+            p.push(OpCode::LoadX, 1);
+            break;
         case Y0:
-            return yvalues[0];
+            p.push(OpCode::LoadY, 0);
+            break;
         case Y1:
-            return yvalues[1];
+            p.push(OpCode::LoadY, 1);
+            break;
         case K0:
-            return k;
+            p.push(OpCode::LoadK);
+            break;
         case Add:
-            v1 = evaluate_term(xvalues, yvalues, k, cursor);
-            v2 = evaluate_term(xvalues, yvalues, k, cursor);
-            return v1 + v2;
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Add);
+            break;
         case Sub:
-            v1 = evaluate_term(xvalues, yvalues, k, cursor);
-            v2 = evaluate_term(xvalues, yvalues, k, cursor);
-            return v1 - v2;
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Sub);
+            break;
         case Mul:
-            v1 = evaluate_term(xvalues, yvalues, k, cursor);
-            v2 = evaluate_term(xvalues, yvalues, k, cursor);
-            return v1 * v2;
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Mul);
+            break;
         case Min:
-            v1 = evaluate_term(xvalues, yvalues, k, cursor);
-            v2 = evaluate_term(xvalues, yvalues, k, cursor);
-            return std::min(v1, v2);
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Min);
+            break;
         case Max:
-            v1 = evaluate_term(xvalues, yvalues, k, cursor);
-            v2 = evaluate_term(xvalues, yvalues, k, cursor);
-            return std::max(v1, v2);
+            compile_term(p, cursor);
+            compile_term(p, cursor);
+            p.push(OpCode::Max);
+            break;
         default:
-            return 0;
+            break;
         }
     }
 
-    Value evaluate(const vector<Value> &xvalues, const vector<Value> &yvalues, Value k) const {
+    // Flatten the prefix node list into a postfix program, so that the
+    // random trials of the fast associativity check run without recursion
+    Program compile() const {
+        Program p;
         int cursor = 0;
-        return evaluate_term(xvalues, yvalues, k, cursor);
+        compile_term(p, cursor);
+        return p;
     }
 
-    void create(DecisionSource &dec, int leaves) {
-        assert(size < 64);
-        assert(leaves > 0);
-        if (leaves == 1) {
-            if (size > 1 && nodes[size-1] == X0 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Add ||
-                 nodes[size-2] == Sub)) {
-                // avoid min(x, x)
-                int d = dec.get(4);
-                if (d == 0) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 1) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 2) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
+    // Build the index-th tree with the given number of leaves
+    void create(const Enumerator &enumerator, uint64_t leaves, uint64_t index) {
+        uint8_t codes[MAX_NODES];
+        size = enumerator.unrank(leaves, index, codes);
+        for (int j = 0; j < size; ++j) {
+            nodes[j] = (Node)codes[j];
+            // The variables alternate X0, Y0, X1, Y1, ...
+            if (nodes[j] < K0) {
+                if (nodes[j] % 2 == 0) {
+                    uses_x[nodes[j] / 2] = true;
                 } else {
-                    nodes[size++] = K0;
-                }
-            } else if (size > 1 && nodes[size-1] == X1 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Add ||
-                 nodes[size-2] == Sub)) {
-                // avoid min(x, x)
-                int d = dec.get(4);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 2) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                } else {
-                    nodes[size++] = K0;
-                }
-
-            } else if (size > 1 && nodes[size-1] == Y0 &&
-                       (nodes[size-2] == Min ||
-                        nodes[size-2] == Max ||
-                        nodes[size-2] == Add ||
-                        nodes[size-2] == Sub)) {
-                // avoid min(y, y)
-                int d = dec.get(4);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                } else {
-                    nodes[size++] = K0;
-                }
-            } else if (size > 1 && nodes[size-1] == Y1 &&
-                       (nodes[size-2] == Min ||
-                        nodes[size-2] == Max ||
-                        nodes[size-2] == Add ||
-                        nodes[size-2] == Sub)) {
-                // avoid min(y, y)
-                int d = dec.get(4);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else {
-                    nodes[size++] = K0;
-                }
-            } else if (size > 1 && nodes[size-1] == K0) {
-                int d = dec.get(4);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                }
-            } else {
-                int d = dec.get(5);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 3) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                } else {
-                    nodes[size++] = K0;
-                }
-            }
-
-            // No constant
-            /*if (size > 1 && nodes[size-1] == X0 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Add ||
-                 nodes[size-2] == Sub)) {
-                // avoid min(x, x)
-                int d = dec.get(3);
-                if (d == 0) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 1) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 2) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                }
-            } else if (size > 1 && nodes[size-1] == X1 &&
-                (nodes[size-2] == Min ||
-                 nodes[size-2] == Max ||
-                 nodes[size-2] == Add ||
-                 nodes[size-2] == Sub)) {
-                // avoid min(x, x)
-                int d = dec.get(3);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 2) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                }
-            } else if (size > 1 && nodes[size-1] == Y0 &&
-                       (nodes[size-2] == Min ||
-                        nodes[size-2] == Max ||
-                        nodes[size-2] == Add ||
-                        nodes[size-2] == Sub)) {
-                // avoid min(y, y)
-                int d = dec.get(4);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                }
-            } else if (size > 1 && nodes[size-1] == Y1 &&
-                       (nodes[size-2] == Min ||
-                        nodes[size-2] == Max ||
-                        nodes[size-2] == Add ||
-                        nodes[size-2] == Sub)) {
-                // avoid min(y, y)
-                int d = dec.get(3);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                }
-            } else {
-                int d = dec.get(4);
-                if (d == 0) {
-                    uses_x[0] = true;
-                    nodes[size++] = X0;
-                } else if (d == 1) {
-                    uses_x[1] = true;
-                    nodes[size++] = X1;
-                } else if (d == 2) {
-                    uses_y[0] = true;
-                    nodes[size++] = Y0;
-                } else if (d == 3) {
-                    uses_y[1] = true;
-                    nodes[size++] = Y1;
-                }
-            }*/
-        } else {
-            // TODO make a list of reasonable options
-            int d = dec.get(LastNode - Add) + Add;
-            nodes[size++] = Node(d);
-            switch(d) {
-            case Add:
-            case Mul:
-            case Min:
-            case Max:
-                {
-                    int leaves_on_right = dec.get(leaves/2) + 1;
-                    int leaves_on_left = leaves - leaves_on_right;
-                    create(dec, leaves_on_left);
-                    create(dec, leaves_on_right);
+                    uses_y[nodes[j] / 2] = true;
                 }
-                break;
-            case Sub:
-                {
-                    int leaves_on_right = dec.get(leaves - 1) + 1;
-                    int leaves_on_left = leaves - leaves_on_right;
-                    create(dec, leaves_on_left);
-                    create(dec, leaves_on_right);
-                }
-                break;
-            default:
-                std::cerr << "Unreachable\n";
             }
         }
     }
@@ -462,86 +298,38 @@ public:
     }
 };
 
-bool generate_expr(int index, uint64_t leaves, uint64_t i, set<TupleExpr> &seen, TupleExpr &e) {
-    string shift = "";
-    for (int a = 0; a < index; ++a) {
-        shift += "\t";
-    }
-
-    e = TupleExpr();
-    DecisionSource dec;
-    dec.val = i;
-    e.create(dec, leaves);
-
-    if (dec.val == 0) {
-        if (seen.find(e) != seen.end()) {
-            return true;
-        }
-        seen.insert(e);
-        return false;
-    } else {
-        return true;
-    }
-}
-
 // Return false if it's proved to be not associative
-bool fast_check_associativity(vector<TupleExpr> &eqs, const set<AssocTuple> &associative_set) {
+bool fast_check_associativity(const vector<const Candidate<TupleExpr> *> &eqs, const HashSet<AssocTuple> &associative_set) {
     size_t size = eqs.size();
 
-    if (associative_set.find(AssocTuple(eqs)) != associative_set.end()) {
+    AssocTuple tuple;
+    for (size_t i = 0; i < size; ++i) {
+        tuple.exprs.push_back(eqs[i]->e);
+    }
+    if (associative_set.contains(tuple)) {
         // We've already proved it's associative, no need to redo things
         vector<Halide::Expr> temp(size);
         for (size_t i = 0; i < size; ++i) {
-            temp[i] = eqs[i].get_expr();
+            temp[i] = eqs[i]->expr;
         }
-        DEBUG_PRINT2 << "......Skip proven non-associative exprs: " << Halide::Tuple(temp) << "\n";
-        return false;
+        DEBUG_PRINT2 << "......Skip proven associative exprs: " << Halide::Tuple(temp) << "\n";
+        return true;
     }
 
-    bool associative = true;
-    bool uses_y = false, uses_x = false;
-    for (int trial = 0; trial < 250; trial++) {
-        vector<Value> xvalues(size), yvalues(size), zvalues(size);
-        for (size_t i = 0; i < size; ++i) {
-            xvalues[i] = random_value();
-            yvalues[i] = random_value();
-            zvalues[i] = random_value();
-        }
-        Value k = random_value();
-
-        // Check it depends on x and y in some meaningful way
-        vector<Value> v_xy(size), v_yz(size), v_xz(size);
-
-        for (size_t i = 0; i < size; ++i) {
-            v_xy[i] = eqs[i].evaluate(xvalues, yvalues, k);
-            v_yz[i] = eqs[i].evaluate(yvalues, zvalues, k);
-            v_xz[i] = eqs[i].evaluate(xvalues, zvalues, k);
-
-            if (v_xy[i] != v_xz[i]) {
-                uses_y = true;
-            }
-            if (v_xz[i] != v_yz[i]) {
-                uses_x = true;
-            }
-        }
-
-        // Check if it's associative
-        vector<Value> v_x_yz(size), v_xy_z(size);
-        for (size_t i = 0; i < size; ++i) {
-            v_x_yz[i] = eqs[i].evaluate(xvalues, v_yz, k);
-            v_xy_z[i] = eqs[i].evaluate(v_xy, zvalues, k);
-            if (v_x_yz[i] != v_xy_z[i]) {
-                associative = false;
-                break;
-            }
-        }
+    ASSERT(size <= MAX_TUPLE_SIZE, "Tuple is too large for the fast associativity check\n");
+    Program programs[MAX_TUPLE_SIZE];
+    for (size_t i = 0; i < size; ++i) {
+        programs[i] = eqs[i]->program;
     }
 
+    bool uses_y = false, uses_x = false;
+    bool associative = simd_check_associativity(programs, size, 250, uses_x, uses_y);
+
     bool skip = !(associative && uses_x && uses_y);
     if (skip) {
         vector<Halide::Expr> temp(size);
         for (size_t i = 0; i < size; ++i) {
-            temp[i] = eqs[i].get_expr();
+            temp[i] = eqs[i]->expr;
         }
         DEBUG_PRINT3 << "...Skip " << Halide::Tuple(temp) << "\t; associative? " << associative
                      << "; uses_x: " << uses_x << "; uses_y: " << uses_y << "\n";
@@ -564,7 +352,7 @@ Point morton_to_coordinate(uint32_t morton) {
 }
 
 int main(int argc, char **argv) {
-    vector<set<TupleExpr>> seen(2);
+    start_prover_workers();
     uint32_t MORTON_MIN = 0;
     uint32_t MORTON_MAX = 2;
 
@@ -577,10 +365,10 @@ int main(int argc, char **argv) {
     std::cout << "Running two-element tuple generator of type: " << kType << "\n";
     std::cout << "Morton min: " << MORTON_MIN << ", Morton max: " << MORTON_MAX << "\n\n";
 
-    vector<IntervalSet> invalid(9);
-    vector<set<TupleExpr>> seen0(9);
+    vector<HashSet<AssocTuple>> associative_sets(9);
 
-    vector<set<AssocTuple>> associative_sets(9);
+    // The dependency graphs a tuple may have without being decomposable
+    const DependencyGraphs graphs(2);
 
     uint64_t valid = 0;
     for (uint32_t morton = MORTON_MIN; morton <= MORTON_MAX; ++morton) {
@@ -589,88 +377,59 @@ int main(int argc, char **argv) {
         uint64_t leaves_end =  std::min(point.leaves + LEAVES_TILE - 1, MAX_LEAVES);
         //uint64_t leaves_start = 4, leaves_end = 4;
         uint64_t i_start = point.i;
-        uint64_t i_end = point.i + ITER_TILE - 1;
+        uint64_t i_end = kEnumerator.tile_end(leaves_start, leaves_end, i_start, ITER_TILE);
 
         std::cout << "Morton: " << morton << ", leaves: [" << leaves_start
                   << ", " << leaves_end << "], i: [" << i_start << ", "
                   << i_end << "]" << "\n";
 
-        for (uint64_t leaves0 = leaves_start; leaves0 <= leaves_end; ++leaves0) {
-            IntervalSet i0_range;
-            i0_range.insert(IntervalVal::closed(i_start, i_end));
-            i0_range -= invalid[leaves0];
-            Halide::Expr expr0, expr1;
-            for (auto it0 = i0_range.begin(); it0 != i0_range.end(); it0++){
-                for (uint64_t i0 = it0->lower(); i0 <= it0->upper(); ++i0) {
-                    if (boost::icl::contains(invalid[leaves0], i0)) {
-                        DEBUG_PRINT2 << "...Skip leaves0: " << leaves0 << ", i0: " << i0 << "\n";
-                        continue;
-                    }
+        // Both elements of a tuple come from this tile, so filter its
+        // candidates once up front
+        CandidatePool<TupleExpr> candidates(leaves_start, leaves_end);
+        candidates.build(kEnumerator, i_start, i_end, kXNames, kYNames, kConstantNames);
 
-                    TupleExpr e0;
-                    bool skip_e0 = generate_expr(0, leaves0, i0, seen0[leaves0], e0);
-                    expr0 = e0.get_expr();
-                    skip_e0 = skip_e0 || should_skip_expression(0, expr0, e0.fail, e0.uses_x, e0.uses_y, kXNames, kYNames, kConstantNames);
-                    if (skip_e0) {
-                        invalid[leaves0].insert(i0);
-                        continue;
-                    }
-
-                    //Halide::Expr expr = (kXVars[0] * kYVars[0]) - (kXVars[1] * kYVars[1]);
-                    /*Halide::Expr expr = (kXVars[0] * kYVars[1]) + (kXVars[1] * kYVars[0]);
-                    if (equal(expr0, expr)) {
-                        std::cout << "***FOUND EXPR after i0: " << i0 << "; expr: " << expr0 << "\n";
-                        return 0;
-                    }*/
-
-                    //std::cout << "Leaves0: " << leaves0 << ", i0: " << i0 << ", expr: " << expr0 << ", valid: " << valid << "\n";
-
-                    for (uint64_t leaves1 = leaves_start; leaves1 <= leaves_end; ++leaves1) {
-                        IntervalSet i1_range;
-                        i1_range.insert(IntervalVal::closed(i_start, i_end));
-                        i1_range -= invalid[leaves1];
-                        for (auto it1 = i1_range.begin(); it1 != i1_range.end(); it1++){
-                            for (uint64_t i1 = it1->lower(); i1 <= it1->upper(); ++i1) {
-                                if (boost::icl::contains(invalid[leaves1], i1)) {
-                                    DEBUG_PRINT2 << "......Skip leaves1: " << leaves1 << ", i1: " << i1 << "\n";
-                                    continue;
-                                }
+        for (uint64_t leaves0 = leaves_start; leaves0 <= leaves_end; ++leaves0) {
+            for (const Candidate<TupleExpr> &c0 : candidates[leaves0]) {
+                // The later elements are only drawn from the rows that can still
+                // make the tuple non-decomposable
+                if (!graphs.allows(DependencyGraphs::kRoot, c0.row)) {
+                    continue;
+                }
+                uint32_t prefix0 = graphs.extend(DependencyGraphs::kRoot, c0.row);
+                //Halide::Expr expr = (kXVars[0] * kYVars[0]) - (kXVars[1] * kYVars[1]);
+                /*Halide::Expr expr = (kXVars[0] * kYVars[1]) + (kXVars[1] * kYVars[0]);
+                if (equal(c0.expr, expr)) {
+                    std::cout << "***FOUND EXPR after i0: " << c0.i << "; expr: " << c0.expr << "\n";
+                    return 0;
+                }*/
+
+                //std::cout << "Leaves0: " << leaves0 << ", i0: " << c0.i << ", expr: " << c0.expr << ", valid: " << valid << "\n";
+
+                for (uint64_t leaves1 = leaves_start; leaves1 <= leaves_end; ++leaves1) {
+                    const vector<Candidate<TupleExpr>> &pool1 = candidates[leaves1];
+                    for (uint32_t row1 : SetBits(graphs.next_rows(prefix0))) {
+                        for (size_t k1 : candidates.with_row(leaves1, row1)) {
+                            const Candidate<TupleExpr> &c1 = pool1[k1];
+                            if (Halide::Internal::equal(c0.expr, c1.expr)) {
+                                continue;
+                            }
+                            //std::cout << "Leaves1: " << leaves1 << ", i1: " << c1.i << ", expr: " << c1.expr << "\n";
 
-                                TupleExpr e1;
-                                bool skip_e1 = generate_expr(1, leaves1, i1, seen[1], e1);
-                                expr1 = e1.get_expr();
-                                if (Halide::Internal::equal(expr0, expr1)) {
-                                    continue;
-                                }
-                                skip_e1 = skip_e1 || should_skip_expression(1, expr1, e1.fail, e1.uses_x, e1.uses_y, kXNames, kYNames, kConstantNames);
-                                if (skip_e1) {
-                                    invalid[leaves1].insert(i1);
-                                    continue;
-                                }
-                                //std::cout << "Leaves1: " << leaves1 << ", i1: " << i1 << ", expr: " << expr1 << "\n";
-
-                                // Check asssociativity
-                                vector<TupleExpr> eqs = {e0, e1};
-                                if (!fast_check_associativity(eqs, associative_sets[leaves0])) {
-                                    vector<Halide::Expr> halide_exprs = {expr0, expr1};
-                                    vector<vector<bool>> eqs_uses_x = {e0.uses_x, e1.uses_x};
-                                    vector<vector<bool>> eqs_uses_y = {e0.uses_y, e1.uses_y};
-                                    if (is_decomposable(eqs_uses_x, eqs_uses_y)) {
-                                        DEBUG_PRINT2 << "......Skip decomposable exprs: " << Halide::Tuple(halide_exprs) << "\n";
-                                        continue;
-                                    }
-                                    if (z3_check_associativity(halide_exprs, kXVars, kYVars, kConstants, {leaves0, leaves1}, {i0, i1})) {
-                                        associative_sets[leaves0].insert(AssocTuple(e0, e1));
-                                        valid++;
-                                        //if (is_decomposable(eqs_uses_x, eqs_uses_y)) {
-                                        //    std::cout << "......Skip decomposable exprs: " << Halide::Tuple(halide_exprs) << "\n";
-                                        //}
-                                    }
+                            // Check asssociativity
+                            vector<const Candidate<TupleExpr> *> eqs = {&c0, &c1};
+                            if (!candidates.is_canonical(eqs)) {
+                                DEBUG_PRINT2 << "......Skip relabeled tuple of leaves0: " << leaves0 << ", i0: " << c0.i << "\n";
+                                continue;
+                            }
+                            if (!fast_check_associativity(eqs, associative_sets[leaves0])) {
+                                vector<Halide::Expr> halide_exprs = {c0.expr, c1.expr};
+                                if (z3_check_associativity(halide_exprs, kXVars, kYVars, kConstants, {leaves0, leaves1}, {c0.i, c1.i})) {
+                                    associative_sets[leaves0].insert(AssocTuple(c0.e, c1.e));
+                                    valid++;
                                 }
                             }
                         }
                     }
-                    seen[1] = set<TupleExpr>();
                 }
             }
         }
@@ -4,6 +4,7 @@
 #include "HalideToZ3.h"
 #include "AssociativityProver.h"
 #include "Utilities.h"
+#include "DependencyGraph.h"
 
 #include <cstdlib>
 #include <cassert>
@@ -73,48 +74,17 @@ uint32_t morton1(uint32_t x) {
     return x;
 }
 
-void print_coordinate(const vector<uint64_t> &leaves, const vector<uint64_t> &is) {
+void print_coordinate(const vector<uint64_t> &leaves, const vector<uint64_t> &is, std::ostream &out) {
     for (size_t i = 0; i < leaves.size(); ++i) {
         if (leaves.size() == 1) {
-            std::cout << "Leaves" << ": " << leaves[i] << ", i" << ": " << is[i];
+            out << "Leaves" << ": " << leaves[i] << ", i" << ": " << is[i];
         } else {
-            std::cout << "Leaves" << i << ": " << leaves[i] << ", i" << i << ": " << is[i];
+            out << "Leaves" << i << ": " << leaves[i] << ", i" << i << ": " << is[i];
         }
         if (i != leaves.size() - 1) {
-            std::cout << ", ";
-        }
-    }
-}
-
-vector<set<int>> compute_subgraphs(vector<set<int>> dependencies) {
-    vector<set<int>> subgraphs(dependencies.size());
-    for (size_t i = 0; i < dependencies.size(); ++i) {
-        // Check if the current subgraph is a subset of another
-        const auto &current = dependencies[i];
-        if (current.empty()) {
-            continue;
-        }
-        bool should_remove = false;
-        for (size_t j = 0; j < dependencies.size(); ++j) {
-            const auto &other = dependencies[j];
-            if ((i == j) || (current.size() > other.size()) || (j < i && subgraphs[i].empty())) {
-                continue;
-            }
-            vector<int> diff;
-            // Compute the vertices in the current set that are not contained in the other
-            std::set_difference(current.begin(), current.end(), other.begin(), other.end(),
-                                std::inserter(diff, diff.begin()));
-            if (diff.empty()) {
-                // 'current' is fully contained in 'other'
-                should_remove = true;
-                break;
-            }
-        }
-        if (!should_remove) {
-            subgraphs[i] = current;
+            out << ", ";
         }
     }
-    return subgraphs;
 }
 
 } // anonymous namespace
@@ -221,86 +191,50 @@ bool is_decomposable(const vector<vector<bool>> &eqs_uses_x,
     assert(eqs_uses_x.size() == eqs_uses_y.size());
 
     size_t size = eqs_uses_x.size();
-    vector<set<int>> dependencies(size);
+    vector<uint32_t> rows(size, 0);
     for (size_t i = 0; i < size; ++i) {
         assert(eqs_uses_x[i].size() == size);
         assert(eqs_uses_y[i].size() == size);
-        for (size_t j = 0; j < eqs_uses_x[i].size(); ++j) {
-            if (eqs_uses_x[i][j]) {
-                dependencies[i].insert(j);
-            }
-        }
-        for (size_t j = 0; j < eqs_uses_y[i].size(); ++j) {
-            if (eqs_uses_y[i][j]) {
-                dependencies[i].insert(j);
+        for (size_t j = 0; j < size; ++j) {
+            if (eqs_uses_x[i][j] || eqs_uses_y[i][j]) {
+                rows[i] |= 1u << j;
             }
         }
     }
-    //std::cout << "\nOriginal dependencies: " << dependencies << "\n";
-
-    bool change = true;
-    while (change) {
-        change = false;
-        for (size_t i = 0; i < dependencies.size(); ++i) {
-            for (size_t j = 0; j < dependencies.size(); ++j) {
-                if (i == j) {
-                    continue;
-                }
-                if (dependencies[i].find(j) != dependencies[i].end()) {
-                    for (const auto &idx : dependencies[j]) {
-                        if (dependencies[i].find(idx) == dependencies[i].end()) {
-                            dependencies[i].insert(idx);
-                            change = true;
-                        }
-                    }
-                }
-            }
-        }
-    }
-
-    //std::cout << "Dependencies: " << dependencies << "\n";
-
-    const auto &subgraphs = compute_subgraphs(dependencies);
-    //std::cout << "Subgraphs: " << subgraphs << "\n";
-    for (const auto &s : subgraphs) {
-        if (s.size() == size) {
-            return false;
-        }
-    }
-    return true;
+    return is_decomposable_graph(rows.data(), size);
 }
 
 bool z3_check_associativity(vector<Halide::Expr> &eqs, vector<Halide::Expr> &kXVars,
                             vector<Halide::Expr> &kYVars, vector<Halide::Expr> &kConstants,
-                            vector<uint64_t> leaves, vector<uint64_t> is) {
+                            vector<uint64_t> leaves, vector<uint64_t> is, std::ostream &out) {
     Halide::Tuple tuple_eqs(eqs);
     pair<IsAssociative, AssociativeIds> result = prove_associativity(tuple_eqs, kXVars, kYVars, kConstants);
     if (result.first == IsAssociative::YES) {
         if (result.second.associativity == AssociativeIds::LEFT) {
-            print_coordinate(leaves, is);
-            std::cout << ", " << tuple_eqs << " -> Left-associativity";
+            print_coordinate(leaves, is, out);
+            out << ", " << tuple_eqs << " -> Left-associativity";
         } else if (result.second.associativity == AssociativeIds::RIGHT) {
-            print_coordinate(leaves, is);
-            std::cout << ", " << tuple_eqs << " -> Right-associativity";
+            print_coordinate(leaves, is, out);
+            out << ", " << tuple_eqs << " -> Right-associativity";
         } else {
             //print_coordinate(leaves, is);
             //std::cout << tuple_eqs << " -> Unknown-associativity\n";
             return false;
         }
-        std::cout << " with identity: " << Halide::Tuple(result.second.identities) << "\n";
+        out << " with identity: " << Halide::Tuple(result.second.identities) << "\n";
     } else if (result.first == IsAssociative::UNKNOWN) {
         if (result.second.associativity == AssociativeIds::LEFT) {
-            print_coordinate(leaves, is);
-            std::cout << ", " << tuple_eqs << " -> UNKNOWN associative with left-identity: ";
+            print_coordinate(leaves, is, out);
+            out << ", " << tuple_eqs << " -> UNKNOWN associative with left-identity: ";
         } else if (result.second.associativity == AssociativeIds::RIGHT) {
-            print_coordinate(leaves, is);
-            std::cout << ", " << tuple_eqs << " -> UNKNOWN associative with right-identity: ";
+            print_coordinate(leaves, is, out);
+            out << ", " << tuple_eqs << " -> UNKNOWN associative with right-identity: ";
         } else {
             //print_coordinate(leaves, is);
             //std::cout << tuple_eqs << " -> UNKNOWN associative\n";
             return false;
         }
-        std::cout << Halide::Tuple(result.second.identities) << "\n";
+        out << Halide::Tuple(result.second.identities) << "\n";
     } else {
         //print_coordinate(leaves, is);
         //std::cout << tuple_eqs << " -> " << "NOT associative\n";
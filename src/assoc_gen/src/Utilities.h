@@ -41,10 +41,12 @@ bool is_expr_boring(Halide::Expr e, Halide::Expr &simplified,
 bool is_decomposable(const std::vector<std::vector<bool>> &eqs_uses_x,
                      const std::vector<std::vector<bool>> &eqs_uses_y);
 
-// Return true if eqs are associative and have identities
+// Return true if eqs are associative and have identities. Proven operators
+// are reported to 'out'.
 bool z3_check_associativity(std::vector<Halide::Expr> &eqs, std::vector<Halide::Expr> &kXVars,
                             std::vector<Halide::Expr> &kYVars, std::vector<Halide::Expr> &kConstants,
-                            std::vector<uint64_t> leaves, std::vector<uint64_t> is);
+                            std::vector<uint64_t> leaves, std::vector<uint64_t> is,
+                            std::ostream &out = std::cout);
 
 void is_decomposable_test();
 
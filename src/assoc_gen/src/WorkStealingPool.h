@@ -0,0 +1,196 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+/** \file
+ *
+ * Work-stealing thread pool used to spread the Morton sweeps of the tuple
+ * generators over all cores of a machine.
+ */
+
+#include "Error.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+/**
+ * Run a fixed list of tasks, identified by their index, on a set of worker
+ * threads. Every worker owns a deque of task indices: it pops work from the
+ * back of its own deque and, once that runs dry, steals from the front of the
+ * other workers' deques. Tasks are dealt out in contiguous blocks so that a
+ * worker tends to walk neighbouring tiles, and the blocks at the front of a
+ * deque (the ones stolen first) are the ones its owner would reach last.
+ *
+ * Completed tasks are handed to an 'emit' callback strictly in index order
+ * (a task is only emitted once all the tasks before it have been emitted),
+ * so output merged there is deterministic regardless of scheduling.
+ *
+ * The worker threads live as long as the pool and wait for the next run()
+ * in between, so the thread-local state of the prover (its ProverSession
+ * and counterexample banks) carries over from one tile to the next. A pool
+ * of one worker runs the tasks on the calling thread instead.
+ */
+class WorkStealingPool {
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    int num_workers;
+    std::vector<Queue> queues;
+
+    std::mutex emit_mutex;
+    std::vector<bool> done;
+    size_t next_to_emit;
+
+    // The current run, handed to the worker threads under 'mutex'
+    std::mutex mutex;
+    std::condition_variable started, finished;
+    uint64_t generation;
+    int busy;
+    bool stopping;
+    const std::function<void(int, size_t)> *task;
+    const std::function<void(size_t)> *emit;
+    std::vector<std::thread> threads;
+
+    bool pop(int worker, size_t &task) {
+        Queue &q = queues[worker];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.tasks.empty()) {
+            return false;
+        }
+        task = q.tasks.back();
+        q.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(int thief, size_t &task) {
+        for (int i = 1; i < num_workers; ++i) {
+            Queue &q = queues[(thief + i) % num_workers];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.tasks.empty()) {
+                task = q.tasks.front();
+                q.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static bool &worker_thread() {
+        static thread_local bool is_worker = false;
+        return is_worker;
+    }
+
+    void complete(size_t t) {
+        std::lock_guard<std::mutex> lock(emit_mutex);
+        done[t] = true;
+        while ((next_to_emit < done.size()) && done[next_to_emit]) {
+            (*emit)(next_to_emit++);
+        }
+    }
+
+    void work(int worker) {
+        size_t t;
+        while (pop(worker, t) || steal(worker, t)) {
+            (*task)(worker, t);
+            complete(t);
+        }
+    }
+
+    void worker_loop(int worker) {
+        worker_thread() = true;
+        uint64_t last = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                started.wait(lock, [&]() { return stopping || (generation != last); });
+                if (stopping) {
+                    return;
+                }
+                last = generation;
+            }
+            work(worker);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy == 0) {
+                finished.notify_one();
+            }
+        }
+    }
+
+public:
+    WorkStealingPool(int num_workers)
+        : num_workers(std::max(num_workers, 1)), queues(std::max(num_workers, 1)), next_to_emit(0),
+          generation(0), busy(0), stopping(false), task(nullptr), emit(nullptr) {
+        if (this->num_workers > 1) {
+            for (int w = 0; w < this->num_workers; ++w) {
+                threads.emplace_back(&WorkStealingPool::worker_loop, this, w);
+            }
+        }
+    }
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        started.notify_all();
+        for (auto &t : threads) {
+            t.join();
+        }
+    }
+
+    int size() const { return num_workers; }
+
+    // Whether the calling thread is a worker of a pool of several, which
+    // keep the cores busy between them: work it would spread over more
+    // threads is better done serially
+    static bool is_worker_thread() { return worker_thread(); }
+
+    /**
+     * Run 'task(worker, index)' for every index in [0, num_tasks) and call
+     * 'emit(index)' in increasing index order as the tasks complete. 'worker'
+     * is in [0, size()) and may be used to index per-worker state. Returns
+     * once every task has run and been emitted. Must not be called from a
+     * task of the same pool.
+     */
+    void run(size_t num_tasks,
+             const std::function<void(int, size_t)> &task,
+             const std::function<void(size_t)> &emit) {
+        done.assign(num_tasks, false);
+        next_to_emit = 0;
+
+        // Deal the tasks out in contiguous blocks, each worker popping its
+        // block from the lowest index up.
+        size_t block = (num_tasks + num_workers - 1) / num_workers;
+        for (int w = 0; w < num_workers; ++w) {
+            size_t begin = std::min(num_tasks, w * block);
+            size_t end = std::min(num_tasks, begin + block);
+            for (size_t t = end; t > begin; --t) {
+                queues[w].tasks.push_back(t - 1);
+            }
+        }
+
+        this->task = &task;
+        this->emit = &emit;
+        if (num_workers == 1) {
+            work(0);
+        } else {
+            std::unique_lock<std::mutex> lock(mutex);
+            busy = num_workers;
+            generation++;
+            started.notify_all();
+            finished.wait(lock, [&]() { return busy == 0; });
+        }
+        ASSERT(next_to_emit == num_tasks, "Not all tasks were emitted\n");
+    }
+};
+
+#endif
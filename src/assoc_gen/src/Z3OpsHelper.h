@@ -3,7 +3,7 @@
 
 /** \file
  *
- * C++ wrapper methods for z3 bitvector arithmetic ops.
+ * C++ wrapper methods for z3 bitvector and floating-point arithmetic ops.
  */
 
 #include "z3++.h"
@@ -88,6 +88,116 @@ inline uint64_t to_uint(const z3::expr &a) {
     return a.get_numeral_uint64();
 }
 
+/** Floating-point ops, rounding to nearest even like Halide's. The sort of a
+ * Halide float of 'bits' bits is the IEEE format of that width. */
+inline z3::sort fp_sort(z3::context &ctx, int bits) {
+    if (bits == 16) {
+        return to_sort(ctx, Z3_mk_fpa_sort_16(ctx));
+    } else if (bits == 32) {
+        return to_sort(ctx, Z3_mk_fpa_sort_32(ctx));
+    }
+    return to_sort(ctx, Z3_mk_fpa_sort_64(ctx));
+}
+
+inline z3::expr fp_val(z3::context &ctx, double value, int bits) {
+    return to_expr(ctx, Z3_mk_fpa_numeral_double(ctx, value, fp_sort(ctx, bits)));
+}
+
+inline z3::expr fp_add(const z3::expr &a, const z3::expr &b) {
+    return to_expr(a.ctx(), Z3_mk_fpa_add(a.ctx(), Z3_mk_fpa_rne(a.ctx()), a, b));
+}
+
+inline z3::expr fp_sub(const z3::expr &a, const z3::expr &b) {
+    return to_expr(a.ctx(), Z3_mk_fpa_sub(a.ctx(), Z3_mk_fpa_rne(a.ctx()), a, b));
+}
+
+inline z3::expr fp_mul(const z3::expr &a, const z3::expr &b) {
+    return to_expr(a.ctx(), Z3_mk_fpa_mul(a.ctx(), Z3_mk_fpa_rne(a.ctx()), a, b));
+}
+
+inline z3::expr fp_div(const z3::expr &a, const z3::expr &b) {
+    return to_expr(a.ctx(), Z3_mk_fpa_div(a.ctx(), Z3_mk_fpa_rne(a.ctx()), a, b));
+}
+
+/** IEEE comparisons: false if either is NaN, and -0 == +0. */
+inline z3::expr fp_equal(const z3::expr &a, const z3::expr &b) {
+    return to_expr(a.ctx(), Z3_mk_fpa_eq(a.ctx(), a, b));
+}
+
+inline z3::expr fp_lt(const z3::expr &a, const z3::expr &b) {
+    return to_expr(a.ctx(), Z3_mk_fpa_lt(a.ctx(), a, b));
+}
+
+inline z3::expr fp_le(const z3::expr &a, const z3::expr &b) {
+    return to_expr(a.ctx(), Z3_mk_fpa_leq(a.ctx(), a, b));
+}
+
+inline z3::expr fp_gt(const z3::expr &a, const z3::expr &b) {
+    return to_expr(a.ctx(), Z3_mk_fpa_gt(a.ctx(), a, b));
+}
+
+inline z3::expr fp_ge(const z3::expr &a, const z3::expr &b) {
+    return to_expr(a.ctx(), Z3_mk_fpa_geq(a.ctx(), a, b));
+}
+
+inline z3::expr fp_min(const z3::expr &a, const z3::expr &b) {
+    return z3::ite(fp_le(a, b), a, b);
+}
+
+inline z3::expr fp_max(const z3::expr &a, const z3::expr &b) {
+    return z3::ite(fp_ge(a, b), a, b);
+}
+
+/** Halide's float mod, a - b * floor(a / b). */
+inline z3::expr fp_mod(const z3::expr &a, const z3::expr &b) {
+    z3::expr quotient = fp_div(a, b);
+    z3::expr floor = to_expr(a.ctx(), Z3_mk_fpa_round_to_integral(a.ctx(), Z3_mk_fpa_rtn(a.ctx()), quotient));
+    return fp_sub(a, fp_mul(b, floor));
+}
+
+inline z3::expr fp_is_nan(const z3::expr &a) {
+    return to_expr(a.ctx(), Z3_mk_fpa_is_nan(a.ctx(), a));
+}
+
+inline z3::expr fp_cast(const z3::expr &a, int new_bits) {
+    return to_expr(a.ctx(), Z3_mk_fpa_to_fp_float(a.ctx(), Z3_mk_fpa_rne(a.ctx()), a, fp_sort(a.ctx(), new_bits)));
+}
+
+inline z3::expr bv_to_fp(const z3::expr &a, int new_bits, bool is_signed) {
+    z3::context &ctx = a.ctx();
+    if (is_signed) {
+        return to_expr(ctx, Z3_mk_fpa_to_fp_signed(ctx, Z3_mk_fpa_rne(ctx), a, fp_sort(ctx, new_bits)));
+    }
+    return to_expr(ctx, Z3_mk_fpa_to_fp_unsigned(ctx, Z3_mk_fpa_rne(ctx), a, fp_sort(ctx, new_bits)));
+}
+
+/** Float to integer casts truncate, like C's. */
+inline z3::expr fp_to_bv(const z3::expr &a, int new_bits, bool is_signed) {
+    z3::context &ctx = a.ctx();
+    if (is_signed) {
+        return to_expr(ctx, Z3_mk_fpa_to_sbv(ctx, Z3_mk_fpa_rtz(ctx), a, new_bits));
+    }
+    return to_expr(ctx, Z3_mk_fpa_to_ubv(ctx, Z3_mk_fpa_rtz(ctx), a, new_bits));
+}
+
+/** The value of the floating-point numeral a, as a double. */
+inline double fp_to_double(const z3::expr &a) {
+    z3::context &ctx = a.ctx();
+    auto holds = [&](Z3_ast test) {
+        return Z3_get_bool_value(ctx, z3::expr(ctx, test).simplify()) == Z3_L_TRUE;
+    };
+    bool negative = holds(Z3_mk_fpa_is_negative(ctx, a));
+    if (holds(Z3_mk_fpa_is_nan(ctx, a))) {
+        return std::nan("");
+    } else if (holds(Z3_mk_fpa_is_infinite(ctx, a))) {
+        return negative ? -INFINITY : INFINITY;
+    } else if (holds(Z3_mk_fpa_is_zero(ctx, a))) {
+        return negative ? -0.0 : 0.0;
+    }
+    z3::expr real = z3::expr(ctx, Z3_mk_fpa_to_real(ctx, a)).simplify();
+    return std::strtod(Z3_get_numeral_decimal_string(ctx, real, 20), nullptr);
+}
+
 }
 
 #endif
@@ -195,7 +195,11 @@ with open(cpp_filename, 'w') as f:
     f.seek(0)
 
     # Actually write the lines
-    f.write("#include \"" + header_filename + "\"\n\n")
+    f.write("#include \"" + header_filename + "\"\n")
+    f.write("#include \"AssociativeOpsIndex.h\"\n\n")
+    f.write("#include <chrono>\n")
+    f.write("#include <map>\n")
+    f.write("#include <string>\n\n")
     f.write("using std::vector;\n\n")
     f.write("namespace Halide {\nnamespace Internal {\n\n")
 
@@ -209,7 +213,8 @@ with open(cpp_filename, 'w') as f:
     f.write("const Expr i32_x0 = Variable::make(i32, \"x0\");\n")
     f.write("const Expr i32_y0 = Variable::make(i32, \"y0\");\n")
     f.write("const Expr i32_x1 = Variable::make(i32, \"x1\");\n")
-    f.write("const Expr i32_y1 = Variable::make(i32, \"y1\");\n\n")
+    f.write("const Expr i32_y1 = Variable::make(i32, \"y1\");\n")
+    f.write("const Expr k0 = Variable::make(i32, \"k0\");\n\n")
 
     f.write("const Expr i32_mul_x0y0 = Mul::make(i32_x0, i32_y0);\n")
     f.write("const Expr i32_mul_x0x0 = Mul::make(i32_x0, i32_x0);\n")
@@ -392,14 +397,47 @@ with open(cpp_filename, 'w') as f:
 
     f.write("using namespace Halide;\n")
     f.write("using namespace Halide::Internal;\n\n")
-    f.write("int main() {\n");
-
+    f.write("// Look up every entry of the tables, instantiated on other variables, with\n")
+    f.write("// the index and with a scan of the whole table, which must agree\n")
+    f.write("int main() {\n")
     f.write(tab + "Expr x = Variable::make(Int(32), \"x\");\n")
     f.write(tab + "Expr y = Variable::make(Int(32), \"y\");\n")
     f.write(tab + "Expr expr = Min::make(x, y);\n")
-    f.write(tab + "const auto &table = get_i32_ops_table({expr});\n")
-    f.write(tab + "std::cout << \"Op: \" << table[0][0].op << \" with id: \" << table[0][0].identity << \"\\n\";\n")
+    f.write(tab + "std::map<std::string, Expr> bindings;\n")
+    f.write(tab + "const auto *entry = match_i32_ops_table({expr}, bindings);\n")
+    f.write(tab + "std::cout << \"Op: \" << (*entry)[0].op << \" with id: \" << (*entry)[0].identity << \"\\n\";\n")
+    f.write("\n")
+    f.write(tab + "std::map<std::string, Expr> renames = {{\"x0\", x}, {\"y0\", y}, {\"k0\", make_const(Int(32), 3)}};\n")
+    f.write(tab + "double t_index = 0, t_scan = 0;\n")
+    f.write(tab + "int lookups = 0;\n")
+    f.write(tab + "for (Expr root : {Add::make(x, y), Sub::make(x, y), Mul::make(x, y), Min::make(x, y), Max::make(x, y)}) {\n")
+    f.write(tab + tab + "const auto &table = get_i32_ops_table({root});\n")
+    f.write(tab + tab + "// Build the index before timing it\n")
+    f.write(tab + tab + "match_i32_ops_table({root}, bindings);\n")
+    f.write(tab + tab + "for (size_t i = 0; i < table.size(); ++i) {\n")
+    f.write(tab + tab + tab + "vector<Expr> exprs = {substitute(renames, table[i][0].op)};\n")
+    f.write(tab + tab + tab + "auto start = std::chrono::steady_clock::now();\n")
+    f.write(tab + tab + tab + "entry = match_i32_ops_table(exprs, bindings);\n")
+    f.write(tab + tab + tab + "auto middle = std::chrono::steady_clock::now();\n")
+    f.write(tab + tab + tab + "const vector<AssociativePair> *scanned = nullptr;\n")
+    f.write(tab + tab + tab + "for (size_t j = 0; !scanned && (j < table.size()); ++j) {\n")
+    f.write(tab + tab + tab + tab + "std::map<std::string, Expr> matches;\n")
+    f.write(tab + tab + tab + tab + "if (expr_match(table[j][0].op, exprs[0], matches)) {\n")
+    f.write(tab + tab + tab + tab + tab + "scanned = &table[j];\n")
+    f.write(tab + tab + tab + tab + "}\n")
+    f.write(tab + tab + tab + "}\n")
+    f.write(tab + tab + tab + "auto end = std::chrono::steady_clock::now();\n")
+    f.write(tab + tab + tab + "t_index += std::chrono::duration<double>(middle - start).count();\n")
+    f.write(tab + tab + tab + "t_scan += std::chrono::duration<double>(end - middle).count();\n")
+    f.write(tab + tab + tab + "lookups++;\n")
+    f.write(tab + tab + tab + "if (entry != scanned) {\n")
+    f.write(tab + tab + tab + tab + "std::cerr << \"The index and the scan disagree on \" << exprs[0] << \"\\n\";\n")
+    f.write(tab + tab + tab + tab + "return -1;\n")
+    f.write(tab + tab + tab + "}\n")
+    f.write(tab + tab + "}\n")
+    f.write(tab + "}\n")
+    f.write(tab + "std::cout << \"Lookups: \" << lookups << \"\\tindex: \" << 1e6 * t_index / lookups << \" us\"\n")
+    f.write(tab + tab + tab + "  << \"\\tscan: \" << 1e6 * t_scan / lookups << \" us\\n\";\n")
     f.write(tab + "return 0;\n")
-    f.write("}\n\n")
-
-
+    f.write("}\n")
+    f.write("\n")